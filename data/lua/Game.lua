@@ -33,11 +33,39 @@ Game = {
 				-- nothing
 			elseif delete then
 				Object.delete(object)
-			elseif object.objectType[action] then
-				object.objectType[action](object)
+			else
+				ObjectType.call(object.objectType, action, object)
 			end
 		end
 	end,
+
+	--- Get the state of the game as plain data for a snapshot.
+	---
+	--- The objects are copied with their object types replaced by ids.
+	saveState = function()
+		local objects = {}
+		for id, object in pairs(Game.objects) do
+			local t = {}
+			for k, v in pairs(object) do
+				t[k] = v
+			end
+			t.objectType = object.objectType.id
+			objects[id] = t
+		end
+		return {
+			freeIdCounter = Game.freeIdCounter,
+			objects = objects,
+		}
+	end,
+
+	--- Restore the state returned by saveState.
+	loadState = function(state)
+		Game.freeIdCounter = state.freeIdCounter
+		Game.objects = state.objects
+		for id, object in pairs(Game.objects) do
+			object.objectType = Game.objectTypes[object.objectType]
+		end
+	end,
 }
 
 --- Methods related to the Message class.
@@ -69,6 +97,23 @@ ObjectType = {
 		Game.objectTypes[t.id] = t
 		return t
 	end,
+
+	--- Call a method of an object type, if it has one.
+	---
+	--- The time is measured for the object type in the profiler.
+	--- Errors are passed on after the label is closed, so that the
+	--- later labels aren't charged to this one.
+	call = function(objectType, method, object)
+		local f = objectType[method]
+		if f then
+			profileBegin(objectType.name or objectType.id)
+			local ok, err = pcall(f, object)
+			profileEnd()
+			if not ok then
+				error(err, 0)
+			end
+		end
+	end,
 }
 
 --- Methods related to the ObjectAction class.
@@ -103,21 +148,24 @@ Object = {
 			nil
 		)
 		Game.objects[t.id] = t
-		if t.objectType.new then
-			t.objectType.new(t)
-		end
+		ObjectType.call(t.objectType, "new", t)
 		return t
 	end,
 
 	--- Delete an existing object.
 	delete = function(t)
-		if t.objectType.delete then
-			t.objectType.delete(t)
-		end
+		ObjectType.call(t.objectType, "delete", t)
 		if t.id then
 			luaDeleteObject(t.id)
 			Game.objects[t.id] = nil
 			t.id = nil
 		end
 	end,
+
+	--- Make an idle object active again, e.g. after a script has changed it.
+	wake = function(t)
+		if t.id then
+			luaWakeObject(t.id)
+		end
+	end,
 }
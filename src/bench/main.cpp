@@ -0,0 +1,233 @@
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <string>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <cmath>
+
+#include "ProgramInfo.hpp"
+#include "util/Path.hpp"
+#include "util/JobSystem.hpp"
+#include "game/Game.hpp"
+
+/** The number of heap allocations with operator new. */
+static std::atomic<unsigned long long> allocationCount(0);
+
+/**
+ * Count the allocations; everything else is left to malloc.
+ */
+void* operator new(std::size_t size) {
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	void* p = std::malloc(size ? size : 1);
+	if (!p) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+/**
+ * Game with extra methods for setting up benchmarks.
+ */
+class BenchGame: public Game::Game {
+	/** Compiled Lua code for creating an object. */
+	Reference newObjectFunction;
+
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param map The map.
+	 */
+	BenchGame(std::shared_ptr< ::Game::Map> map):
+		Game(map) {
+		newObjectFunction = compile("local t = {...}; Object.new({objectTypeId = t[1], playerId = t[2], x = t[3], y = t[4]})", "newObject");
+	}
+
+	/**
+	 * Create an object like the tech tree does.
+	 *
+	 * @param objectTypeId The object type.
+	 * @param playerId The owner.
+	 * @param x The x coordinate.
+	 * @param y The y coordinate.
+	 */
+	void newObject(const std::string& objectTypeId, int playerId, double x, double y) {
+		callReference(newObjectFunction, 0, Lua::String(objectTypeId), Lua::Number(playerId), Lua::Number(x), Lua::Number(y));
+	}
+};
+
+/**
+ * Get the ids of a player's objects in order.
+ *
+ * @param game The game.
+ * @param playerId The player.
+ * @return The ids.
+ */
+static std::vector<Game::Object::IdType> getPlayerObjects(const Game::Game& game, int playerId) {
+	std::vector<Game::Object::IdType> ids;
+	const Game::Game::ObjectContainerType& objects = game.getObjects();
+	for (Game::Game::ObjectContainerType::const_iterator i = objects.begin(); i != objects.end(); ++i) {
+		if (i->second->getOwner()->id == playerId) {
+			ids.push_back(i->first);
+		}
+	}
+	std::sort(ids.begin(), ids.end());
+	return ids;
+}
+
+/**
+ * Get an integer option.
+ *
+ * @param options The options.
+ * @param key The name of the option.
+ * @param defaultValue The value if the option is not given.
+ * @return The value.
+ */
+static int getOption(const std::map<std::string, std::string>& options, const std::string& key, int defaultValue) {
+	std::map<std::string, std::string>::const_iterator i = options.find(key);
+	return i == options.end() ? defaultValue : std::stoi(i->second);
+}
+
+/**
+ * Main function for the benchmark.
+ *
+ * The options are given as key=value: size (map width and height),
+ * players, units (per player), seconds (of game time), interval (seconds
+ * between orders), scenario (idle, move or delete), threads (-1 for none,
+ * 0 for one less than the cores), simd (0 for the scalar movement code)
+ * and seed.
+ */
+int main(int argc, char** argv)
+try {
+	Path::init(argc ? argv[0] : "./bin/unknown.exe");
+	std::cout << ProgramInfo::name << " (version " << ProgramInfo::version << ", benchmark)" << std::endl;
+
+	std::map<std::string, std::string> options;
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg(argv[i]);
+		const std::string::size_type eq = arg.find('=');
+		if (eq == std::string::npos) {
+			throw std::runtime_error("Invalid argument: " + arg + " (expected key=value)");
+		}
+		options[arg.substr(0, eq)] = arg.substr(eq + 1);
+	}
+	const int size = std::max(8, getOption(options, "size", 128));
+	const int playerCount = std::max(1, getOption(options, "players", 2));
+	const int units = std::max(0, getOption(options, "units", 500));
+	const int seconds = std::max(1, getOption(options, "seconds", 30));
+	const int interval = std::max(1, getOption(options, "interval", 2));
+	const int threads = getOption(options, "threads", -1);
+	const int seed = getOption(options, "seed", 1);
+	const bool simd = getOption(options, "simd", 1) != 0;
+	const std::string scenario = options.count("scenario") ? options["scenario"] : "move";
+	if (scenario != "idle" && scenario != "move" && scenario != "delete") {
+		throw std::runtime_error("Unknown scenario: " + scenario);
+	}
+
+	std::cout << "Map " << size << "x" << size << ", " << playerCount << " players, " << units << " extra units each, scenario " << scenario << ", ";
+	if (threads >= 0) {
+		std::cout << "job system with " << threads << " threads";
+	} else {
+		std::cout << "no job system";
+	}
+	std::cout << (simd ? ", SIMD movement." : ", scalar movement.") << std::endl;
+
+	// Set up the game.
+	std::chrono::steady_clock::time_point setupStart = std::chrono::steady_clock::now();
+	std::shared_ptr<Game::Map> map(new Game::Map());
+	map->generate(size, size, playerCount);
+	BenchGame game(map);
+	if (threads >= 0) {
+		game.setJobSystem(std::make_shared<JobSystem>(threads));
+	}
+	game.setVectorized(simd);
+	const Game::Map::PlayerContainerType& mapPlayers = map->getPlayers();
+	for (Game::Map::PlayerContainerType::const_iterator i = mapPlayers.begin(); i != mapPlayers.end(); ++i) {
+		std::shared_ptr<Game::Client> client(new Game::Client);
+		client->id = i->first;
+		client->players.insert(i->first);
+		game.insertClient(client);
+
+		// The army is a square around the starting position.
+		const int side = (int) std::ceil(std::sqrt((double) units));
+		const Vector2<SIUnit::Position>& start = i->second.startPosition;
+		for (int j = 0; j < units; ++j) {
+			const double x = start.x.getDouble() + (j % side - side / 2) * 1.2;
+			const double y = start.y.getDouble() + (j / side - side / 2) * 1.2;
+			game.newObject(j % 2 ? "testUnit" : "testUnit2", i->first, x, y);
+		}
+	}
+	const double setupSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - setupStart).count();
+	std::cout << "Setup took " << setupSeconds << " s, " << game.getObjects().size() << " objects." << std::endl;
+
+	// Run the game one step at a time, with the orders inserted just before their step.
+	const Scalar<SIUnit::Time> dt = Game::Game::getStepLength();
+	const int ticks = (int) (seconds / dt.getDouble());
+	const int ordersEvery = (int) (interval / dt.getDouble());
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<double> coordinate(1, size - 1);
+	std::vector<double> tickTimes;
+	tickTimes.reserve(ticks);
+	unsigned int sequence = 0;
+	unsigned long long allocations = 0;
+	for (int tick = 1; tick <= ticks; ++tick) {
+		if (scenario != "idle" && (tick - 1) % ordersEvery == 0) {
+			for (Game::Map::PlayerContainerType::const_iterator i = mapPlayers.begin(); i != mapPlayers.end(); ++i) {
+				std::vector<Game::Object::IdType> ids(getPlayerObjects(game, i->first));
+				Game::Message message;
+				message.client = i->first;
+				message.sequence = ++sequence;
+				message.timestamp = dt * Scalar<>(tick);
+				message.action = Game::ObjectAction::MOVE;
+				message.position = Vector2<SIUnit::Position>(coordinate(random), coordinate(random));
+				if (scenario == "delete" && tick > 1) {
+					// Delete a tenth of the original army.
+					message.action = Game::ObjectAction::DELETE;
+					ids.resize(std::min(ids.size(), (std::size_t) units / 10 + 1));
+				}
+				for (Game::Object::IdType id: ids) {
+					message.actors.push_back(id);
+				}
+				game.insertMessage(message);
+			}
+		}
+
+		const unsigned long long allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		game.runUntil(dt * Scalar<>(tick));
+		tickTimes.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+		allocations += allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+	}
+
+	// Report.
+	double total = 0;
+	for (double t: tickTimes) {
+		total += t;
+	}
+	std::sort(tickTimes.begin(), tickTimes.end());
+	const double p50 = tickTimes[tickTimes.size() / 2];
+	const double p99 = tickTimes[std::min(tickTimes.size() - 1, tickTimes.size() * 99 / 100)];
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << "Ran " << ticks << " ticks in " << total << " s: " << ticks / total << " ticks/s." << std::endl;
+	std::cout << "Tick time: p50 " << p50 * 1000 << " ms, p99 " << p99 * 1000 << " ms, max " << tickTimes.back() * 1000 << " ms." << std::endl;
+	std::cout << "Allocations: " << (double) allocations / ticks << " per tick; Lua memory peak " << game.getPeakMemoryUsage() / 1024 << " kB." << std::endl;
+	std::cout << "Objects at the end: " << game.getObjects().size() << ", state hash " << std::hex << game.getStateHash() << std::dec << "." << std::endl;
+	return 0;
+} catch (std::exception& e) {
+	std::cerr << "Fatal exception: " << e.what() << std::endl;
+	return 1;
+} catch (...) {
+	std::cerr << "Fatal exception of unknown cause!" << std::endl;
+	return 1;
+}
@@ -1,11 +1,44 @@
 #include <iostream>
 #include <stdexcept>
+#include <list>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
 
 #include "ProgramInfo.hpp"
 #include "util/Path.hpp"
 #include "util/Configuration.hpp"
+#include "util/JobSystem.hpp"
 #include "connection/Server.hpp"
+#include "connection/Host.hpp"
 #include "connection/TCPListener.hpp"
+#include "connection/ReplayPlayer.hpp"
+#include "game/Game.hpp"
+
+/**
+ * Simulate a replay as fast as possible and report the speed.
+ *
+ * @param path The replay file.
+ * @param startTime The game time to seek to before measuring.
+ * @param jobSystem The job system for the simulation, or NULL.
+ */
+static void playReplay(const std::string& path, double startTime, std::shared_ptr<JobSystem> jobSystem) {
+	Connection::ReplayPlayer player(path);
+	player.setJobSystem(jobSystem);
+	if (startTime > 0) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		player.seek(startTime);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "Seeked to " << player.getTime().getDouble() << " s in " << seconds << " s." << std::endl;
+	}
+	const double startGameTime = player.getTime().getDouble();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	player.run();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	double gameSeconds = player.getTime().getDouble() - startGameTime;
+	std::cout << "Simulated " << gameSeconds << " s of game time in " << seconds << " s ("
+		<< (gameSeconds / Game::Game::getStepLength().getDouble()) / seconds << " steps/s)." << std::endl;
+}
 
 /**
  * Main function for the command-line interface.
@@ -18,33 +51,87 @@ try {
 
 	Configuration config(Path::getConfigPath("cli.conf"));
 
-	std::shared_ptr<Connection::Server> server(new Connection::Server());
+	std::string name = config.getString("game.name", "Game at " + boost::asio::ip::host_name());
+	int port = config.getInt("game.port", 6667);
+
+	// Zero threads means one less than the number of cores.
+	std::shared_ptr<JobSystem> jobSystem;
+	int threads = config.getInt("game.threads", 0);
+	if (threads >= 0) {
+		jobSystem = std::make_shared<JobSystem>(threads);
+	}
+
+	// Limit the Lua instructions per message callback (zero means no limit) and write a Lua profile if a file is given.
+	int instructionBudget = std::max(0, config.getInt("lua.budget", 0));
+	std::string profilePath = config.getString("lua.profile", "");
 
-	server->setName(config.getString("game.name", "Game at " + boost::asio::ip::host_name()));
+	// Limit the Lua memory per game in megabytes; zero means no limit.
+	std::size_t memoryLimit = std::max(0, config.getInt("lua.memoryLimit", 0)) * (std::size_t) 1024 * 1024;
 
-	int listeners = 0;
+	// Take a snapshot this often (in game seconds) so that clients can rejoin; zero turns this off.
+	double snapshotInterval = std::max(0.0, config.getDouble("game.snapshotInterval", 30));
+
+	// Replay mode: "--replay file [start time]" simulates a recorded game and quits.
+	if ((argc == 3 || argc == 4) && std::string(argv[1]) == "--replay") {
+		playReplay(argv[2], argc == 4 ? std::atof(argv[3]) : 0, jobSystem);
+		return 0;
+	}
+
+	std::list<std::shared_ptr<Connection::Listener> > listeners;
 	try {
 		std::cout << "Starting TCP listener on IPv6... ";
-		server->addListener(std::make_shared<Connection::TCPListener>(boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v6(), 6667)));
+		listeners.push_back(std::make_shared<Connection::TCPListener>(boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v6(), port)));
 		std::cout << "OK!\n";
-		++listeners;
 	} catch (std::runtime_error& e) {
 		std::cout << "Error! " << e.what() << "\n";
 	}
 	try {
 		std::cout << "Starting TCP listener on IPv4... ";
-		server->addListener(std::make_shared<Connection::TCPListener>(boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), 6667)));
+		listeners.push_back(std::make_shared<Connection::TCPListener>(boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port)));
 		std::cout << "OK!\n";
-		++listeners;
 	} catch (std::runtime_error& e) {
 		std::cout << "Error! " << e.what() << "\n";
 	}
-	if (!listeners) {
+	if (listeners.empty()) {
 		std::cout << "No listeners, bailing out...\n";
 		return 1;
 	}
+
+	// With host.games set, host many games at once; otherwise run just one.
+	int games = config.getInt("host.games", 0);
+	if (games > 0) {
+		// Zero threads means one per core.
+		Connection::Host host(std::max(0, config.getInt("host.threads", 0)), games);
+		host.setName(name);
+		host.setJobSystem(jobSystem);
+		host.setInstructionBudget(instructionBudget);
+		host.setProfilePath(profilePath);
+		host.setMemoryLimit(memoryLimit);
+		host.setReplayDirectory(config.getString("host.replays", ""));
+		host.setSnapshotInterval(snapshotInterval);
+		host.setReadyGames(std::max(0, config.getInt("host.readyGames", 1)));
+		for (std::list<std::shared_ptr<Connection::Listener> >::iterator i = listeners.begin(); i != listeners.end(); ++i) {
+			host.addListener(*i);
+		}
+		std::cout << "Listeners added, hosting up to " << games << " games." << std::endl;
+		host.run();
+		return 0;
+	}
+
+	std::shared_ptr<Connection::Server> server(new Connection::Server());
+	server->setName(name);
+	server->setJobSystem(jobSystem);
+	server->setInstructionBudget(instructionBudget);
+	server->setProfilePath(profilePath);
+	server->setMemoryLimit(memoryLimit);
+	server->setReplayPath(config.getString("game.replay", ""));
+	server->setSnapshotInterval(snapshotInterval);
+	for (std::list<std::shared_ptr<Connection::Listener> >::iterator i = listeners.begin(); i != listeners.end(); ++i) {
+		server->addListener(*i);
+	}
 	std::cout << "Listeners added, starting the main loop." << std::endl;
 	server->run();
+	server->writeProfile();
 	return 0;
 } catch (std::exception& e) {
 	std::cerr << "Fatal exception: " << e.what() << std::endl;
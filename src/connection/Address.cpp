@@ -19,7 +19,7 @@ std::shared_ptr<Connection::EndPoint> Connection::Address::connect(const std::st
 
 std::string Connection::Address::toString(const Listener& listener) {
 	if (const TCPListener* tcp = dynamic_cast<const TCPListener*>(&listener)) {
-		boost::asio::ip::tcp::endpoint endpoint = tcp->acceptor.local_endpoint();
+		boost::asio::ip::tcp::endpoint endpoint = tcp->getLocalEndpoint();
 		boost::asio::ip::address address = endpoint.address();
 		if (address.is_loopback()) {
 			throw std::runtime_error("No address available!");
@@ -1,12 +1,51 @@
+#include <fstream>
+#include <mutex>
+
 #include "Base.hpp"
 
 #include "game/Game.hpp"
+#include "game/GamePool.hpp"
+#include "util/Deserializer.hpp"
+
+/** Lock for writing the profiles; many games may end at once. */
+static std::mutex profileMutex;
+
+Connection::Base::~Base() {
+}
+
+void Connection::Base::writeProfile() const {
+	if (!game || profilePath.empty()) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(profileMutex);
+	std::ofstream stream(profilePath.c_str(), std::ios::app);
+	if (!stream) {
+		throw std::runtime_error("Connection::Base::writeProfile: Can't open " + profilePath + "!");
+	}
+	game->writeProfile(stream);
+	stream.close();
+	if (!stream) {
+		throw std::runtime_error("Connection::Base::writeProfile: Can't write " + profilePath + "!");
+	}
+}
+
+void Connection::Base::createGame() {
+	if (gamePool) {
+		game = gamePool->take();
+	} else {
+		std::shared_ptr<Game::Map> map(new Game::Map());
+		map->load("maps/testmap");
+		game.reset(new Game::Game(map));
+	}
+	game->setJobSystem(jobSystem);
+	game->setInstructionBudget(instructionBudget);
+	game->setMemoryLimit(memoryLimit);
+	game->setProfiling(!profilePath.empty());
+}
 
 void Connection::Base::initGame() {
 	state = INIT;
-	std::shared_ptr<Game::Map> map(new Game::Map());
-	map->load("maps/testmap");
-	game.reset(new Game::Game(map));
+	createGame();
 
 	const Game::Game::PlayerContainerType& players(game->getPlayers());
 	Game::Game::PlayerContainerType::const_iterator p = players.begin();
@@ -22,6 +61,51 @@ void Connection::Base::initGame() {
 	}
 }
 
+void Connection::Base::loadSnapshot(const std::string& snapshot) {
+	createGame();
+	game->loadSnapshot(snapshot);
+	expectedHashes.clear();
+	for (ClientInfoContainerType::iterator i = clients.begin(); i != clients.end(); ++i) {
+		game->insertClient(i->second);
+	}
+	state = PLAY;
+}
+
 void Connection::Base::startGame() {
 	state = PLAY;
 }
+
+Scalar<SIUnit::Time> Connection::Base::handleBatch(const char* data, std::size_t size) {
+	Deserializer input(data, size);
+	bool more;
+	while (input.get(more), more) {
+		Game::Message msg(input);
+		game->insertMessage(msg);
+	}
+	Scalar<SIUnit::Time> time;
+	input.get(time);
+
+	// The state hashes of the steps up to the last one.
+	std::uint64_t step, hash;
+	unsigned int count;
+	input.get(step);
+	input.get(count);
+	while (count--) {
+		input.get(hash);
+		expectedHashes.push_back(std::make_pair(step - count, hash));
+	}
+	return time;
+}
+
+bool Connection::Base::checkStateHashes() {
+	bool found = false;
+	while (!expectedHashes.empty() && expectedHashes.front().first <= game->getStep()) {
+		std::uint64_t hash;
+		if (!desyncStep && game->getStateHash(expectedHashes.front().first, hash) && hash != expectedHashes.front().second) {
+			desyncStep = expectedHashes.front().first;
+			found = true;
+		}
+		expectedHashes.pop_front();
+	}
+	return found;
+}
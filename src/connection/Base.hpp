@@ -1,11 +1,15 @@
 #ifndef PUTKARTS_Connection_Base_HPP
 #define PUTKARTS_Connection_Base_HPP
 
+#include <cstdint>
 #include <string>
 #include <stdexcept>
 #include <map>
+#include <deque>
 #include <memory>
+#include <utility>
 
+#include "util/Scalar.hpp"
 #include "connection/ClientInfo.hpp"
 
 namespace Connection {
@@ -19,9 +23,12 @@ namespace Connection {
 
 namespace Game {
 	class Game;
+	class GamePool;
 	class Message;
 }
 
+class JobSystem;
+
 /**
  * Base class for local and remote game connections.
  */
@@ -39,30 +46,92 @@ protected:
 	/** The current game. */
 	std::shared_ptr<Game::Game> game;
 
+	/** Ready games to use, or NULL to set up a new game with the default map. */
+	std::shared_ptr<Game::GamePool> gamePool;
+
+	/** Worker threads for the game simulation, or NULL. */
+	std::shared_ptr<JobSystem> jobSystem;
+
+	/** The Lua instruction budget per message callback, or zero. */
+	std::uint64_t instructionBudget;
+
+	/** The file for the Lua profile, or empty if the profiler is off. */
+	std::string profilePath;
+
+	/** The maximum memory usage of Lua in bytes, or zero. */
+	std::size_t memoryLimit;
+
+	/** State hashes from the batches, by step, to compare with the game. */
+	std::deque<std::pair<std::uint64_t, std::uint64_t> > expectedHashes;
+
+	/** The first step where the game has differed from the batches, or zero. */
+	std::uint64_t desyncStep;
+
+	/**
+	 * Create the game object and apply the settings.
+	 */
+	void createGame();
+
 	/**
 	 * Initialise the game object.
 	 */
 	virtual void initGame();
 
+	/**
+	 * Create the game from a snapshot and continue playing it.
+	 *
+	 * The clients already know their players, so nothing is assigned;
+	 * they replace the clients of the same ids in the snapshot.
+	 *
+	 * @param snapshot The snapshot from Game::Game::saveSnapshot.
+	 * @throw std::runtime_error Thrown if the snapshot is invalid.
+	 */
+	void loadSnapshot(const std::string& snapshot);
+
 	/**
 	 * Start the game.
 	 */
 	virtual void startGame();
 
+	/**
+	 * Read a batch from the server: insert the messages into the game and keep the state hashes.
+	 *
+	 * @param data The batch.
+	 * @param size The length of the batch.
+	 * @return The time up to which the batches are complete.
+	 * @throw std::runtime_error Thrown if the batch is invalid.
+	 */
+	Scalar<SIUnit::Time> handleBatch(const char* data, std::size_t size);
+
+	/**
+	 * Compare the state hashes of the steps run so far with the ones from the batches.
+	 *
+	 * @return true if the game has just been found to differ; see desyncStep.
+	 */
+	bool checkStateHashes();
+
 public:
 	/**
 	 * Constructor.
 	 */
 	Base():
-		state(SETUP) {
+		state(SETUP),
+		instructionBudget(0),
+		memoryLimit(0),
+		desyncStep(0) {
 	}
 
 	/**
 	 * Virtual base destructor.
 	 */
-	virtual ~Base() {
-		// Nothing to do.
-	}
+	virtual ~Base();
+
+	/**
+	 * Append the Lua profile of the game to the profile file, if the profiler is on.
+	 *
+	 * @throw std::runtime_error if the file can't be written.
+	 */
+	void writeProfile() const;
 
 	/**
 	 * Get the current state.
@@ -83,6 +152,51 @@ public:
 		return *game;
 	}
 
+	/**
+	 * Set the worker threads to use for the game simulation.
+	 *
+	 * @param jobSystem_ The job system, or NULL to run in the calling thread.
+	 */
+	void setJobSystem(std::shared_ptr<JobSystem> jobSystem_) {
+		jobSystem = jobSystem_;
+	}
+
+	/**
+	 * Set a pool of ready games to take the game from.
+	 *
+	 * @param gamePool_ The pool, or NULL to set up a new game with the default map.
+	 */
+	void setGamePool(std::shared_ptr<Game::GamePool> gamePool_) {
+		gamePool = gamePool_;
+	}
+
+	/**
+	 * Set the Lua instruction budget per message callback.
+	 *
+	 * @param instructionBudget_ The number of instructions, or zero for no limit.
+	 */
+	void setInstructionBudget(std::uint64_t instructionBudget_) {
+		instructionBudget = instructionBudget_;
+	}
+
+	/**
+	 * Set the maximum memory usage of Lua for the game.
+	 *
+	 * @param memoryLimit_ The number of bytes, or zero for no limit.
+	 */
+	void setMemoryLimit(std::size_t memoryLimit_) {
+		memoryLimit = memoryLimit_;
+	}
+
+	/**
+	 * Turn on the Lua profiler; the results are appended to a file when the game ends.
+	 *
+	 * @param profilePath_ The file, or empty to turn the profiler off.
+	 */
+	void setProfilePath(const std::string& profilePath_) {
+		profilePath = profilePath_;
+	}
+
 	/**
 	 * Run the game up to this moment.
 	 */
@@ -1,45 +1,63 @@
 #include <memory>
 #include <string>
+#include <iostream>
+#include <algorithm>
 
 #include "Client.hpp"
 
 #include "game/Game.hpp"
+#include "util/Serializer.hpp"
 
-void Connection::Client::handlePacket(std::string& data) {
-	char type = *data.begin();
-	data.erase(data.begin());
+void Connection::Client::handlePacket(boost::string_ref data) {
+	char type = data.front();
+	data.remove_prefix(1);
 
 	// A client has joined.
 	if (type == 'c') {
-		ClientInfo info(data);
+		ClientInfo info(data.to_string());
 		clients[info.id] = std::make_shared<ClientInfo>(info);
 		if (clients.size() == 1) {
 			ownId = info.id;
 		}
+		// A client that rejoins a running game takes over players.
+		if (game) {
+			game->insertClient(clients[info.id]);
+		}
+		return;
+	}
+
+	// Our secret for rejoining.
+	if (type == 'k') {
+		rejoinToken = data.to_string();
 		return;
 	}
 
 	// A client has left.
 	if (type == 'd') {
-		clients.erase(std::stoi(data));
+		clients.erase(std::stoi(data.to_string()));
 		return;
 	}
 
-	// Game::Message.
-	if (type == 'm') {
+	// A batch of Game::Messages, followed by the time up to which the batches are complete.
+	if (type == 'b') {
 		if (game) {
-			Game::Message msg(data);
-			if (msg.timestamp > lastMessageTimestamp) {
-				prevMessageTimestamp = lastMessageTimestamp;
-				lastMessageTimestamp = msg.timestamp;
-			}
-			game->insertMessage(msg);
+			serverTime = handleBatch(data.data(), data.size());
 		}
 		return;
 	}
 
-	// Init the game.
+	// A snapshot of the running game; the batches after it follow.
+	if (type == 'S') {
+		if (state == SETUP) {
+			loadSnapshot(data.to_string());
+			serverTime = game->getTime();
+		}
+		return;
+	}
+
+	// Init the game, with the server's Lua instruction budget.
 	if (type == 'i') {
+		instructionBudget = data.empty() ? 0 : std::stoull(data.to_string());
 		initGame();
 		return;
 	}
@@ -52,7 +70,7 @@ void Connection::Client::handlePacket(std::string& data) {
 }
 
 void Connection::Client::update() {
-	std::string data;
+	boost::string_ref data;
 	while (true) {
 		try {
 			if (!connection->receivePacket(data)) {
@@ -67,8 +85,29 @@ void Connection::Client::update() {
 		}
 	}
 	if (state == PLAY) {
-		game->runUntil(prevMessageTimestamp);
+		game->runUntil(serverTime);
+		if (checkStateHashes()) {
+			reportDesync();
+		}
+	}
+}
+
+void Connection::Client::reportDesync() {
+	std::cerr << "The game is out of sync since step " << desyncStep << "!" << std::endl;
+
+	// Send the object hashes, so that the server can find the first object that differs.
+	Game::Game::ObjectHashContainerType hashes;
+	game->getObjectHashes(hashes);
+	std::sort(hashes.begin(), hashes.end());
+	Serializer report;
+	report.put(desyncStep);
+	report.put(game->getStep());
+	report.put((unsigned int) hashes.size());
+	for (Game::Game::ObjectHashContainerType::const_iterator i = hashes.begin(); i != hashes.end(); ++i) {
+		report.put(i->first);
+		report.put(i->second);
 	}
+	connection->sendPacket("x" + report.getData());
 }
 
 void Connection::Client::sendMessage(const Game::Message& message) {
@@ -82,3 +121,7 @@ void Connection::Client::setReadyToInit() {
 void Connection::Client::setReadyToStart() {
 	connection->sendPacket("s");
 }
+
+void Connection::Client::joinRunningGame(int oldId, const std::string& token) {
+	connection->sendPacket("r" + std::to_string(oldId) + " " + token);
+}
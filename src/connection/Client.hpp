@@ -25,18 +25,23 @@ class Connection::Client: virtual public Connection::Base {
 	/** The client id of this client. */
 	int ownId;
 
-	/** The greatest message timestamp. */
-	Scalar<SIUnit::Time> lastMessageTimestamp;
+	/** The secret for rejoining the game with the players of this client. */
+	std::string rejoinToken;
 
-	/** The greatest message timestamp before lastMessageTimestamp. */
-	Scalar<SIUnit::Time> prevMessageTimestamp;
+	/** The time up to which the server has sent all messages. */
+	Scalar<SIUnit::Time> serverTime;
 
 	/**
 	 * Handle a received packet.
 	 *
 	 * @param data The packet.
 	 */
-	void handlePacket(std::string& data);
+	void handlePacket(boost::string_ref data);
+
+	/**
+	 * Log a desync and report it to the server.
+	 */
+	void reportDesync();
 
 public:
 	/**
@@ -67,6 +72,14 @@ public:
 		return clients.find(ownId)->second;
 	}
 
+	/**
+	 * Get the secret that lets this client's players rejoin the game
+	 * through a new connection; see joinRunningGame.
+	 */
+	const std::string& getRejoinToken() const {
+		return rejoinToken;
+	}
+
 	/**
 	 * Mark the client as ready for initialising the game ("settings ok, let's play").
 	 */
@@ -76,6 +89,19 @@ public:
 	 * Mark the client as ready for initialising the game ("all set, start the clock").
 	 */
 	void setReadyToStart();
+
+	/**
+	 * Join a game that is already running.
+	 *
+	 * The server sends a snapshot and the batches after it, so the game
+	 * catches up without replaying the whole match. The server drops the
+	 * connection if it doesn't take snapshots, the old client is unknown
+	 * or the token is wrong.
+	 *
+	 * @param oldId The id of a client that has left, to take over its players, or zero to only watch.
+	 * @param token The rejoin token of the old client; see getRejoinToken.
+	 */
+	void joinRunningGame(int oldId, const std::string& token);
 };
 
 #endif
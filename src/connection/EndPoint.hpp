@@ -3,9 +3,11 @@
 
 #include <string>
 #include <memory>
+#include <boost/utility/string_ref.hpp>
 
 namespace Connection {
 	class EndPoint;
+	class Wakeup;
 }
 
 /**
@@ -30,10 +32,23 @@ public:
 	/**
 	 * Receive a data packet (message).
 	 *
+	 * The packet is not copied; it stays valid until the next call.
+	 *
 	 * @param data The message is stored here.
 	 * @return true if a packet was received, false otherwise.
 	 */
-	virtual bool receivePacket(std::string& data) = 0;
+	virtual bool receivePacket(boost::string_ref& data) = 0;
+
+	/**
+	 * Set a wakeup to notify when a packet arrives.
+	 *
+	 * The default implementation does nothing; the owner must then poll.
+	 *
+	 * @param wakeup The wakeup.
+	 */
+	virtual void setWakeup(std::shared_ptr<Wakeup> wakeup) {
+		// Nothing to do.
+	}
 };
 
 #endif
@@ -0,0 +1,247 @@
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <boost/format.hpp>
+
+#include "Host.hpp"
+
+#include "game/Game.hpp"
+#include "game/Map.hpp"
+#include "game/GamePool.hpp"
+
+/**
+ * A thread that runs the main loops of some servers.
+ */
+class Connection::Host::Worker: boost::noncopyable {
+	/** Type for server container. */
+	typedef std::vector<std::shared_ptr<Server> > ServerContainerType;
+
+	/** Wakeup shared by the servers of this worker. */
+	std::shared_ptr<Wakeup> wakeup;
+
+	/** Lock for the fields below. */
+	std::mutex mutex;
+
+	/** Servers that haven't been taken into the loop yet. */
+	ServerContainerType incoming;
+
+	/** Set when the thread should exit. */
+	bool quit;
+
+	/** The number of servers, including the incoming ones. */
+	std::atomic<std::size_t> count;
+
+	/** The servers in the loop; used only by the thread. */
+	ServerContainerType servers;
+
+	/** The thread. */
+	std::thread thread;
+
+	/**
+	 * The main loop of the thread.
+	 */
+	void run() {
+		while (true) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (quit) {
+					return;
+				}
+				servers.insert(servers.end(), incoming.begin(), incoming.end());
+				incoming.clear();
+			}
+
+			// Sleep until the first of the servers needs an update.
+			Scalar<SIUnit::Time> timeout = 1;
+			for (ServerContainerType::iterator i = servers.begin(); i != servers.end();) {
+				Server& server = **i;
+				try {
+					server.update();
+				} catch (std::exception& e) {
+					std::cerr << "Game " << server.getName() << " failed: " << e.what() << std::endl;
+					i = servers.erase(i);
+					--count;
+					continue;
+				}
+				if (server.getState() == END) {
+					// Report the memory use for sizing the host.
+					std::cout << "Game " << server.getName() << " ended, Lua memory peak " << server.getGame().getPeakMemoryUsage() / 1024 << " kB." << std::endl;
+					try {
+						server.writeProfile();
+					} catch (std::exception& e) {
+						std::cerr << "Game " << server.getName() << ": " << e.what() << std::endl;
+					}
+					i = servers.erase(i);
+					--count;
+					continue;
+				}
+				timeout = std::min(timeout, server.getTimeout());
+				++i;
+			}
+			wakeup->wait(timeout);
+		}
+	}
+
+public:
+	/**
+	 * Constructor; starts the thread.
+	 */
+	Worker():
+		wakeup(new Wakeup()),
+		quit(false),
+		count(0),
+		thread(&Worker::run, this) {
+	}
+
+	/**
+	 * Destructor; stops the thread.
+	 */
+	~Worker() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wakeup->notify();
+		thread.join();
+	}
+
+	/**
+	 * Get the wakeup for new servers.
+	 */
+	std::shared_ptr<Wakeup> getWakeup() const {
+		return wakeup;
+	}
+
+	/**
+	 * Get the number of servers.
+	 */
+	std::size_t getServerCount() const {
+		return count;
+	}
+
+	/**
+	 * Add a server to the loop.
+	 *
+	 * @param server The server; it must use the wakeup of this worker.
+	 */
+	void addServer(std::shared_ptr<Server> server) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			incoming.push_back(server);
+			++count;
+		}
+		wakeup->notify();
+	}
+};
+
+Connection::Host::Host(unsigned int workerCount, std::size_t maxGames_):
+	wakeup(new Wakeup()),
+	instructionBudget(0),
+	memoryLimit(0),
+	snapshotInterval(0),
+	readyGames(1),
+	maxGames(maxGames_),
+	gameCounter(0),
+	name("Host") {
+	if (!workerCount) {
+		workerCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+	for (unsigned int i = 0; i < workerCount; ++i) {
+		workers.push_back(std::unique_ptr<Worker>(new Worker()));
+	}
+}
+
+Connection::Host::~Host() {
+	// Stop the workers before the servers go away.
+	workers.clear();
+}
+
+void Connection::Host::addListener(std::shared_ptr<Listener> listener) {
+	listener->setWakeup(wakeup);
+	listeners.push_back(listener);
+}
+
+std::shared_ptr<Game::Map> Connection::Host::getMap(const std::string& directory) {
+	std::shared_ptr<Game::Map>& map = maps[directory];
+	if (!map) {
+		std::shared_ptr<Game::Map> tmp(new Game::Map());
+		tmp->load(directory);
+		map = tmp;
+	}
+	return map;
+}
+
+std::shared_ptr<Game::GamePool> Connection::Host::getGamePool(const std::string& directory) {
+	std::shared_ptr<Game::GamePool>& pool = gamePools[directory];
+	if (!pool) {
+		pool.reset(new Game::GamePool(getMap(directory), readyGames));
+	}
+	return pool;
+}
+
+std::size_t Connection::Host::getGameCount() const {
+	std::size_t count = 0;
+	for (std::vector<std::unique_ptr<Worker> >::const_iterator i = workers.begin(); i != workers.end(); ++i) {
+		count += (*i)->getServerCount();
+	}
+	return count;
+}
+
+void Connection::Host::route(std::shared_ptr<EndPoint> connection) {
+	// The worker thread may start the game at any time, so the state is checked under the server's lock.
+	if (lobby && lobby->joinSetup(connection)) {
+		return;
+	}
+	lobby.reset();
+	if (getGameCount() >= maxGames) {
+		// Full; the connection is closed when it goes out of scope.
+		return;
+	}
+
+	// Pin the new game to the least busy worker.
+	Worker* worker = workers.front().get();
+	for (std::vector<std::unique_ptr<Worker> >::iterator i = workers.begin(); i != workers.end(); ++i) {
+		if ((*i)->getServerCount() < worker->getServerCount()) {
+			worker = i->get();
+		}
+	}
+	lobby.reset(new Server(worker->getWakeup()));
+	lobby->setName((boost::format("%s #%u") % name % ++gameCounter).str());
+	lobby->setJobSystem(jobSystem);
+	lobby->setInstructionBudget(instructionBudget);
+	lobby->setProfilePath(profilePath);
+	lobby->setMemoryLimit(memoryLimit);
+	lobby->setSnapshotInterval(snapshotInterval);
+	if (!replayDirectory.empty()) {
+		lobby->setReplayPath((boost::format("%s/game-%u.replay") % replayDirectory % gameCounter).str());
+	}
+	lobby->setGamePool(getGamePool("maps/testmap"));
+	worker->addServer(lobby);
+	lobby->addClient(connection);
+}
+
+bool Connection::Host::update() {
+	std::vector<std::shared_ptr<EndPoint> > connections;
+	for (ListenerContainerType::iterator i = listeners.begin(); i != listeners.end();) {
+		if ((*i)->accept(connections)) {
+			++i;
+		} else {
+			i = listeners.erase(i);
+		}
+	}
+	for (std::vector<std::shared_ptr<EndPoint> >::iterator i = connections.begin(); i != connections.end(); ++i) {
+		route(*i);
+	}
+	return !listeners.empty();
+}
+
+void Connection::Host::run() {
+	std::shared_ptr<Game::GamePool> pool(getGamePool("maps/testmap"));
+	while (update()) {
+		// Set up one game at a time, so new connections don't wait long.
+		wakeup->wait(pool->fill() ? 0 : 1);
+	}
+}
@@ -0,0 +1,230 @@
+#ifndef PUTKARTS_Connection_Host_HPP
+#define PUTKARTS_Connection_Host_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <boost/utility.hpp>
+
+#include "connection/Server.hpp"
+#include "connection/Listener.hpp"
+#include "connection/Wakeup.hpp"
+
+namespace Connection {
+	class Host;
+}
+
+namespace Game {
+	class Map;
+	class GamePool;
+}
+
+class JobSystem;
+
+/**
+ * Runs many independent games in one process.
+ *
+ * The host owns the listeners and routes each new connection to the
+ * open lobby, a Server that is still in the SETUP state. When the lobby
+ * starts its game, the next connection opens a new lobby. Each server
+ * is pinned to one worker thread, which runs the main loops of all its
+ * servers. The servers share the job system and the loaded maps.
+ */
+class Connection::Host: boost::noncopyable {
+	/** A thread that runs the main loops of some servers. */
+	class Worker;
+
+	/** Type for listener container. */
+	typedef std::vector<std::shared_ptr<Listener> > ListenerContainerType;
+
+	/** Listeners that wait for connections. */
+	ListenerContainerType listeners;
+
+	/** The worker threads. */
+	std::vector<std::unique_ptr<Worker> > workers;
+
+	/** Wakeup for the main loop; notified by the listeners. */
+	std::shared_ptr<Wakeup> wakeup;
+
+	/** Worker threads for the game simulations, or NULL. */
+	std::shared_ptr<JobSystem> jobSystem;
+
+	/** The Lua instruction budget per message callback, or zero. */
+	std::uint64_t instructionBudget;
+
+	/** The file for the Lua profiles, or empty if the profiler is off. */
+	std::string profilePath;
+
+	/** The maximum memory usage of Lua in bytes per game, or zero. */
+	std::size_t memoryLimit;
+
+	/** The directory for replays, or empty for no replays. */
+	std::string replayDirectory;
+
+	/** The game time between snapshots, or zero for no snapshots. */
+	Scalar<SIUnit::Time> snapshotInterval;
+
+	/** Loaded maps by directory. */
+	std::map<std::string, std::shared_ptr<Game::Map> > maps;
+
+	/** Ready games by map directory. */
+	std::map<std::string, std::shared_ptr<Game::GamePool> > gamePools;
+
+	/** The number of games to keep ready for each map. */
+	std::size_t readyGames;
+
+	/** The server that gets the new connections. */
+	std::shared_ptr<Server> lobby;
+
+	/** The maximum number of games at once. */
+	std::size_t maxGames;
+
+	/** The number of games started so far; used for naming them. */
+	unsigned int gameCounter;
+
+	/** The name of the host; the games are named after it. */
+	std::string name;
+
+	/**
+	 * Give a new connection to the lobby, opening a new lobby if necessary.
+	 *
+	 * @param connection The connection.
+	 */
+	void route(std::shared_ptr<EndPoint> connection);
+
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param workerCount The number of worker threads; zero means the number of cores.
+	 * @param maxGames The maximum number of games at once.
+	 */
+	Host(unsigned int workerCount, std::size_t maxGames);
+
+	/**
+	 * Destructor; stops the workers and the games.
+	 */
+	~Host();
+
+	/**
+	 * Set the host name.
+	 *
+	 * @param name_ The new name.
+	 */
+	void setName(const std::string& name_) {
+		name = name_;
+	}
+
+	/**
+	 * Set the worker threads to use for the game simulations.
+	 *
+	 * @param jobSystem_ The job system, or NULL to run in the calling thread.
+	 */
+	void setJobSystem(std::shared_ptr<JobSystem> jobSystem_) {
+		jobSystem = jobSystem_;
+	}
+
+	/**
+	 * Set the Lua instruction budget per message callback for the games.
+	 *
+	 * @param instructionBudget_ The number of instructions, or zero for no limit.
+	 */
+	void setInstructionBudget(std::uint64_t instructionBudget_) {
+		instructionBudget = instructionBudget_;
+	}
+
+	/**
+	 * Set the maximum memory usage of Lua per game.
+	 *
+	 * @param memoryLimit_ The number of bytes, or zero for no limit.
+	 */
+	void setMemoryLimit(std::size_t memoryLimit_) {
+		memoryLimit = memoryLimit_;
+	}
+
+	/**
+	 * Record a replay of each game.
+	 *
+	 * @param replayDirectory_ The directory for the replays, or empty for no replays.
+	 */
+	void setReplayDirectory(const std::string& replayDirectory_) {
+		replayDirectory = replayDirectory_;
+	}
+
+	/**
+	 * Take snapshots of the games; see Server::setSnapshotInterval.
+	 *
+	 * @param snapshotInterval_ The game time between snapshots, or zero for no snapshots.
+	 */
+	void setSnapshotInterval(Scalar<SIUnit::Time> snapshotInterval_) {
+		snapshotInterval = snapshotInterval_;
+	}
+
+	/**
+	 * Turn on the Lua profiler; the results of each game are appended to a file.
+	 *
+	 * @param profilePath_ The file, or empty to turn the profiler off.
+	 */
+	void setProfilePath(const std::string& profilePath_) {
+		profilePath = profilePath_;
+	}
+
+	/**
+	 * Insert a new listener.
+	 *
+	 * @param listener The listener.
+	 */
+	void addListener(std::shared_ptr<Listener> listener);
+
+	/**
+	 * Get a map, loading it only the first time.
+	 *
+	 * @param directory The map directory.
+	 * @return The map.
+	 * @throw std::runtime_error Thrown if the map can't be loaded.
+	 */
+	std::shared_ptr<Game::Map> getMap(const std::string& directory);
+
+	/**
+	 * Get the pool of ready games for a map.
+	 *
+	 * @param directory The map directory.
+	 * @return The pool.
+	 * @throw std::runtime_error Thrown if the map can't be loaded.
+	 */
+	std::shared_ptr<Game::GamePool> getGamePool(const std::string& directory);
+
+	/**
+	 * Set the number of games to keep ready for each map.
+	 *
+	 * This only affects the maps that haven't been used yet.
+	 *
+	 * @param readyGames_ The number.
+	 */
+	void setReadyGames(std::size_t readyGames_) {
+		readyGames = readyGames_;
+	}
+
+	/**
+	 * Get the number of running games, including the lobby.
+	 */
+	std::size_t getGameCount() const;
+
+	/**
+	 * Route the new connections.
+	 *
+	 * @return false if there are no listeners left, true otherwise.
+	 */
+	bool update();
+
+	/**
+	 * Run until all listeners have failed.
+	 *
+	 * Games are set up in advance while there are no connections to route.
+	 */
+	void run();
+};
+
+#endif
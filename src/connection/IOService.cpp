@@ -0,0 +1,28 @@
+#include "IOService.hpp"
+
+Connection::IOService::IOService():
+	work(new boost::asio::io_service::work(service)),
+	thread(&IOService::run, this) {
+}
+
+Connection::IOService::~IOService() {
+	work.reset();
+	service.stop();
+	thread.join();
+}
+
+void Connection::IOService::run() {
+	while (true) {
+		try {
+			service.run();
+			return;
+		} catch (...) {
+			// A handler failed; the connection in question is dead anyway.
+		}
+	}
+}
+
+boost::asio::io_service& Connection::IOService::get() {
+	static IOService instance;
+	return instance.service;
+}
@@ -0,0 +1,53 @@
+#ifndef PUTKARTS_Connection_IOService_HPP
+#define PUTKARTS_Connection_IOService_HPP
+
+#include <memory>
+#include <thread>
+#include <boost/asio.hpp>
+#include <boost/utility.hpp>
+
+namespace Connection {
+	class IOService;
+}
+
+/**
+ * The io_service shared by all network connections.
+ *
+ * The service runs the completion handlers on its own thread, so all
+ * socket operations should be started from that thread, using post.
+ */
+class Connection::IOService: boost::noncopyable {
+	/** The io service. */
+	boost::asio::io_service service;
+
+	/** Keeps the service running while there's nothing to do. */
+	std::unique_ptr<boost::asio::io_service::work> work;
+
+	/** The thread running the service. */
+	std::thread thread;
+
+	/**
+	 * Constructor; starts the thread.
+	 */
+	IOService();
+
+	/**
+	 * Run the service until it's stopped.
+	 */
+	void run();
+
+public:
+	/**
+	 * Destructor; stops the thread.
+	 */
+	~IOService();
+
+	/**
+	 * Get the shared io_service, starting it if necessary.
+	 *
+	 * @return The io_service.
+	 */
+	static boost::asio::io_service& get();
+};
+
+#endif
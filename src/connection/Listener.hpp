@@ -1,11 +1,15 @@
 #ifndef PUTKARTS_Connection_Listener_HPP
 #define PUTKARTS_Connection_Listener_HPP
 
+#include <memory>
+#include <vector>
 #include <boost/utility.hpp>
 
 namespace Connection {
 	class Server;
 	class Listener;
+	class EndPoint;
+	class Wakeup;
 }
 
 /**
@@ -27,6 +31,25 @@ public:
 	 * @return false if this Listener should be removed, true otherwise.
 	 */
 	virtual bool update(Server& server) = 0;
+
+	/**
+	 * Take the new connections without giving them to a server.
+	 *
+	 * @param connections The connections are appended here.
+	 * @return false if this Listener should be removed, true otherwise.
+	 */
+	virtual bool accept(std::vector<std::shared_ptr<EndPoint> >& connections) = 0;
+
+	/**
+	 * Set a wakeup to notify when a connection arrives.
+	 *
+	 * The default implementation does nothing; the owner must then poll.
+	 *
+	 * @param wakeup The wakeup.
+	 */
+	virtual void setWakeup(std::shared_ptr<Wakeup> wakeup) {
+		// Nothing to do.
+	}
 };
 
 #endif
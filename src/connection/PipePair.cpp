@@ -2,6 +2,7 @@
 #include <mutex>
 
 #include "PipePair.hpp"
+#include "Wakeup.hpp"
 
 /**
  * An implementation of FIFO.
@@ -10,15 +11,33 @@ class Connection::PipePair::Pipe: public Connection::EndPoint, private std::mute
 	/** Internal buffer. */
 	std::list<std::string> buffer;
 
+	/** The packet last received. */
+	std::string current;
+
+	/** The wakeup of the receiver. */
+	std::shared_ptr<Wakeup> wakeup;
+
 public:
 	/** @copydoc EndPoint::sendPacket */
 	void sendPacket(const std::string& data) {
 		std::lock_guard<std::mutex> lock(*this);
 		buffer.push_back(data);
+		if (wakeup) {
+			wakeup->notify();
+		}
+	}
+
+	/** @copydoc EndPoint::setWakeup */
+	void setWakeup(std::shared_ptr<Wakeup> wakeup_) {
+		std::lock_guard<std::mutex> lock(*this);
+		wakeup = wakeup_;
+		if (wakeup && !buffer.empty()) {
+			wakeup->notify();
+		}
 	}
 
 	/** @copydoc EndPoint::receivePacket */
-	bool receivePacket(std::string& data) {
+	bool receivePacket(boost::string_ref& data) {
 		if (buffer.empty()) {
 			return false;
 		}
@@ -26,8 +45,9 @@ public:
 		if (buffer.empty()) {
 			return false;
 		}
-		data = *buffer.begin();
+		current.swap(buffer.front());
 		buffer.pop_front();
+		data = current;
 		return true;
 	}
 };
@@ -56,9 +76,14 @@ public:
 	}
 
 	/** @copydoc EndPoint::receivePacket */
-	bool receivePacket(std::string& data) {
+	bool receivePacket(boost::string_ref& data) {
 		return input->receivePacket(data);
 	}
+
+	/** @copydoc EndPoint::setWakeup */
+	void setWakeup(std::shared_ptr<Wakeup> wakeup) {
+		input->setWakeup(wakeup);
+	}
 };
 
 Connection::PipePair::PipePair() {
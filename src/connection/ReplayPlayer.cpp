@@ -0,0 +1,122 @@
+#include <stdexcept>
+#include <iostream>
+
+#include "ReplayPlayer.hpp"
+#include "ReplayRecorder.hpp"
+
+#include "game/Game.hpp"
+#include "game/GamePool.hpp"
+#include "util/Deserializer.hpp"
+
+Connection::ReplayPlayer::ReplayPlayer(const std::string& path):
+	stream(path.c_str(), std::ios::binary),
+	replayTime(0) {
+	if (!stream || !ReplayRecorder::readBlock(stream, block) || block[0] != 'h') {
+		throw std::runtime_error("Can't read replay " + path);
+	}
+	Deserializer header(block.data() + 1, block.size() - 1);
+	std::string magic, mapDirectory;
+	unsigned int version, count;
+	header.get(magic);
+	header.get(version);
+	if (magic != ReplayRecorder::magic || version != ReplayRecorder::version) {
+		throw std::runtime_error("Unsupported replay " + path);
+	}
+	header.get(mapDirectory);
+	header.get(instructionBudget);
+	header.get(count);
+	while (count--) {
+		std::string data;
+		header.get(data);
+		std::shared_ptr<ClientInfo> info(new ClientInfo(data));
+		clients[info->id] = info;
+	}
+	headerClients = clients;
+	headerEnd = stream.tellg();
+
+	std::shared_ptr<Game::Map> map(new Game::Map());
+	map->load(mapDirectory);
+	setGamePool(std::make_shared<Game::GamePool>(map, 0));
+}
+
+void Connection::ReplayPlayer::handleClient() {
+	std::shared_ptr<ClientInfo> info(new ClientInfo(block.substr(1)));
+	clients[info->id] = info;
+	if (game) {
+		game->insertClient(info);
+	}
+}
+
+void Connection::ReplayPlayer::update() {
+	if (state == SETUP) {
+		initGame();
+		startGame();
+	}
+	if (state != PLAY) {
+		return;
+	}
+	if (!ReplayRecorder::readBlock(stream, block)) {
+		state = END;
+		return;
+	}
+	if (block[0] == 'c') {
+		handleClient();
+		return;
+	}
+	if (block[0] != 'b') {
+		// Snapshots are only needed for seeking.
+		return;
+	}
+	replayTime = handleBatch(block.data() + 1, block.size() - 1);
+	game->runUntil(replayTime);
+	if (checkStateHashes()) {
+		std::cerr << "The replay is out of sync since step " << desyncStep << "!" << std::endl;
+	}
+}
+
+void Connection::ReplayPlayer::seek(Scalar<SIUnit::Time> time) {
+	// Find the last snapshot before the time.
+	stream.clear();
+	stream.seekg(headerEnd);
+	clients = headerClients;
+	std::string snapshot;
+	ClientInfoContainerType snapshotClients;
+	std::streampos snapshotEnd = headerEnd;
+	while (ReplayRecorder::readBlock(stream, block)) {
+		if (block[0] == 'c') {
+			handleClient();
+		} else if (block[0] == 'S') {
+			if (Game::Game::getSnapshotTime(block.substr(1)) > time) {
+				break;
+			}
+			snapshot = block.substr(1);
+			snapshotClients = clients;
+			snapshotEnd = stream.tellg();
+		}
+	}
+
+	// Start from the snapshot, or from the beginning if there is none.
+	game.reset();
+	expectedHashes.clear();
+	stream.clear();
+	stream.seekg(snapshotEnd);
+	if (snapshot.empty()) {
+		clients = headerClients;
+		state = SETUP;
+		replayTime = 0;
+	} else {
+		clients = snapshotClients;
+		loadSnapshot(snapshot);
+		replayTime = game->getTime();
+	}
+
+	while (state != END && replayTime < time) {
+		update();
+	}
+}
+
+void Connection::ReplayPlayer::run() {
+	while (state != END) {
+		update();
+	}
+}
@@ -0,0 +1,85 @@
+#ifndef PUTKARTS_Connection_ReplayPlayer_HPP
+#define PUTKARTS_Connection_ReplayPlayer_HPP
+
+#include <string>
+#include <fstream>
+
+#include "util/Scalar.hpp"
+#include "connection/Base.hpp"
+
+namespace Connection {
+	class ReplayPlayer;
+}
+
+/**
+ * Simulates a game from a replay file written by ReplayRecorder.
+ *
+ * The player works like a client whose server is the file: it sets up
+ * the game from the header and handles the batches in order. It never
+ * waits, so a whole match runs as fast as the simulation can go. It can
+ * also seek, starting from the nearest snapshot in the file.
+ */
+class Connection::ReplayPlayer: virtual public Connection::Base {
+	/** The file. */
+	std::ifstream stream;
+
+	/** Buffer for the current block. */
+	std::string block;
+
+	/** The time up to which the file has been read. */
+	Scalar<SIUnit::Time> replayTime;
+
+	/** The clients in the header. */
+	ClientInfoContainerType headerClients;
+
+	/** The position after the header. */
+	std::streampos headerEnd;
+
+	/**
+	 * Handle a client block in the buffer.
+	 */
+	void handleClient();
+
+public:
+	/**
+	 * Constructor; reads the header. The game is set up on the first update.
+	 *
+	 * @param path The replay file.
+	 * @throw std::runtime_error Thrown if the file can't be read.
+	 */
+	ReplayPlayer(const std::string& path);
+
+	/**
+	 * Read and simulate the next batch.
+	 *
+	 * The state changes to END at the end of the file.
+	 *
+	 * @throw std::runtime_error Thrown if the file is broken.
+	 */
+	virtual void update();
+
+	/**
+	 * Jump to a moment in the replay.
+	 *
+	 * The game is loaded from the last snapshot before the time, or set
+	 * up again if there is none, and simulated up to the time.
+	 *
+	 * @param time The time.
+	 * @throw std::runtime_error Thrown if the file is broken.
+	 */
+	void seek(Scalar<SIUnit::Time> time);
+
+	/**
+	 * Simulate the rest of the replay.
+	 */
+	void run();
+
+	/**
+	 * Get the game time up to which the replay has been simulated.
+	 */
+	Scalar<SIUnit::Time> getTime() const {
+		return replayTime;
+	}
+};
+
+#endif
@@ -0,0 +1,60 @@
+#include <stdexcept>
+
+#include "ReplayRecorder.hpp"
+#include "util/Path.hpp"
+#include "util/Serializer.hpp"
+
+const std::string Connection::ReplayRecorder::magic("PutkaRTS replay");
+
+Connection::ReplayRecorder::ReplayRecorder(const std::string& path, const std::string& mapDirectory, std::uint64_t instructionBudget, const std::map<int, std::shared_ptr<ClientInfo> >& clients) {
+	Path::mkdirForFile(path);
+	stream.open(path.c_str(), std::ios::binary | std::ios::trunc);
+	if (!stream) {
+		throw std::runtime_error("Can't write replay " + path);
+	}
+	Serializer header;
+	header.put(magic);
+	header.put(version);
+	header.put(mapDirectory);
+	header.put(instructionBudget);
+	header.put((unsigned int) clients.size());
+	for (std::map<int, std::shared_ptr<ClientInfo> >::const_iterator i = clients.begin(); i != clients.end(); ++i) {
+		header.put(i->second->serialize());
+	}
+	writeBlock('h', header.getData());
+}
+
+void Connection::ReplayRecorder::writeBlock(char type, const std::string& data) {
+	const std::string::size_type size = data.size() + 1;
+	const char length[4] = {(char) size, (char) (size >> 8), (char) (size >> 16), (char) (size >> 24)};
+	stream.write(length, 4);
+	stream.put(type);
+	stream.write(data.data(), data.size());
+	stream.flush();
+}
+
+void Connection::ReplayRecorder::record(const std::string& batch) {
+	writeBlock('b', batch);
+}
+
+void Connection::ReplayRecorder::recordSnapshot(const std::string& snapshot) {
+	writeBlock('S', snapshot);
+}
+
+void Connection::ReplayRecorder::recordClient(const ClientInfo& client) {
+	writeBlock('c', client.serialize());
+}
+
+bool Connection::ReplayRecorder::readBlock(std::istream& stream, std::string& data) {
+	// A block cut short by a crash counts as the end.
+	unsigned char length[4];
+	if (!stream.read(reinterpret_cast<char*>(length), 4)) {
+		return false;
+	}
+	const std::string::size_type size = length[0] | (length[1] << 8) | (length[2] << 16) | ((std::string::size_type) length[3] << 24);
+	if (!size || size > maxBlockSize) {
+		throw std::runtime_error("Replay: invalid block size!");
+	}
+	data.resize(size);
+	return (bool) stream.read(&data[0], size);
+}
@@ -0,0 +1,90 @@
+#ifndef PUTKARTS_Connection_ReplayRecorder_HPP
+#define PUTKARTS_Connection_ReplayRecorder_HPP
+
+#include <cstdint>
+#include <string>
+#include <fstream>
+#include <boost/utility.hpp>
+
+#include "connection/Base.hpp"
+
+namespace Connection {
+	class ReplayRecorder;
+}
+
+/**
+ * Writes the message stream of a game to a replay file.
+ *
+ * The file starts with a header that describes the game setup: the map
+ * and the clients. After that come the batches exactly as the server
+ * sends them, and now and then a snapshot or a changed client. Each
+ * block has a 4-byte little endian length and a type byte, like the
+ * packets. The file is only appended to, so a crashed game leaves a
+ * usable replay.
+ */
+class Connection::ReplayRecorder: boost::noncopyable {
+	/** The file. */
+	std::ofstream stream;
+
+	/**
+	 * Write one block with its length.
+	 *
+	 * @param type The type of the block.
+	 * @param data The data.
+	 */
+	void writeBlock(char type, const std::string& data);
+
+public:
+	/** The identifier at the start of the header. */
+	static const std::string magic;
+
+	/** The format version of the header. */
+	static const unsigned int version = 8;
+
+	/** The maximum size of a block. */
+	static const std::string::size_type maxBlockSize = 1 << 26;
+
+	/**
+	 * Constructor; writes the header.
+	 *
+	 * @param path The file.
+	 * @param mapDirectory The map of the game.
+	 * @param instructionBudget The Lua instruction budget of the game.
+	 * @param clients The clients of the game.
+	 * @throw std::runtime_error Thrown if the file can't be written.
+	 */
+	ReplayRecorder(const std::string& path, const std::string& mapDirectory, std::uint64_t instructionBudget, const std::map<int, std::shared_ptr<ClientInfo> >& clients);
+
+	/**
+	 * Write a batch.
+	 *
+	 * @param batch The batch data, as in the batch packet.
+	 */
+	void record(const std::string& batch);
+
+	/**
+	 * Write a snapshot; players can seek to it.
+	 *
+	 * @param snapshot The snapshot from Game::Game::saveSnapshot.
+	 */
+	void recordSnapshot(const std::string& snapshot);
+
+	/**
+	 * Write a new or changed client.
+	 *
+	 * @param client The client.
+	 */
+	void recordClient(const ClientInfo& client);
+
+	/**
+	 * Read one block from a replay file.
+	 *
+	 * @param stream The file.
+	 * @param data The data is stored here; the first byte is the type.
+	 * @return false at the end of the file, or if the last block is incomplete.
+	 * @throw std::runtime_error Thrown if the file is broken.
+	 */
+	static bool readBlock(std::istream& stream, std::string& data);
+};
+
+#endif
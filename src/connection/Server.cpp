@@ -1,8 +1,11 @@
 #include <memory>
 #include <mutex>
-#include <thread>
 #include <functional>
 #include <string>
+#include <stdexcept>
+#include <iostream>
+#include <algorithm>
+#include <random>
 
 #include "Server.hpp"
 #include "Client.hpp"
@@ -10,6 +13,25 @@
 #include "connection/PipePair.hpp"
 #include "connection/ClientInfo.hpp"
 #include "game/Game.hpp"
+#include "util/Deserializer.hpp"
+
+/**
+ * Make a secret for rejoining a game.
+ *
+ * @return 128 random bits in hexadecimal.
+ */
+static std::string makeRejoinToken() {
+	static const char digits[] = "0123456789abcdef";
+	std::random_device random;
+	std::string token;
+	for (int i = 0; i < 4; ++i) {
+		std::uint32_t bits = random();
+		for (int j = 0; j < 8; ++j, bits >>= 4) {
+			token += digits[bits & 15];
+		}
+	}
+	return token;
+}
 
 /**
  * A class that represents one client on the server side.
@@ -69,6 +91,24 @@ public:
 	}
 };
 
+Connection::Server::Server():
+	wakeup(new Wakeup()),
+	messageSequence(0),
+	snapshotInterval(0),
+	snapshotTime(0),
+	objectHashes(objectHashHistory),
+	batchStep(0) {
+}
+
+Connection::Server::Server(std::shared_ptr<Wakeup> wakeup_):
+	wakeup(wakeup_),
+	messageSequence(0),
+	snapshotInterval(0),
+	snapshotTime(0),
+	objectHashes(objectHashHistory),
+	batchStep(0) {
+}
+
 void Connection::Server::run() {
 	std::weak_ptr<Server> weak(shared_from_this());
 	while (std::shared_ptr<Server> ptr = weak.lock()) {
@@ -76,8 +116,17 @@ void Connection::Server::run() {
 			return;
 		}
 		update();
-		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		wakeup->wait(getTimeout());
+	}
+}
+
+Scalar<SIUnit::Time> Connection::Server::getTimeout() {
+	std::lock_guard<std::recursive_mutex> lock(*this);
+	if (state == PLAY) {
+		return game->getTime() + Game::Game::getStepLength() - clock.getTime();
 	}
+	// Nothing is scheduled, but the metaserver needs updates now and then.
+	return 1;
 }
 
 std::shared_ptr<Connection::Client> Connection::Server::createLocalClient() {
@@ -88,13 +137,45 @@ std::shared_ptr<Connection::Client> Connection::Server::createLocalClient() {
 
 void Connection::Server::startGame() {
 	Base::startGame();
+	if (!replayPath.empty()) {
+		try {
+			recorder.reset(new ReplayRecorder(replayPath, game->getMap().getDirectory(), instructionBudget, clients));
+		} catch (std::runtime_error& e) {
+			std::cerr << "Not recording a replay: " << e.what() << std::endl;
+		}
+	}
+	if (snapshotInterval > 0) {
+		takeSnapshot();
+	}
+	batchStep = game->getStep();
 	clock.reset();
 	clock.unpause();
 }
 
+void Connection::Server::takeSnapshot() {
+	std::string snapshot;
+	try {
+		snapshot = game->saveSnapshot();
+	} catch (std::runtime_error& e) {
+		// The game goes on, but nobody can join it any more.
+		std::cerr << "Not taking snapshots: " << e.what() << std::endl;
+		snapshotInterval = 0;
+		snapshotPacket.clear();
+		snapshotBatches.clear();
+		return;
+	}
+	snapshotPacket.assign(1, 'S');
+	snapshotPacket.append(snapshot);
+	snapshotTime = game->getTime();
+	snapshotBatches.clear();
+	if (recorder) {
+		recorder->recordSnapshot(snapshot);
+	}
+}
+
 void Connection::Server::addClient(std::shared_ptr<Client> client) {
 	std::lock_guard<std::recursive_mutex> lock(*this);
-	for (client->id = 1; clients.find(client->id) != clients.end(); ++client->id);
+	for (client->id = 1; clients.find(client->id) != clients.end() || departedClients.find(client->id) != departedClients.end(); ++client->id);
 
 	// Send the new client to all, and send all old clients to the new one.
 	ClientInfoContainerType old = clients;
@@ -103,33 +184,63 @@ void Connection::Server::addClient(std::shared_ptr<Client> client) {
 	for (ClientInfoContainerType::iterator i = old.begin(); i != old.end(); ++i) {
 		sendPacket(*client, 'c' + i->second->serialize());
 	}
+
+	// Only the client itself knows its token, so nobody else can take its players.
+	rejoinTokens[client->id] = makeRejoinToken();
+	sendPacket(*client, 'k' + rejoinTokens[client->id]);
 }
 
 void Connection::Server::addClient(std::shared_ptr<EndPoint> connection) {
+	connection->setWakeup(wakeup);
 	return addClient(std::shared_ptr<Client>(new Client(connection)));
 }
 
+bool Connection::Server::joinSetup(std::shared_ptr<EndPoint> connection) {
+	std::lock_guard<std::recursive_mutex> lock(*this);
+	if (state != SETUP) {
+		return false;
+	}
+	addClient(connection);
+	return true;
+}
+
 void Connection::Server::removeClient(int id) {
 	std::lock_guard<std::recursive_mutex> lock(*this);
-	if (clients.erase(id)) {
-		sendPacket(clients, 'd' + std::to_string(id));
+	ClientInfoContainerType::iterator i = clients.find(id);
+	if (i == clients.end()) {
+		return;
+	}
+	// Remember the players of the client, so that it can rejoin.
+	if (state != SETUP && !i->second->players.empty()) {
+		departedClients[id] = std::make_shared<ClientInfo>(*i->second);
+	} else {
+		rejoinTokens.erase(id);
 	}
+	clients.erase(i);
+	sendPacket(clients, 'd' + std::to_string(id));
 }
 
 void Connection::Server::addListener(std::shared_ptr<Listener> listener) {
 	std::lock_guard<std::recursive_mutex> lock(*this);
+	listener->setWakeup(wakeup);
 	listeners.insert(listener);
 }
 
-bool Connection::Server::handlePacket(Client& client, std::string& data) {
-	char type = *data.begin();
-	data.erase(data.begin());
+bool Connection::Server::handlePacket(Client& client, boost::string_ref data) {
+	char type = data.front();
+	data.remove_prefix(1);
 
 	// Game::Message.
 	if (type == 'm') {
 		if (game) {
-			Game::Message msg(data);
+			Deserializer input(data.data(), data.size());
+			Game::Message msg(input);
 			msg.client = client.id;
+			msg.sequence = ++messageSequence;
+			// The queue has a bucket for every step up to the timestamp; this also rejects NaN.
+			if (!(msg.timestamp <= game->getTime() + Scalar<SIUnit::Time>((double) maxMessageDelay))) {
+				return false;
+			}
 			game->insertMessage(msg);
 		}
 		return true;
@@ -146,9 +257,13 @@ bool Connection::Server::handlePacket(Client& client, std::string& data) {
 			readyToInit &= i->second->readyToInit;
 		}
 		if (readyToInit) {
-			sendPacket(clients, "i");
+			// The clients stop the Lua callbacks where the server does.
+			sendPacket(clients, "i" + std::to_string(instructionBudget));
 			initGame();
-			listeners.clear();
+			// Without snapshots nobody can join the running game.
+			if (snapshotInterval <= 0) {
+				listeners.clear();
+			}
 		}
 		return true;
 	}
@@ -170,10 +285,92 @@ bool Connection::Server::handlePacket(Client& client, std::string& data) {
 		return true;
 	}
 
+	// Join the running game, optionally with the players of a client that has left; that takes its token.
+	if (type == 'r') {
+		if (state != PLAY || snapshotPacket.empty()) {
+			return false;
+		}
+		// The id of the old client, then its token.
+		const std::string::size_type space = data.find(' ');
+		int id;
+		try {
+			id = std::stoi(data.substr(0, space).to_string());
+		} catch (std::logic_error&) {
+			return false;
+		}
+		if (id) {
+			ClientInfoContainerType::iterator old = departedClients.find(id);
+			std::map<int, std::string>::iterator token = rejoinTokens.find(id);
+			if (old == departedClients.end() || token == rejoinTokens.end() || space == boost::string_ref::npos || data.substr(space + 1) != token->second) {
+				return false;
+			}
+			client.players = old->second->players;
+			departedClients.erase(old);
+			rejoinTokens.erase(token);
+			game->insertClient(clients[client.id]);
+			sendPacket(clients, 'c' + client.serialize());
+			if (recorder) {
+				recorder->recordClient(client);
+			}
+			// The snapshot must include the new client, in case it leaves before the next one.
+			takeSnapshot();
+		}
+		sendPacket(client, snapshotPacket);
+		for (std::vector<std::string>::const_iterator i = snapshotBatches.begin(); i != snapshotBatches.end(); ++i) {
+			sendPacket(client, *i);
+		}
+		return true;
+	}
+
+	// A client has found that its game differs from ours.
+	if (type == 'x') {
+		try {
+			handleDesync(client, data);
+		} catch (std::runtime_error&) {
+			return false;
+		}
+		return true;
+	}
+
 	// Invalid packet.
 	return false;
 }
 
+void Connection::Server::handleDesync(Client& client, boost::string_ref data) {
+	Deserializer input(data.data(), data.size());
+	std::uint64_t step, hashStep;
+	unsigned int count;
+	input.get(step);
+	input.get(hashStep);
+	input.get(count);
+	std::cerr << "Game " << name << ": client " << client.id << " is out of sync since step " << step << "!" << std::endl;
+
+	const ObjectHashes& own = objectHashes[hashStep % objectHashHistory];
+	if (own.step != hashStep) {
+		std::cerr << "The object states of step " << hashStep << " are not available any more." << std::endl;
+		return;
+	}
+
+	// The client's list is sorted by id; sort ours and find the first object that is different or missing.
+	std::vector<std::pair<unsigned int, std::uint64_t> > sorted(own.hashes);
+	std::sort(sorted.begin(), sorted.end());
+	std::vector<std::pair<unsigned int, std::uint64_t> >::const_iterator i = sorted.begin();
+	while (count--) {
+		std::pair<unsigned int, std::uint64_t> theirs;
+		input.get(theirs.first);
+		input.get(theirs.second);
+		if (i == sorted.end() || *i != theirs) {
+			const unsigned int id = (i == sorted.end() || theirs.first < i->first) ? theirs.first : i->first;
+			std::cerr << "At step " << hashStep << ", object " << id << " is the first one that differs." << std::endl;
+			return;
+		}
+		++i;
+	}
+	if (i != sorted.end()) {
+		std::cerr << "At step " << hashStep << ", object " << i->first << " is the first one that differs." << std::endl;
+	}
+}
+
 void Connection::Server::update() {
 	std::lock_guard<std::recursive_mutex> lock(*this);
 	if (state != SETUP) {
@@ -200,7 +397,7 @@ void Connection::Server::update() {
 		ClientInfoContainerType::iterator j = i++;
 		Client& client = dynamic_cast<Client&>(*j->second);
 		EndPoint& endPoint = *client.connection;
-		std::string data;
+		boost::string_ref data;
 		while (true) {
 			try {
 				if (!endPoint.receivePacket(data)) {
@@ -219,12 +416,16 @@ void Connection::Server::update() {
 		}
 	}
 	if (state == PLAY) {
-		game->runUntil(clock.getTime(), std::bind(&Server::sendMessage, this, std::placeholders::_1));
+		const Scalar<SIUnit::Time> oldTime = game->getTime();
+		game->runUntil(clock.getTime(), std::bind(&Server::queueMessage, this, std::placeholders::_1));
 
-		// PING
-		Game::Message msg;
-		msg.timestamp = game->getTime();
-		sendMessage(msg);
+		// Messages are only handled by steps, so nothing is queued unless the game advanced.
+		if (game->getTime() != oldTime) {
+			sendBatch();
+			if (snapshotInterval > 0 && game->getTime() >= snapshotTime + snapshotInterval) {
+				takeSnapshot();
+			}
+		}
 	}
 }
 
@@ -244,8 +445,40 @@ void Connection::Server::sendPacket(const ClientInfoContainerType& clients, cons
 	}
 }
 
-void Connection::Server::sendMessage(const Game::Message& msg) {
-	sendPacket(clients, 'm' + msg.serialize());
+void Connection::Server::queueMessage(const Game::Message& msg) {
+	batch.put(true);
+	msg.serialize(batch);
+}
+
+void Connection::Server::sendBatch() {
+	// The packet is built once and shared by all clients.
+	batch.put(false);
+	batch.put(game->getTime());
+
+	// The state hashes of the steps since the last batch, for desync detection.
+	const std::uint64_t step = game->getStep();
+	const unsigned int count = std::min<std::uint64_t>(step - batchStep, Game::Game::stateHashHistory);
+	batch.put(step);
+	batch.put(count);
+	for (std::uint64_t i = step - count + 1; i <= step; ++i) {
+		std::uint64_t hash = 0;
+		game->getStateHash(i, hash);
+		batch.put(hash);
+	}
+	ObjectHashes& hashes = objectHashes[step % objectHashHistory];
+	hashes.step = step;
+	game->getObjectHashes(hashes.hashes);
+	batchStep = step;
+	if (recorder) {
+		recorder->record(batch.getData());
+	}
+	batchPacket.assign(1, 'b');
+	batchPacket.append(batch.getData());
+	batch.clear();
+	sendPacket(clients, batchPacket);
+	if (!snapshotPacket.empty()) {
+		snapshotBatches.push_back(batchPacket);
+	}
 }
 
 void Connection::Server::setName(const std::string& name_) {
@@ -2,7 +2,10 @@
 #define PUTKARTS_Connection_Server_HPP
 
 #include <string>
+#include <cstdint>
 #include <set>
+#include <map>
+#include <vector>
 #include <memory>
 #include <mutex>
 
@@ -10,7 +13,10 @@
 #include "connection/EndPoint.hpp"
 #include "connection/Listener.hpp"
 #include "connection/Metaserver.hpp"
+#include "connection/Wakeup.hpp"
+#include "connection/ReplayRecorder.hpp"
 #include "util/Clock.hpp"
+#include "util/Serializer.hpp"
 
 namespace Connection {
 	class Server;
@@ -44,6 +50,63 @@ class Connection::Server: virtual public Connection::Base, public std::enable_sh
 	/** The name of this server (or game). */
 	std::string name;
 
+	/** Wakeup for the main loop; notified by the connections. May be shared by many servers. */
+	std::shared_ptr<Wakeup> wakeup;
+
+	/** The messages handled during this update, to be sent in one packet. */
+	Serializer batch;
+
+	/** Buffer for the batch packet. */
+	std::string batchPacket;
+
+	/** The sequence number of the last received message; orders messages with the same timestamp. */
+	unsigned int messageSequence;
+
+	/** The file for recording a replay, or empty. */
+	std::string replayPath;
+
+	/** The replay recorder, while the game is running. */
+	std::unique_ptr<ReplayRecorder> recorder;
+
+	/** The game time between snapshots, or zero for no snapshots. */
+	Scalar<SIUnit::Time> snapshotInterval;
+
+	/** The latest snapshot as a packet, or empty. */
+	std::string snapshotPacket;
+
+	/** The game time of the latest snapshot. */
+	Scalar<SIUnit::Time> snapshotTime;
+
+	/** The batch packets sent after the latest snapshot. */
+	std::vector<std::string> snapshotBatches;
+
+	/** Clients that have left the running game, so that they can rejoin. */
+	ClientInfoContainerType departedClients;
+
+	/** The secret that each client, present or departed, must show to rejoin with its players. */
+	std::map<int, std::string> rejoinTokens;
+
+	/** The object hashes of one step; see Game::Game::getObjectHashes. */
+	struct ObjectHashes {
+		/** The step. */
+		std::uint64_t step;
+
+		/** The hashes by object id. */
+		std::vector<std::pair<unsigned int, std::uint64_t> > hashes;
+	};
+
+	/** How far ahead of the game a client may stamp its messages, in seconds. */
+	static const unsigned int maxMessageDelay = 10;
+
+	/** The number of batches whose object hashes are kept for desync reports. */
+	static const std::size_t objectHashHistory = 32;
+
+	/** The object hashes of the latest batches, by step modulo objectHashHistory. */
+	std::vector<ObjectHashes> objectHashes;
+
+	/** The last step in the latest batch. */
+	std::uint64_t batchStep;
+
 	/**
 	 * Insert a new client.
 	 *
@@ -68,11 +131,30 @@ class Connection::Server: virtual public Connection::Base, public std::enable_sh
 	void sendPacket(const ClientInfoContainerType& clients, const std::string& data);
 
 	/**
-	 * Send a message to all clients.
+	 * Add a handled message to the batch.
 	 *
 	 * @param msg The message.
 	 */
-	void sendMessage(const Game::Message& msg);
+	void queueMessage(const Game::Message& msg);
+
+	/**
+	 * Send the batch and the current game time to all clients.
+	 */
+	void sendBatch();
+
+	/**
+	 * Take a snapshot of the game for clients that join late.
+	 */
+	void takeSnapshot();
+
+	/**
+	 * Log a desync report from a client.
+	 *
+	 * @param client The client.
+	 * @param data The report.
+	 * @throw std::runtime_error Thrown if the report is invalid.
+	 */
+	void handleDesync(Client& client, boost::string_ref data);
 
 	/**
 	 * Handle a packet.
@@ -81,7 +163,7 @@ class Connection::Server: virtual public Connection::Base, public std::enable_sh
 	 * @param data The packet.
 	 * @return false if the client should be removed, true otherwise.
 	 */
-	bool handlePacket(Client& client, std::string& data);
+	bool handlePacket(Client& client, boost::string_ref data);
 
 	/**
 	 * Remove a client.
@@ -89,11 +171,39 @@ class Connection::Server: virtual public Connection::Base, public std::enable_sh
 	void removeClient(int id);
 
 public:
+	/**
+	 * Constructor.
+	 */
+	Server();
+
+	/**
+	 * Constructor for servers that share a main loop.
+	 *
+	 * @param wakeup_ The wakeup of the main loop.
+	 */
+	explicit Server(std::shared_ptr<Wakeup> wakeup_);
+
 	/**
 	 * Run until the game ends or all clients disconnect.
+	 *
+	 * The server sleeps until a connection has data or the next game step is due.
 	 */
 	void run();
 
+	/**
+	 * Wake up the main loop.
+	 */
+	void wake() {
+		wakeup->notify();
+	}
+
+	/**
+	 * Get the time until the next update is due, if nothing wakes the server before.
+	 *
+	 * @return The time.
+	 */
+	Scalar<SIUnit::Time> getTimeout();
+
 	/**
 	 * Create a local client.
 	 */
@@ -106,6 +216,17 @@ public:
 	 */
 	void addClient(std::shared_ptr<EndPoint> connection);
 
+	/**
+	 * Insert a new client, if the game hasn't started yet.
+	 *
+	 * The state is checked under the same lock that the main loop holds
+	 * while it changes the state, so this is safe from other threads.
+	 *
+	 * @param connection The channel of communication.
+	 * @return True if the client was inserted.
+	 */
+	bool joinSetup(std::shared_ptr<EndPoint> connection);
+
 	/**
 	 * Insert a new listener.
 	 *
@@ -120,6 +241,26 @@ public:
 	 */
 	void setName(const std::string& name);
 
+	/**
+	 * Record a replay of the game.
+	 *
+	 * @param replayPath_ The file, or empty for no replay.
+	 */
+	void setReplayPath(const std::string& replayPath_) {
+		replayPath = replayPath_;
+	}
+
+	/**
+	 * Take snapshots of the running game, so that clients can join or rejoin it.
+	 *
+	 * Without snapshots the listeners are closed when the game starts.
+	 *
+	 * @param snapshotInterval_ The game time between snapshots, or zero for no snapshots.
+	 */
+	void setSnapshotInterval(Scalar<SIUnit::Time> snapshotInterval_) {
+		snapshotInterval = snapshotInterval_;
+	}
+
 	/**
 	 * Get the server name.
 	 *
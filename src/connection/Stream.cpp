@@ -1,29 +1,67 @@
-#include <boost/format.hpp>
+#include <algorithm>
+#include <stdexcept>
 
 #include "Stream.hpp"
 
+/** How much to try to read at once. */
+static const std::size_t readSize = 1 << 16;
+
+/**
+ * Read the packet size from a header.
+ *
+ * @param header The header.
+ * @return The size of the packet.
+ * @throw std::runtime_error if the size is invalid.
+ */
+static std::size_t readHeader(const char* header) {
+	std::size_t size = 0;
+	for (std::size_t i = 0; i < Connection::Stream::headerSize; ++i) {
+		size |= (std::size_t) (unsigned char) header[i] << (8 * i);
+	}
+	if (size > Connection::Stream::maxPacketSize) {
+		throw std::runtime_error("Invalid packet size!");
+	}
+	return size;
+}
+
 void Connection::Stream::sendPacket(const std::string& data) {
-	sendData((boost::format("%08x") % data.size()).str());
-	sendData(data);
+	if (data.size() > maxPacketSize) {
+		throw std::runtime_error("Packet is too big!");
+	}
+	char header[headerSize];
+	for (std::size_t i = 0; i < headerSize; ++i) {
+		header[i] = (char) (data.size() >> (8 * i));
+	}
+	sendData(header, headerSize, data.data(), data.size());
 }
 
-bool Connection::Stream::receivePacket(std::string& data) {
-	while (!recvSize) {
-		receiveData(8 - recvBuf.size());
-		if (recvBuf.size() < 8) {
+bool Connection::Stream::receivePacket(boost::string_ref& data) {
+	std::size_t available = recvBuf.size() - recvStart;
+	std::size_t needed = headerSize;
+	if (available >= headerSize) {
+		needed += readHeader(&recvBuf[recvStart]);
+	}
+
+	// Read more only if the buffer doesn't hold a whole packet.
+	if (available < needed) {
+		// Move the unread data to the beginning; this invalidates the last packet.
+		if (recvStart) {
+			std::copy(recvBuf.begin() + recvStart, recvBuf.end(), recvBuf.begin());
+			recvBuf.resize(available);
+			recvStart = 0;
+		}
+		receiveData(std::max(readSize, needed - available));
+		available = recvBuf.size();
+		if (available < headerSize) {
+			return false;
+		}
+		needed = headerSize + readHeader(&recvBuf[0]);
+		if (available < needed) {
 			return false;
 		}
-		recvBuf.push_back(0);
-		recvSize = std::strtoul(&recvBuf[0], 0, 16);
-		recvBuf.clear();
-		recvBuf.reserve(recvSize);
-	}
-	receiveData(recvSize - recvBuf.size());
-	if (recvBuf.size() < recvSize) {
-		return false;
 	}
-	data.assign(recvBuf.begin(), recvBuf.end());
-	recvBuf.clear();
-	recvSize = 0;
+
+	data = boost::string_ref(recvBuf.data() + recvStart + headerSize, needed - headerSize);
+	recvStart += needed;
 	return true;
 }
@@ -2,6 +2,7 @@
 #define PUTKARTS_Connection_Stream_HPP
 
 #include <vector>
+#include <cstddef>
 
 #include "connection/EndPoint.hpp"
 
@@ -11,10 +12,19 @@ namespace Connection {
 
 /**
  * Connection helper that wraps packets into a stream.
+ *
+ * Each packet is preceded by its length as a 32-bit little endian number.
  */
 class Connection::Stream: public Connection::EndPoint {
-	/** Number of bytes missing from the next packet. */
-	size_t recvSize;
+	/** The start of the unread data in recvBuf. */
+	std::size_t recvStart;
+
+public:
+	/** The size of the packet header. */
+	static const std::size_t headerSize = 4;
+
+	/** The largest accepted packet; anything bigger is taken as garbage. */
+	static const std::size_t maxPacketSize = 1 << 26;
 
 protected:
 	/** The buffer for receiving data. */
@@ -24,15 +34,18 @@ protected:
 	 * Constructor.
 	 */
 	Stream():
-		recvSize(0) {
+		recvStart(0) {
 	}
 
 	/**
-	 * Send some data.
+	 * Send a packet header and the packet, preferably with one write.
 	 *
-	 * @param data The data to send.
+	 * @param header The header.
+	 * @param headerLength The length of the header.
+	 * @param data The packet.
+	 * @param dataLength The length of the packet.
 	 */
-	virtual void sendData(const std::string& data) = 0;
+	virtual void sendData(const char* header, std::size_t headerLength, const char* data, std::size_t dataLength) = 0;
 
 	/**
 	 * Receive some data and append it to the recvBuf.
@@ -46,7 +59,7 @@ public:
 	virtual void sendPacket(const std::string& data);
 
 	/** @copydoc EndPoint::receivePacket */
-	virtual bool receivePacket(std::string& data);
+	virtual bool receivePacket(boost::string_ref& data);
 };
 
 #endif
@@ -1,16 +1,208 @@
-#include <boost/format.hpp>
+#include <algorithm>
+#include <array>
+#include <mutex>
+#include <stdexcept>
+#include <functional>
 
 #include "TCPEndPoint.hpp"
+#include "IOService.hpp"
+#include "Wakeup.hpp"
 
-void Connection::TCPEndPoint::sendData(const std::string& data) {
-	boost::asio::write(socket, boost::asio::buffer(data));
+/**
+ * The socket and the buffers of a TCPEndPoint.
+ *
+ * The socket is only used from the I/O thread (except for connecting),
+ * and the handlers keep the object alive until they have run.
+ */
+class Connection::TCPEndPoint::TCPEndPointImpl: public std::enable_shared_from_this<TCPEndPointImpl> {
+public:
+	/** The TCP stream. */
+	boost::asio::ip::tcp::socket socket;
+
+	/** Lock for the fields shared with the owner's thread. */
+	std::mutex mutex;
+
+	/** Buffer for reading; used only by the I/O thread. */
+	std::array<char, 1 << 16> readBuffer;
+
+	/** Data received but not yet taken by the owner. */
+	std::vector<char> received;
+
+	/** Data waiting to be written. */
+	std::string queued;
+
+	/** Data being written; used only by the I/O thread. */
+	std::string writing;
+
+	/** Is a write queued or running? */
+	bool writeActive;
+
+	/** Has the connection failed? */
+	bool closed;
+
+	/** Should the socket be closed after the pending writes? */
+	bool closing;
+
+	/** The wakeup to notify about new data, or NULL. */
+	std::shared_ptr<Wakeup> wakeup;
+
+	/**
+	 * Constructor.
+	 */
+	TCPEndPointImpl():
+		socket(IOService::get()),
+		writeActive(false),
+		closed(false),
+		closing(false) {
+	}
+
+	/**
+	 * Notify the wakeup, if any. The lock must be held.
+	 */
+	void notify() {
+		if (wakeup) {
+			wakeup->notify();
+		}
+	}
+
+	/**
+	 * Start an asynchronous read.
+	 */
+	void startRead() {
+		socket.async_read_some(boost::asio::buffer(readBuffer), std::bind(&TCPEndPointImpl::handleRead, shared_from_this(), std::placeholders::_1, std::placeholders::_2));
+	}
+
+	/**
+	 * Store the received data and continue reading.
+	 */
+	void handleRead(const boost::system::error_code& error, std::size_t size) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (error) {
+			closed = true;
+			notify();
+			return;
+		}
+		received.insert(received.end(), readBuffer.begin(), readBuffer.begin() + size);
+		notify();
+		startRead();
+	}
+
+	/**
+	 * Write all of the queued data.
+	 */
+	void startWrite() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			writing.swap(queued);
+		}
+		boost::asio::async_write(socket, boost::asio::buffer(writing), std::bind(&TCPEndPointImpl::handleWrite, shared_from_this(), std::placeholders::_1, std::placeholders::_2));
+	}
+
+	/**
+	 * Continue writing if more data has been queued.
+	 */
+	void handleWrite(const boost::system::error_code& error, std::size_t size) {
+		writing.clear();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (error) {
+				closed = true;
+				writeActive = false;
+				notify();
+				return;
+			}
+			if (queued.empty()) {
+				writeActive = false;
+				if (closing) {
+					boost::system::error_code ignored;
+					socket.close(ignored);
+				}
+				return;
+			}
+		}
+		startWrite();
+	}
+
+	/**
+	 * Close the socket once the pending writes are done.
+	 */
+	void close() {
+		std::lock_guard<std::mutex> lock(mutex);
+		closing = true;
+		wakeup.reset();
+		if (!writeActive) {
+			boost::system::error_code ignored;
+			socket.close(ignored);
+		}
+	}
+};
+
+Connection::TCPEndPoint::TCPEndPoint():
+	impl(new TCPEndPointImpl()) {
+}
+
+Connection::TCPEndPoint::TCPEndPoint(const std::string& address, int port):
+	impl(new TCPEndPointImpl()) {
+	connect(address, std::to_string(port));
+}
+
+Connection::TCPEndPoint::TCPEndPoint(const std::string& address, const std::string& port):
+	impl(new TCPEndPointImpl()) {
+	connect(address, port);
+}
+
+Connection::TCPEndPoint::~TCPEndPoint() {
+	IOService::get().post(std::bind(&TCPEndPointImpl::close, impl));
+}
+
+boost::asio::ip::tcp::socket& Connection::TCPEndPoint::getSocket() {
+	return impl->socket;
+}
+
+void Connection::TCPEndPoint::start() {
+	IOService::get().post(std::bind(&TCPEndPointImpl::startRead, impl));
+}
+
+void Connection::TCPEndPoint::connect(const std::string& address, const std::string& port) {
+	// Connecting blocks; the I/O thread takes over only after this.
+	boost::asio::ip::tcp::resolver resolver(IOService::get());
+	boost::asio::ip::tcp::resolver::query query(address, port);
+	boost::asio::connect(impl->socket, resolver.resolve(query));
+	start();
+}
+
+void Connection::TCPEndPoint::setWakeup(std::shared_ptr<Wakeup> wakeup) {
+	std::lock_guard<std::mutex> lock(impl->mutex);
+	impl->wakeup = wakeup;
+	if (!impl->received.empty() || impl->closed) {
+		impl->notify();
+	}
+}
+
+void Connection::TCPEndPoint::sendData(const char* header, std::size_t headerLength, const char* data, std::size_t dataLength) {
+	std::lock_guard<std::mutex> lock(impl->mutex);
+	if (impl->closed) {
+		throw std::runtime_error("Connection closed!");
+	}
+	// Packets queued before the write starts go out with one system call.
+	impl->queued.append(header, headerLength);
+	impl->queued.append(data, dataLength);
+	if (!impl->writeActive) {
+		impl->writeActive = true;
+		IOService::get().post(std::bind(&TCPEndPointImpl::startWrite, impl));
+	}
 }
 
 void Connection::TCPEndPoint::receiveData(size_t size) {
-	if (!socket.available()) {
+	std::lock_guard<std::mutex> lock(impl->mutex);
+	std::vector<char>& received = impl->received;
+	if (received.empty()) {
+		if (impl->closed) {
+			throw std::runtime_error("Connection closed!");
+		}
 		return;
 	}
-	size_t old = recvBuf.size();
-	recvBuf.resize(old + size);
-	recvBuf.resize(old + socket.read_some(boost::asio::buffer(&recvBuf[old], size)));
+	size = std::min(size, received.size());
+	recvBuf.insert(recvBuf.end(), received.begin(), received.begin() + size);
+	received.erase(received.begin(), received.begin() + size);
 }
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <string>
+#include <memory>
 #include <boost/asio.hpp>
 
 #include "connection/Stream.hpp"
@@ -13,23 +14,35 @@ namespace Connection {
 
 /**
  * Connection end point.
+ *
+ * The socket is served asynchronously by the shared IOService: incoming
+ * data is buffered as it arrives, and outgoing data is queued and
+ * written in the background.
  */
 class Connection::TCPEndPoint: public Connection::Stream {
 	friend class TCPListener;
 
-	/** The io service. */
-	boost::asio::io_service service;
+	/** Class for the socket and the buffers; shared with the I/O thread. */
+	class TCPEndPointImpl;
 
-	/** The TCP stream. */
-	boost::asio::ip::tcp::socket socket;
+	/** Pointer to the implementation. */
+	std::shared_ptr<TCPEndPointImpl> impl;
+
+	/**
+	 * Get the socket, for connecting or accepting.
+	 */
+	boost::asio::ip::tcp::socket& getSocket();
+
+	/**
+	 * Start reading from the connected socket.
+	 */
+	void start();
 
 public:
 	/**
 	 * Default constructor for use with TCPListener.
 	 */
-	TCPEndPoint():
-		socket(service) {
-	}
+	TCPEndPoint();
 
 	/**
 	 * Connect to an address.
@@ -37,10 +50,7 @@ public:
 	 * @param address The address.
 	 * @param port The port.
 	 */
-	TCPEndPoint(const std::string& address, int port):
-		socket(service) {
-		connect(address, std::to_string(port));
-	}
+	TCPEndPoint(const std::string& address, int port);
 
 	/**
 	 * Connect to an address.
@@ -48,10 +58,12 @@ public:
 	 * @param address The address.
 	 * @param port The port.
 	 */
-	TCPEndPoint(const std::string& address, const std::string& port):
-		socket(service) {
-		connect(address, port);
-	}
+	TCPEndPoint(const std::string& address, const std::string& port);
+
+	/**
+	 * Destructor; closes the connection after sending the queued data.
+	 */
+	virtual ~TCPEndPoint();
 
 	/**
 	 * Connect to an address.
@@ -59,15 +71,14 @@ public:
 	 * @param address The address.
 	 * @param port The port.
 	 */
-	void connect(const std::string& address, const std::string& port) {
-		boost::asio::ip::tcp::resolver resolver(service);
-		boost::asio::ip::tcp::resolver::query query(address, port);
-		boost::asio::connect(socket, resolver.resolve(query));
-	}
+	void connect(const std::string& address, const std::string& port);
+
+	/** @copydoc EndPoint::setWakeup */
+	virtual void setWakeup(std::shared_ptr<Wakeup> wakeup);
 
 protected:
 	/** @copydoc Stream::sendData */
-	virtual void sendData(const std::string& data);
+	virtual void sendData(const char* header, std::size_t headerLength, const char* data, std::size_t dataLength);
 
 	/** @copydoc Stream::receiveData */
 	virtual void receiveData(size_t size);
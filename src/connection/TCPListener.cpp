@@ -1,29 +1,118 @@
-#include <boost/format.hpp>
+#include <vector>
+#include <mutex>
+#include <functional>
 
 #include "TCPListener.hpp"
+#include "IOService.hpp"
+#include "Wakeup.hpp"
+
+/**
+ * The acceptor and the accepted connections of a TCPListener.
+ */
+class Connection::TCPListener::TCPListenerImpl: public std::enable_shared_from_this<TCPListenerImpl> {
+public:
+	/** The listening socket. */
+	boost::asio::ip::tcp::acceptor acceptor;
+
+	/** A placeholder for the next client; used only by the I/O thread. */
+	std::shared_ptr<TCPEndPoint> next;
+
+	/** Lock for the fields below. */
+	std::mutex mutex;
+
+	/** Accepted connections that haven't been given to the server yet. */
+	std::vector<std::shared_ptr<TCPEndPoint> > accepted;
+
+	/** Has accepting failed? */
+	bool failed;
+
+	/** The wakeup to notify about new connections, or NULL. */
+	std::shared_ptr<Wakeup> wakeup;
+
+	/**
+	 * Constructor.
+	 */
+	TCPListenerImpl():
+		acceptor(IOService::get()),
+		failed(false) {
+	}
+
+	/**
+	 * Start accepting the next connection.
+	 */
+	void startAccept() {
+		next.reset(new TCPEndPoint());
+		acceptor.async_accept(next->getSocket(), std::bind(&TCPListenerImpl::handleAccept, shared_from_this(), std::placeholders::_1));
+	}
+
+	/**
+	 * Store the accepted connection and accept the next one.
+	 */
+	void handleAccept(const boost::system::error_code& error) {
+		if (error == boost::asio::error::operation_aborted) {
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (error) {
+				failed = true;
+			} else {
+				next->start();
+				accepted.push_back(next);
+			}
+			if (wakeup) {
+				wakeup->notify();
+			}
+		}
+		if (!error) {
+			startAccept();
+		}
+	}
+
+	/**
+	 * Stop listening.
+	 */
+	void close() {
+		boost::system::error_code ignored;
+		acceptor.close(ignored);
+	}
+};
 
 Connection::TCPListener::TCPListener(const boost::asio::ip::tcp::endpoint& address):
-	acceptor(service),
-	next(new TCPEndPoint()) {
+	impl(new TCPListenerImpl()) {
+	boost::asio::ip::tcp::acceptor& acceptor = impl->acceptor;
 	acceptor.open(address.protocol());
 	acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
 	if (address.address().is_v6()) {
 		acceptor.set_option(boost::asio::ip::v6_only(true));
 	}
-	acceptor.non_blocking(true);
 	acceptor.bind(address);
 	acceptor.listen();
+	localEndpoint = acceptor.local_endpoint();
+	IOService::get().post(std::bind(&TCPListenerImpl::startAccept, impl));
+}
+
+Connection::TCPListener::~TCPListener() {
+	IOService::get().post(std::bind(&TCPListenerImpl::close, impl));
 }
 
 bool Connection::TCPListener::update(Server& server) {
-	while (true) {
-		boost::system::error_code error;
-		acceptor.accept(next->socket, error);
-		if (error) {
-			return (error == boost::asio::error::would_block);
-		}
-		server.addClient(next);
-		next.reset(new TCPEndPoint());
+	std::vector<std::shared_ptr<EndPoint> > tmp;
+	bool ok = accept(tmp);
+	for (std::vector<std::shared_ptr<EndPoint> >::iterator i = tmp.begin(); i != tmp.end(); ++i) {
+		server.addClient(*i);
 	}
-	return true;
+	return ok;
+}
+
+bool Connection::TCPListener::accept(std::vector<std::shared_ptr<EndPoint> >& connections) {
+	std::lock_guard<std::mutex> lock(impl->mutex);
+	connections.insert(connections.end(), impl->accepted.begin(), impl->accepted.end());
+	impl->accepted.clear();
+	return !impl->failed;
+}
+
+void Connection::TCPListener::setWakeup(std::shared_ptr<Wakeup> wakeup) {
+	std::lock_guard<std::mutex> lock(impl->mutex);
+	impl->wakeup = wakeup;
 }
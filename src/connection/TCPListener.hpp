@@ -13,18 +13,19 @@ namespace Connection {
 
 /**
  * TCP listener.
+ *
+ * Connections are accepted asynchronously by the shared IOService and
+ * handed to the server on the next update.
  */
 class Connection::TCPListener: public Connection::Listener {
-	friend class Address;
+	/** Class for the acceptor and the accepted connections; shared with the I/O thread. */
+	class TCPListenerImpl;
 
-	/** Boost IO service. */
-	boost::asio::io_service service;
+	/** Pointer to the implementation. */
+	std::shared_ptr<TCPListenerImpl> impl;
 
-	/** The listening socket. */
-	boost::asio::ip::tcp::acceptor acceptor;
-
-	/** A placeholder for the next client. */
-	std::shared_ptr<TCPEndPoint> next;
+	/** The local address. */
+	boost::asio::ip::tcp::endpoint localEndpoint;
 
 public:
 	/**
@@ -34,8 +35,28 @@ public:
 	 */
 	TCPListener(const boost::asio::ip::tcp::endpoint& address);
 
+	/**
+	 * Destructor; stops listening.
+	 */
+	virtual ~TCPListener();
+
+	/**
+	 * Get the local address.
+	 *
+	 * @return The address.
+	 */
+	const boost::asio::ip::tcp::endpoint& getLocalEndpoint() const {
+		return localEndpoint;
+	}
+
 	/** @copydoc Connection::Listener::update */
 	virtual bool update(Server& server);
+
+	/** @copydoc Connection::Listener::accept */
+	virtual bool accept(std::vector<std::shared_ptr<EndPoint> >& connections);
+
+	/** @copydoc Connection::Listener::setWakeup */
+	virtual void setWakeup(std::shared_ptr<Wakeup> wakeup);
 };
 
 #endif
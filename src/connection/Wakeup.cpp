@@ -0,0 +1,21 @@
+#include <chrono>
+
+#include "Wakeup.hpp"
+
+void Connection::Wakeup::notify() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		notified = true;
+	}
+	condition.notify_all();
+}
+
+void Connection::Wakeup::wait(Scalar<SIUnit::Time> timeout) {
+	std::unique_lock<std::mutex> lock(mutex);
+	if (!notified && timeout.isPositive()) {
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now()
+			+ std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(timeout.getDouble()));
+		while (!notified && condition.wait_until(lock, end) != std::cv_status::timeout);
+	}
+	notified = false;
+}
@@ -0,0 +1,51 @@
+#ifndef PUTKARTS_Connection_Wakeup_HPP
+#define PUTKARTS_Connection_Wakeup_HPP
+
+#include <mutex>
+#include <condition_variable>
+#include <boost/utility.hpp>
+
+#include "util/Scalar.hpp"
+
+namespace Connection {
+	class Wakeup;
+}
+
+/**
+ * A signal for waking up a sleeping server loop.
+ *
+ * End points and listeners notify the wakeup when they have something
+ * to handle, so the loop can sleep until then instead of polling.
+ */
+class Connection::Wakeup: boost::noncopyable {
+	/** Lock for the flag. */
+	std::mutex mutex;
+
+	/** Condition for waiting. */
+	std::condition_variable condition;
+
+	/** Has there been a notification since the last wait? */
+	bool notified;
+
+public:
+	/**
+	 * Constructor.
+	 */
+	Wakeup():
+		notified(false) {
+	}
+
+	/**
+	 * Wake up the waiting thread, or make its next wait return immediately.
+	 */
+	void notify();
+
+	/**
+	 * Wait until notified or until the timeout.
+	 *
+	 * @param timeout The maximum time to wait.
+	 */
+	void wait(Scalar<SIUnit::Time> timeout);
+};
+
+#endif
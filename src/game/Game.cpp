@@ -1,25 +1,44 @@
 #include <stdexcept>
 #include <vector>
 #include <functional>
-
+#include <cmath>
+#include <map>
+#include <algorithm>
+#include <limits>
+
+#include "util/PoolAllocator.hpp"
+#include "util/Serializer.hpp"
+#include "util/Deserializer.hpp"
 #include "Game.hpp"
 
 Game::Game::Game(std::shared_ptr<Map> map_):
+	messages(1),
 	map(map_),
-	freeObjectId(1) {
+	freeObjectId(1),
+	stateHashes(stateHashHistory),
+	firstHashedStep(0),
+	grid(map_ ? map_->getSizeX() : 0, map_ ? map_->getSizeY() : 0, 2),
+	objectPool(new MemoryPool()) {
 	if (!map.get()) {
 		throw std::logic_error("Game::Game: Map is NULL!");
 	}
+	pathfinder.setMap(*map);
+	pathfinder.loadGraph(Path::getLocalDataPath(map->getDirectory() + "/paths.cache"));
 
 	// Initialise the Lua interface.
-	bind("luaNewObjectType", std::bind(&Game::luaNewObjectType, this));
-	bind("luaNewObjectAction", std::bind(&Game::luaNewObjectAction, this));
-	bind("luaNewObject", std::bind(&Game::luaNewObject, this));
-	bind("luaDeleteObject", std::bind(&Game::luaDeleteObject, this));
+	bind("luaNewObjectType", this, &Game::luaNewObjectType);
+	bind("luaNewObjectAction", this, &Game::luaNewObjectAction);
+	bind("luaNewObject", this, &Game::luaNewObject);
+	bind("luaDeleteObject", this, &Game::luaDeleteObject);
+	bind("luaWakeObject", this, &Game::luaWakeObject);
 	runFile<void>(Path::findDataPath("lua/Game.lua"));
+	eraseObjectFunction = compile("local id = ...; if Game.objects[id] then Object.delete(Game.objects[id]) end", "eraseObject");
+	handleMessageFunction = compile("Game.handleMessage(...)", "handleMessage");
+	saveStateFunction = compile("return Game.saveState()", "saveState");
+	loadStateFunction = compile("Game.loadState(...)", "loadState");
 
 	// TODO: Read the tech tree.
-	run<void>("\
+	loadCached("\
 		ObjectType.new({\
 			id = 'testStart',\
 			name = 'Test starting position',\
@@ -35,7 +54,8 @@ Game::Game::Game(std::shared_ptr<Map> map_):
 		})\
 		ObjectType.new({id = 'testUnit', name = 'Test unit', radius = 0.4, maxVelocity = 2.5})\
 		ObjectType.new({id = 'testUnit2', name = 'Bigger test unit', radius = 0.6, maxVelocity = 3.5})\
-	");
+	", "tech tree");
+	call(0, 0);
 
 	// Initialise players.
 	const Map::PlayerContainerType& mapPlayers = map->getPlayers();
@@ -47,46 +67,361 @@ Game::Game::Game(std::shared_ptr<Map> map_):
 		insertPlayer(testPlayer);
 
 		// Create starting position.
-		load("local t = {...}; Object.new({objectTypeId = 'testStart', playerId = t[1], x = t[2], y = t[3]});");
+		loadCached("local t = {...}; Object.new({objectTypeId = 'testStart', playerId = t[1], x = t[2], y = t[3]});");
 		push<Lua::Number>(testPlayer->id);
 		push<Lua::Number>(p.startPosition.x.getDouble());
 		push<Lua::Number>(p.startPosition.y.getDouble());
 		call(3, 0);
 	}
+	recordStateHash();
+}
+
+Game::Game::~Game() {
+	// The objects may outlive the game, but the tasks don't.
+	for (ObjectContainerType::iterator i = objects.begin(); i != objects.end(); ++i) {
+		i->second->task = 0;
+	}
 }
 
 void Game::Game::runUntil(Scalar<SIUnit::Time> time, MessageCallbackType messageCallback) {
-	const Scalar<SIUnit::Time> dt = 1.0 / 32;
+	const Scalar<SIUnit::Time> dt = getStepLength();
 	while (clock + dt <= time) {
 		runStep(dt, messageCallback);
 	}
 }
 
 void Game::Game::insertMessage(const Message& message) {
-	messages.push(message);
+	// Step k ends at k * getStepLength(); allow for rounding errors.
+	const double steps = std::ceil((message.timestamp / getStepLength()).getDouble() - 1e-6);
+	if (!(steps < (double) std::numeric_limits<MessageQueue::TickType>::max() / 2)) {
+		throw std::runtime_error("Game::insertMessage: Invalid timestamp!");
+	}
+	messages.push(steps > 0 ? (MessageQueue::TickType) steps : 0, message);
 }
 
-void Game::Game::eraseObject(std::shared_ptr<Object> object) {
-	load("if Game.objects[...] then Object.delete(Game.objects[...]) end");
-	push<Lua::Number>(object->id);
+std::string Game::Game::saveSnapshot() {
+	Serializer output;
+	output.put(clock);
+	output.put(freeObjectId);
+	output.put(getInstructionBudget());
+
+	// The clients, in id order; messages from them may still be in the batches after the snapshot.
+	std::map<Client::IdType, const Client*> sortedClients;
+	for (ClientContainerType::const_iterator i = clients.begin(); i != clients.end(); ++i) {
+		sortedClients[i->first] = i->second.get();
+	}
+	output.put((unsigned int) sortedClients.size());
+	for (std::map<Client::IdType, const Client*>::const_iterator i = sortedClients.begin(); i != sortedClients.end(); ++i) {
+		output.put(i->first);
+		std::vector<Player::IdType> ids(i->second->players.begin(), i->second->players.end());
+		std::sort(ids.begin(), ids.end());
+		output.put((unsigned int) ids.size());
+		for (Player::IdType id: ids) {
+			output.put(id);
+		}
+	}
+
+	// The objects in slot order, so that they get the same slots when loaded.
+	std::map<const Task*, unsigned int> taskIndices;
+	std::vector<const Task*> usedTasks;
+	output.put((unsigned int) store.size());
+	output.put((unsigned int) store.getActiveCount());
+	for (ObjectStore::SlotType i = 0; i < store.size(); ++i) {
+		const Object& object = store.getObject(i);
+		output.put(object.id);
+		output.put(object.objectType->id);
+		output.put(object.owner->id);
+		output.put(object.getPosition());
+		output.put(object.getHeading());
+		output.put(object.hitPoints);
+		output.put(object.experience);
+
+		// Tasks are numbered from one in the order they are found.
+		unsigned int taskIndex = 0;
+		if (object.task) {
+			std::map<const Task*, unsigned int>::iterator found = taskIndices.find(object.task);
+			if (found == taskIndices.end()) {
+				usedTasks.push_back(object.task);
+				found = taskIndices.insert(std::make_pair(object.task, (unsigned int) usedTasks.size())).first;
+			}
+			taskIndex = found->second;
+		}
+		output.put(taskIndex);
+	}
+
+	output.put((unsigned int) usedTasks.size());
+	for (const Task* task: usedTasks) {
+		output.put(task->action ? task->action->id : std::string());
+		output.put(task->hasDestination);
+		output.put(task->destination);
+		output.put((bool) task->route);
+		output.put(task->route ? task->route->getStart() : Pathfinder::noTile);
+		saveObjectList(output, task->actors);
+		saveObjectList(output, task->targets);
+		output.put(task->targetHash);
+	}
+
+	callReference(saveStateFunction, 1);
+	popSerialized(output);
+	return output.getData();
+}
+
+void Game::Game::loadSnapshot(const std::string& snapshot) {
+	Deserializer input(snapshot);
+	input.get(clock);
+	input.get(freeObjectId);
+
+	// The budget decides where the callbacks stop, so it must be the same everywhere.
+	std::uint64_t instructionBudget;
+	input.get(instructionBudget);
+	setInstructionBudget(instructionBudget);
+
+	unsigned int count;
+	clients.clear();
+	input.get(count);
+	while (count--) {
+		std::shared_ptr<Client> client(new Client);
+		unsigned int playerCount;
+		input.get(client->id);
+		input.get(playerCount);
+		while (playerCount--) {
+			Player::IdType id;
+			input.get(id);
+			client->players.insert(id);
+		}
+		clients[client->id] = client;
+	}
+
+	messages.reset((MessageQueue::TickType) std::floor((clock / getStepLength()).getDouble() + 0.5) + 1);
+
+	// Remove the objects of the new game.
+	while (!objects.empty()) {
+		luaDeleteObject(objects.begin()->first);
+	}
+
+	std::vector<unsigned int> objectTasks;
+	unsigned int activeCount;
+	input.get(count);
+	input.get(activeCount);
+	if (activeCount > count) {
+		throw std::runtime_error("Invalid snapshot (bad active count)!");
+	}
+	while (count--) {
+		Object::IdType id;
+		ObjectType::IdType objectTypeId;
+		Player::IdType ownerId;
+		Vector2<SIUnit::Position> position;
+		Vector2<> heading;
+		int hitPoints, experience;
+		unsigned int taskIndex;
+		input.get(id);
+		input.get(objectTypeId);
+		input.get(ownerId);
+		input.get(position);
+		input.get(heading);
+		input.get(hitPoints);
+		input.get(experience);
+		input.get(taskIndex);
+
+		ObjectTypeContainerType::const_iterator objectType = objectTypes.find(objectTypeId);
+		PlayerContainerType::const_iterator owner = players.find(ownerId);
+		if (objectType == objectTypes.end() || owner == players.end() || objects.find(id) != objects.end()) {
+			throw std::runtime_error("Invalid snapshot (bad object)!");
+		}
+		std::shared_ptr<Object> tmp(std::allocate_shared<Object>(PoolAllocator<Object>(objectPool), position));
+		tmp->id = id;
+		tmp->objectType = objectType->second;
+		tmp->owner = owner->second;
+		tmp->heading = heading;
+		tmp->hitPoints = hitPoints;
+		tmp->experience = experience;
+		objects[id] = tmp;
+		store.insert(*tmp);
+		grid.insert(tmp);
+		objectTasks.push_back(taskIndex);
+	}
+
+	std::vector<Task*> loadedTasks;
+	input.get(count);
+	while (count--) {
+		Task& task = newTask();
+		loadedTasks.push_back(&task);
+		ObjectAction::IdType actionId;
+		input.get(actionId);
+		if (!actionId.empty()) {
+			ObjectActionContainerType::const_iterator action = objectActions.find(actionId);
+			if (action == objectActions.end()) {
+				throw std::runtime_error("Invalid snapshot (bad action)!");
+			}
+			task.action = action->second;
+		}
+		input.get(task.hasDestination);
+		input.get(task.destination);
+		bool hasRoute;
+		Pathfinder::TileType routeStart;
+		input.get(hasRoute);
+		input.get(routeStart);
+		loadObjectList(input, task.actors);
+		loadObjectList(input, task.targets);
+		input.get(task.targetHash);
+
+		// The routes only depend on the map, so they are planned again from the same tiles.
+		if (hasRoute && routeStart == Pathfinder::noTile) {
+			task.route = pathfinder.getFlowField(task.destination);
+		} else if (hasRoute) {
+			task.route = pathfinder.getPath(routeStart, pathfinder.getTile(task.destination));
+		}
+		listRoute(task);
+	}
+
+	// The objects were inserted into an empty store, so the slots follow the order in the snapshot.
+	for (ObjectStore::SlotType i = 0; i < objectTasks.size(); ++i) {
+		if (!objectTasks[i]) {
+			continue;
+		}
+		if (objectTasks[i] > loadedTasks.size() || i >= activeCount) {
+			throw std::runtime_error("Invalid snapshot (bad task)!");
+		}
+		Object& object = store.getObject(i);
+		object.task = loadedTasks[objectTasks[i] - 1];
+		++object.task->references;
+		store.rehash(i);
+	}
+
+	// The inserted objects are all active; the idle ones were last.
+	store.setActiveCount(activeCount);
+
+	pushReference(loadStateFunction);
+	pushSerialized(input);
 	call(1, 0);
+
+	// The hashes of the earlier steps are unknown.
+	firstHashedStep = getStep();
+	recordStateHash();
+}
+
+Scalar<SIUnit::Time> Game::Game::getSnapshotTime(const std::string& snapshot) {
+	Deserializer input(snapshot);
+	Scalar<SIUnit::Time> time;
+	input.get(time);
+	return time;
+}
+
+void Game::Game::saveObjectList(Serializer& output, const std::vector<ObjectStore::Handle>& handles) const {
+	std::vector<Object::IdType> ids;
+	for (ObjectStore::Handle handle: handles) {
+		const Object* object = store.resolve(handle);
+		if (object) {
+			ids.push_back(object->id);
+		}
+	}
+	output.put((unsigned int) ids.size());
+	for (Object::IdType id: ids) {
+		output.put(id);
+	}
+}
+
+void Game::Game::loadObjectList(Deserializer& input, std::vector<ObjectStore::Handle>& handles) const {
+	unsigned int count;
+	input.get(count);
+	while (count--) {
+		Object::IdType id;
+		input.get(id);
+		ObjectContainerType::const_iterator found = objects.find(id);
+		if (found != objects.end()) {
+			handles.push_back(found->second->handle);
+		}
+	}
+}
+
+void Game::Game::eraseObject(std::shared_ptr<Object> object) {
+	callReference(eraseObjectFunction, 0, Lua::Number(object->id));
 }
 
 void Game::Game::runStep(Scalar<SIUnit::Time> dt, MessageCallbackType messageCallback) {
 	clock += dt;
 	handleMessages(messageCallback);
+	refreshRoutes();
+
+	// Read phase: every object sees the others at their old positions,
+	// so the slots are independent and the result doesn't depend on
+	// how the work is split between threads.
+	forEachSlot(std::bind(&Game::updateTasks, this, std::placeholders::_1, std::placeholders::_2));
+	forEachSlot(std::bind(&ObjectStore::integrate, &store, dt, std::placeholders::_1, std::placeholders::_2));
+	store.buildBroadphase(Scalar<SIUnit::Length>(map->getSizeX()), Scalar<SIUnit::Length>(map->getSizeY()));
+	forEachSlot(std::bind(&ObjectStore::separate, &store, std::placeholders::_1, std::placeholders::_2));
+	forEachSlot(std::bind(&ObjectStore::applySeparation, &store, std::cref(pathfinder), std::placeholders::_1, std::placeholders::_2));
+
+	// Commit phase: shared structures are only touched here, in slot order.
+	const ObjectStore::SlotType n = store.getActiveCount();
+	for (ObjectStore::SlotType i = 0; i < n; ++i) {
+		Object& object = store.getObject(i);
+		if (store.isFinished(i)) {
+			releaseTask(*object.task);
+			object.task = 0;
+			store.rehash(i);
+		}
+		if (store.isOffRoute(i)) {
+			planPath(*object.task, object);
+		}
+		if (store.isMoving(i) || store.isPushed(i)) {
+			grid.update(object);
+			store.rehash(i);
+		}
+		if (store.hasTouchedIdle(i)) {
+			store.getIdleContacts(i, wakingObjects);
+		}
+		// An object without a task sleeps once nothing pushes it.
+		if (!object.task && !store.isPushed(i)) {
+			sleepingObjects.push_back(&object);
+		}
+	}
 
-	typedef std::vector<std::shared_ptr<Object> > ObjectVectorType;
-	ObjectVectorType tmp;
-	tmp.reserve(objects.size());
-	for (ObjectContainerType::iterator i = objects.begin(); i != objects.end(); ++i) {
-		tmp.push_back(i->second);
+	// Moving objects between the sets changes the slots, so it is done after the loop.
+	for (Object* object: sleepingObjects) {
+		store.deactivate(*object);
 	}
-	for (ObjectVectorType::iterator i = tmp.begin(); i != tmp.end(); ++i) {
-		Object& object = **i;
-		if (!object.runStep(dt, *this)) {
-			eraseObject(*i);
-		}
+	for (Object* object: wakingObjects) {
+		store.activate(*object);
+	}
+	sleepingObjects.clear();
+	wakingObjects.clear();
+	recordStateHash();
+}
+
+void Game::Game::recordStateHash() {
+	stateHashes[getStep() % stateHashHistory] = store.getHash();
+}
+
+bool Game::Game::getStateHash(MessageQueue::TickType step, std::uint64_t& hash) const {
+	if (step < firstHashedStep || step > getStep() || step + stateHashHistory <= getStep()) {
+		return false;
+	}
+	hash = stateHashes[step % stateHashHistory];
+	return true;
+}
+
+void Game::Game::getObjectHashes(ObjectHashContainerType& result) const {
+	result.clear();
+	result.reserve(store.size());
+	for (ObjectStore::SlotType i = 0; i < store.size(); ++i) {
+		result.push_back(std::make_pair(store.getObject(i).id, store.getHash(i)));
+	}
+}
+
+void Game::Game::forEachSlot(const JobSystem::RangeFunctionType& function) {
+	// Small chunks aren't worth the synchronization.
+	const ObjectStore::SlotType chunkSize = 256;
+	if (jobSystem && store.getActiveCount() > chunkSize) {
+		jobSystem->parallelFor(0, store.getActiveCount(), chunkSize, function);
+	} else {
+		function(0, store.getActiveCount());
+	}
+}
+
+void Game::Game::updateTasks(ObjectStore::SlotType begin, ObjectStore::SlotType end) {
+	for (ObjectStore::SlotType i = begin; i < end; ++i) {
+		store.getObject(i).updateTask();
 	}
 }
 
@@ -96,56 +431,72 @@ bool Game::Game::handleMessage(Message& message) {
 		return false;
 	}
 
-	std::shared_ptr<Client> client(clients[message.client]);
-	std::shared_ptr<Task> task(new Task);
-
-	// Create a dummy target for moving, if needed.
-	if (message.action == ObjectAction::MOVE && message.targets.empty()) {
-		task->dummy.reset(new Object(message.position));
-		task->targets.push_back(task->dummy);
-	}
+	const Client& client = *clients[message.client];
 
 	// Check the action.
+	std::shared_ptr<const ObjectAction> action;
 	if (objectActions.find(message.action) != objectActions.end()) {
-		task->action = objectActions[message.action];
+		action = objectActions[message.action];
 	}
-	if (!task->action && message.action != ObjectAction::MOVE && message.action != ObjectAction::DELETE) {
+	if (!action && message.action != ObjectAction::MOVE && message.action != ObjectAction::DELETE) {
 		return false;
 	}
 
+	Task& task = newTask();
+	task.action = action;
+
+	// Use the position as the destination for moving, if needed.
+	if (message.action == ObjectAction::MOVE && message.targets.empty()) {
+		task.hasDestination = true;
+		task.destination = message.position;
+	}
+
 	// Collect actors that exist and are allowed.
 	for (Object::IdType id: message.actors) {
-		if (objects.find(id) == objects.end()) {
+		ObjectContainerType::const_iterator found = objects.find(id);
+		if (found == objects.end()) {
 			continue;
 		}
-		std::shared_ptr<Object> object(objects[id]);
-		if (client->players.find(object->owner->id) == client->players.end()) {
+		Object& object = *found->second;
+		if (object.task == &task || client.players.find(object.owner->id) == client.players.end()) {
 			continue;
 		}
 		// Replace the current task with the new one.
-		if (object->task) {
-			for (std::list<std::weak_ptr<Object> >::iterator i = object->task->actors.begin(); i != object->task->actors.end(); ++i) {
-				if (i->lock() == object) {
-					object->task->actors.erase(i);
+		if (object.task) {
+			std::vector<ObjectStore::Handle>& actors = object.task->actors;
+			for (std::vector<ObjectStore::Handle>::iterator i = actors.begin(); i != actors.end(); ++i) {
+				if (i->index == object.handle.index && i->generation == object.handle.generation) {
+					*i = actors.back();
+					actors.pop_back();
 					break;
 				}
 			}
+			releaseTask(*object.task);
 		}
-		object->task = task;
-		task->actors.push_back(object);
+		object.task = &task;
+		++task.references;
+		task.actors.push_back(object.handle);
+		store.activate(object);
 	}
 
-	if (task->actors.empty()) {
+	if (task.actors.empty()) {
+		releaseTask(task);
 		return false;
 	}
 
 	// Collect targets.
 	for (Object::IdType id: message.targets) {
-		if (objects.find(id) == objects.end()) {
+		ObjectContainerType::const_iterator found = objects.find(id);
+		if (found == objects.end()) {
 			continue;
 		}
-		task->targets.push_back(objects[id]);
+		task.targets.push_back(found->second->handle);
 	}
+	task.targetHash = store.hashIds(task.targets);
+
+	// The task is part of the state of the actors.
+	rehashActors(task);
+	planRoute(task);
 
 	// Moving doesn't involve Lua.
 	if (message.action == ObjectAction::MOVE) {
@@ -153,29 +504,121 @@ bool Game::Game::handleMessage(Message& message) {
 	}
 
 	// Other actions are handled in Lua code.
-	load("Game.handleMessage(...)");
+	pushReference(handleMessageFunction);
 	push<Lua::String>(message.action);
-	for (std::weak_ptr<const Object> objectWeak: task->actors) {
-		std::shared_ptr<const Object> object(objectWeak.lock());
+	int nargs = 1;
+	for (ObjectStore::Handle handle: task.actors) {
+		const Object* object = store.resolve(handle);
 		if (object) {
 			push<Lua::Number>(object->id);
+			++nargs;
 		}
 	}
-	call(1 + task->actors.size(), 0);
+	startInstructionBudget();
+	try {
+		call(nargs, 0);
+	} catch (Lua::BudgetException&) {
+		// Only this callback is cut short, at the same instruction on every computer.
+	} catch (...) {
+		stopInstructionBudget();
+		throw;
+	}
+	stopInstructionBudget();
 
 	return true;
 }
 
+void Game::Game::planRoute(Task& task) {
+	task.route.reset();
+	if (!task.hasDestination) {
+		return;
+	}
+	if (task.references > 1) {
+		task.route = pathfinder.getFlowField(task.destination);
+		listRoute(task);
+		return;
+	}
+	for (ObjectStore::Handle handle: task.actors) {
+		const Object* object = store.resolve(handle);
+		if (object) {
+			planPath(task, *object);
+			return;
+		}
+	}
+}
+
+void Game::Game::planPath(Task& task, const Object& actor) {
+	task.route = pathfinder.getPath(pathfinder.getTile(actor.getPosition()), pathfinder.getTile(task.destination));
+	listRoute(task);
+}
+
+void Game::Game::listRoute(Task& task) {
+	if (task.route && !task.routeListed) {
+		routedTasks.push_back(&task);
+		task.routeListed = true;
+	}
+}
+
+void Game::Game::refreshRoutes() {
+	for (std::vector<Task*>::size_type i = 0; i < routedTasks.size();) {
+		Task& task = *routedTasks[i];
+		// Finished and reused tasks have lost their routes.
+		if (!task.route) {
+			task.routeListed = false;
+			routedTasks[i] = routedTasks.back();
+			routedTasks.pop_back();
+			continue;
+		}
+		if (!pathfinder.isCurrent(*task.route)) {
+			planRoute(task);
+		}
+		++i;
+	}
+}
+
+Game::Task& Game::Game::newTask() {
+	if (freeTasks.empty()) {
+		tasks.push_back(std::unique_ptr<Task>(new Task));
+		freeTasks.push_back(tasks.back().get());
+	}
+	Task& task = *freeTasks.back();
+	freeTasks.pop_back();
+	return task;
+}
+
+void Game::Game::rehashActors(const Task& task) {
+	for (ObjectStore::Handle handle: task.actors) {
+		const Object* object = store.resolve(handle);
+		if (object && object->task == &task) {
+			store.rehash(object->slot);
+		}
+	}
+}
+
+void Game::Game::releaseTask(Task& task) {
+	if (task.references > 1) {
+		--task.references;
+		return;
+	}
+	task.clear();
+	freeTasks.push_back(&task);
+}
+
 void Game::Game::handleMessages(MessageCallbackType messageCallback) {
-	while (!messages.empty() && messages.top().timestamp <= clock) {
-		Message message(messages.top());
-		messages.pop();
+	// Handling a message never inserts new ones, so the bucket stays valid.
+	MessageQueue::BucketType& bucket = messages.getCurrent();
+	unsigned int sequence = 0;
+	for (MessageQueue::BucketType::iterator i = bucket.begin(); i != bucket.end(); ++i) {
+		Message& message = *i;
 
+		// Restamp the message, so that the clients handle it at the same time and in the same order.
 		message.timestamp = clock;
+		message.sequence = sequence++;
 		if (handleMessage(message) && messageCallback) {
 			messageCallback(message);
 		}
 	}
+	messages.next();
 }
 
 void Game::Game::insertPlayer(std::shared_ptr<Player> player) {
@@ -191,43 +634,58 @@ void Game::Game::eraseClient(int id) {
 	clients.erase(id);
 }
 
-void Game::Game::luaNewObjectType() {
+void Game::Game::luaNewObjectType(const String& id, const String& name, Boolean immutable, Number radius, Number maxVelocity, Number lineOfSight, Number maxHitPoints) {
 	std::shared_ptr<ObjectType> tmp(new ObjectType);
-	tmp->id = get<String>(1);
-	tmp->name = get<String>(2);
-	tmp->immutable = get<Boolean>(3);
-	tmp->radius = get<Number>(4);
-	tmp->maxVelocity = get<Number>(5);
-	tmp->lineOfSight = get<Number>(6);
-	tmp->maxHitPoints = get<Number>(7);
+	tmp->id = id;
+	tmp->name = name;
+	tmp->immutable = immutable;
+	tmp->radius = radius;
+	tmp->maxVelocity = maxVelocity;
+	tmp->lineOfSight = lineOfSight;
+	tmp->maxHitPoints = maxHitPoints;
 	objectTypes[tmp->id] = tmp;
 }
 
-void Game::Game::luaNewObjectAction() {
+void Game::Game::luaNewObjectAction(const String& id, const String& name) {
 	std::shared_ptr<ObjectAction> tmp(new ObjectAction);
-	tmp->id = get<String>(1);
-	tmp->name = get<String>(2);
+	tmp->id = id;
+	tmp->name = name;
 	objectActions[tmp->id] = tmp;
 }
 
-void Game::Game::luaNewObject() {
+Lua::Number Game::Game::luaNewObject(const String& objectTypeId, Number playerId, Number x, Number y) {
 	if (freeObjectId <= 0) {
 		throw std::runtime_error("FIXME: freeObjectId has overflown!");
 	}
 
-	std::shared_ptr<Object> tmp(new Object(Vector2<SIUnit::Position>(get<Number>(3), get<Number>(4))));
-	tmp->objectType = objectTypes[get<String>(1)],
-	tmp->owner = players[get<Number>(2)],
+	std::shared_ptr<Object> tmp(std::allocate_shared<Object>(PoolAllocator<Object>(objectPool), Vector2<SIUnit::Position>(x, y)));
+	tmp->objectType = objectTypes[objectTypeId],
+	tmp->owner = players[playerId],
 	tmp->id = freeObjectId++;
 	objects[tmp->id] = tmp;
-	push<Number>(tmp->id);
+	store.insert(*tmp);
+	grid.insert(tmp);
+	return tmp->id;
 }
 
-void Game::Game::luaDeleteObject() {
-	Object::IdType id = get<Number>(1);
+void Game::Game::luaDeleteObject(Number objectId) {
+	Object::IdType id = objectId;
 	if (objects.find(id) == objects.end()) {
 		return;
 	}
 	objects[id]->dead = true;
+	if (objects[id]->task) {
+		releaseTask(*objects[id]->task);
+		objects[id]->task = 0;
+	}
+	grid.erase(objects[id]);
+	store.erase(*objects[id]);
 	objects.erase(id);
 }
+
+void Game::Game::luaWakeObject(Number objectId) {
+	ObjectContainerType::const_iterator found = objects.find(objectId);
+	if (found != objects.end()) {
+		store.activate(*found->second);
+	}
+}
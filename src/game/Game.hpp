@@ -1,14 +1,19 @@
 #ifndef PUTKARTS_Game_Game_HPP
 #define PUTKARTS_Game_Game_HPP
 
-#include <queue>
+#include <cstdint>
 #include <memory>
+#include <vector>
+#include <utility>
 #include <functional>
 #include <unordered_map>
 
 #include "util/Scalar.hpp"
+#include "util/JobSystem.hpp"
+#include "util/MemoryPool.hpp"
 #include "lua/Lua.hpp"
 #include "Message.hpp"
+#include "MessageQueue.hpp"
 #include "Task.hpp"
 #include "Map.hpp"
 #include "Client.hpp"
@@ -16,6 +21,9 @@
 #include "ObjectType.hpp"
 #include "ObjectAction.hpp"
 #include "Object.hpp"
+#include "ObjectGrid.hpp"
+#include "ObjectStore.hpp"
+#include "Pathfinder.hpp"
 
 namespace Game {
 	class Game;
@@ -47,12 +55,21 @@ public:
 	/** Type for specifying an external callback for message handling. */
 	typedef std::function<void(const Message&)> MessageCallbackType;
 
+	/** Type for specifying a callback for object queries. */
+	typedef ObjectGrid::CallbackType ObjectCallbackType;
+
+	/** Type for the state hashes of objects, by object id. */
+	typedef std::vector<std::pair<Object::IdType, std::uint64_t> > ObjectHashContainerType;
+
+	/** The number of steps whose state hashes are kept. */
+	static const MessageQueue::TickType stateHashHistory = 256;
+
 private:
 	/** Keep track of game time. */
 	Scalar<SIUnit::Time> clock;
 
-	/** Pending messages. */
-	std::priority_queue<Message> messages;
+	/** Pending messages by the step in which they are handled. */
+	MessageQueue messages;
 
 	/** The map on which the game is played. */
 	std::shared_ptr<Map> map;
@@ -72,11 +89,56 @@ private:
 	/** Next id to assign to an object. */
 	Object::IdType freeObjectId;
 
+	/** The state hashes of the latest steps, by step modulo stateHashHistory. */
+	std::vector<std::uint64_t> stateHashes;
+
+	/** The first step whose state hash is known. */
+	MessageQueue::TickType firstHashedStep;
+
 	/** Objects in the game */
 	ObjectContainerType objects;
 
-	/** A task for idle units. */
-	const std::shared_ptr<Task> idleTask;
+	/** Simulation state of the objects. */
+	ObjectStore store;
+
+	/** Spatial index of the objects. */
+	ObjectGrid grid;
+
+	/** Routes on the map. */
+	Pathfinder pathfinder;
+
+	/** Memory for the objects; the objects keep it alive. */
+	std::shared_ptr<MemoryPool> objectPool;
+
+	/** All tasks, in use or not. */
+	std::vector<std::unique_ptr<Task> > tasks;
+
+	/** Tasks that are not in use. */
+	std::vector<Task*> freeTasks;
+
+	/** Tasks that have got a route, so that checking the routes doesn't go through all tasks; the ones without a route are dropped there. */
+	std::vector<Task*> routedTasks;
+
+	/** Objects to move to the idle slots after a step; kept to reuse the memory. */
+	std::vector<Object*> sleepingObjects;
+
+	/** Idle objects to wake after a step; kept to reuse the memory. */
+	std::vector<Object*> wakingObjects;
+
+	/** Worker threads for the simulation; NULL to run everything in this thread. */
+	std::shared_ptr<JobSystem> jobSystem;
+
+	/** Compiled Lua code for eraseObject. */
+	Reference eraseObjectFunction;
+
+	/** Compiled Lua code for handling a message. */
+	Reference handleMessageFunction;
+
+	/** Compiled Lua code for getting the Lua state for a snapshot. */
+	Reference saveStateFunction;
+
+	/** Compiled Lua code for restoring the Lua state from a snapshot. */
+	Reference loadStateFunction;
 
 private:
 	/**
@@ -87,6 +149,96 @@ private:
 	 */
 	void runStep(Scalar<SIUnit::Time> dt, MessageCallbackType messageCallback);
 
+	/**
+	 * Run a function over the active object slots, in parallel if possible.
+	 *
+	 * Idle objects have no task and nothing pushing them, so a step has
+	 * nothing to do for them.
+	 *
+	 * @param function The function; it gets a range of slots [begin, end).
+	 */
+	void forEachSlot(const JobSystem::RangeFunctionType& function);
+
+	/**
+	 * Choose the targets for the objects in the given slots.
+	 *
+	 * @param begin The first slot.
+	 * @param end The slot after the last one.
+	 */
+	void updateTasks(ObjectStore::SlotType begin, ObjectStore::SlotType end);
+
+	/**
+	 * Plan the route of a task to its destination.
+	 *
+	 * A task with many actors gets a shared flow field, and a task with
+	 * one actor gets a path from the actor's current position.
+	 *
+	 * @param task The task.
+	 */
+	void planRoute(Task& task);
+
+	/**
+	 * Plan a path for a task from the position of one actor.
+	 *
+	 * @param task The task.
+	 * @param actor The actor.
+	 */
+	void planPath(Task& task, const Object& actor);
+
+	/**
+	 * Add a task to the routed tasks, if it has a route and isn't there yet.
+	 *
+	 * @param task The task.
+	 */
+	void listRoute(Task& task);
+
+	/**
+	 * Plan new routes for the tasks whose routes have become stale.
+	 */
+	void refreshRoutes();
+
+	/**
+	 * Get an unused task.
+	 *
+	 * @return The task, with no references.
+	 */
+	Task& newTask();
+
+	/**
+	 * Drop one reference to a task; a task without references is reused.
+	 *
+	 * @param task The task.
+	 */
+	void releaseTask(Task& task);
+
+	/**
+	 * Update the state hashes of the actors that still have a task.
+	 *
+	 * @param task The task.
+	 */
+	void rehashActors(const Task& task);
+
+	/**
+	 * Write the ids of the objects in a list; objects that have left the game are skipped.
+	 *
+	 * @param output The serializer.
+	 * @param handles The objects.
+	 */
+	void saveObjectList(Serializer& output, const std::vector<ObjectStore::Handle>& handles) const;
+
+	/**
+	 * Read a list written by saveObjectList.
+	 *
+	 * @param input The deserializer.
+	 * @param handles The handles of the objects are appended here.
+	 */
+	void loadObjectList(Deserializer& input, std::vector<ObjectStore::Handle>& handles) const;
+
+	/**
+	 * Store the state hash of the current step.
+	 */
+	void recordStateHash();
+
 	/**
 	 * Handle the messages up to the current game time.
 	 *
@@ -110,6 +262,60 @@ public:
 	 */
 	Game(std::shared_ptr<Map> map);
 
+	/**
+	 * Destructor.
+	 */
+	~Game();
+
+	/**
+	 * Set the worker threads used for the simulation.
+	 *
+	 * The results are identical with any number of threads.
+	 *
+	 * @param jobSystem_ The job system, or NULL to run in the calling thread.
+	 */
+	void setJobSystem(std::shared_ptr<JobSystem> jobSystem_) {
+		jobSystem = jobSystem_;
+	}
+
+	/**
+	 * Choose between the SIMD and the scalar movement code.
+	 *
+	 * The results are identical; the scalar code is the reference.
+	 *
+	 * @param vectorized Use SIMD instructions if available?
+	 */
+	void setVectorized(bool vectorized) {
+		store.setVectorized(vectorized);
+	}
+
+	/**
+	 * Profiling of the Lua code; see Lua.
+	 *
+	 * The labels are the object types whose callbacks are running.
+	 */
+	using Lua::setProfiling;
+	using Lua::writeProfile;
+
+	/**
+	 * Limit the Lua instructions of each message callback; see Lua.
+	 *
+	 * A callback that goes over the budget is stopped, and the game
+	 * goes on. The callback stops at the same point on every computer
+	 * only if they all use the same budget; snapshots include it.
+	 */
+	using Lua::setInstructionBudget;
+	using Lua::getInstructionBudget;
+
+	/**
+	 * Memory usage of the Lua code; see Lua.
+	 *
+	 * When the limit is reached, the game fails with an exception.
+	 */
+	using Lua::setMemoryLimit;
+	using Lua::getMemoryUsage;
+	using Lua::getPeakMemoryUsage;
+
 	/**
 	 * Get the current time.
 	 */
@@ -117,6 +323,47 @@ public:
 		return clock;
 	}
 
+	/**
+	 * Get the number of steps run since the start of the game.
+	 */
+	MessageQueue::TickType getStep() const {
+		return messages.getCurrentTick() - 1;
+	}
+
+	/**
+	 * Get the hash of the current state of the objects.
+	 *
+	 * The hash covers the positions, directions, hit points and tasks
+	 * of the objects, and it's updated incrementally as they change.
+	 * Games that have run identically have the same hash.
+	 */
+	std::uint64_t getStateHash() const {
+		return store.getHash();
+	}
+
+	/**
+	 * Get the state hash after one of the latest steps.
+	 *
+	 * @param step The step.
+	 * @param hash The hash is stored here.
+	 * @return false if the hash of the step isn't known any more, or yet.
+	 */
+	bool getStateHash(MessageQueue::TickType step, std::uint64_t& hash) const;
+
+	/**
+	 * Get the state hashes of the individual objects, for finding the cause of a desync.
+	 *
+	 * @param result The hashes are stored here, in no particular order.
+	 */
+	void getObjectHashes(ObjectHashContainerType& result) const;
+
+	/**
+	 * Get the length of one simulation step.
+	 */
+	static Scalar<SIUnit::Time> getStepLength() {
+		return 1.0 / 32;
+	}
+
 	/**
 	 * Get the map.
 	 */
@@ -131,6 +378,28 @@ public:
 		return objects;
 	}
 
+	/**
+	 * Call a function for each object that overlaps the given rectangle.
+	 *
+	 * @param min The minimum corner.
+	 * @param max The maximum corner.
+	 * @param callback The function to call.
+	 */
+	void forEachObject(const Vector2<SIUnit::Position>& min, const Vector2<SIUnit::Position>& max, const ObjectCallbackType& callback) const {
+		grid.forEachObject(min, max, callback);
+	}
+
+	/**
+	 * Call a function for each object within the given range of a position.
+	 *
+	 * @param position The position.
+	 * @param range The range; the object's radius is added to this.
+	 * @param callback The function to call.
+	 */
+	void forEachObject(const Vector2<SIUnit::Position>& position, Scalar<SIUnit::Length> range, const ObjectCallbackType& callback) const {
+		grid.forEachObject(position, range, callback);
+	}
+
 	/**
 	 * Get players.
 	 */
@@ -146,10 +415,47 @@ public:
 	 */
 	void runUntil(Scalar<SIUnit::Time> time, MessageCallbackType messageCallback = 0);
 
+	/**
+	 * Save the complete state of the game: the clock, the clients, the objects, their tasks and the Lua state.
+	 *
+	 * A new game on the same map with the same clients continues exactly
+	 * like this one after loadSnapshot. Messages that haven't been
+	 * handled yet are not included.
+	 *
+	 * @return The snapshot.
+	 * @throw Lua::Exception Thrown if the Lua state can't be serialized.
+	 */
+	std::string saveSnapshot();
+
+	/**
+	 * Replace the state of the game with a snapshot.
+	 *
+	 * The game should be new and on the same map as the snapshot. The
+	 * clients are replaced with plain clients from the snapshot.
+	 *
+	 * @param snapshot The snapshot from saveSnapshot.
+	 * @throw std::runtime_error Thrown if the snapshot is invalid.
+	 */
+	void loadSnapshot(const std::string& snapshot);
+
+	/**
+	 * Get the game time of a snapshot without loading it.
+	 *
+	 * @param snapshot The snapshot from saveSnapshot.
+	 * @return The time.
+	 */
+	static Scalar<SIUnit::Time> getSnapshotTime(const std::string& snapshot);
+
 	/**
 	 * Insert a message in the queue.
 	 *
+	 * The message is handled in the first step that ends at or after
+	 * its timestamp; messages in the same step are handled in order.
+	 * The queue keeps a bucket for every step up to the timestamp, so
+	 * timestamps from untrusted sources must be checked first.
+	 *
 	 * @param message The message.
+	 * @throw std::runtime_error Thrown if the timestamp is infinite or NaN.
 	 */
 	void insertMessage(const Message& message);
 
@@ -182,23 +488,38 @@ protected:
 
 	/**
 	 * Lua callback: Add an object type.
+	 *
+	 * f(string id, string name, bool immutable, float radius, float maxVelocity, float lineOfSight, float maxHitPoints)
 	 */
-	void luaNewObjectType();
+	void luaNewObjectType(const String& id, const String& name, Boolean immutable, Number radius, Number maxVelocity, Number lineOfSight, Number maxHitPoints);
 
 	/**
 	 * Lua callback: Add an object action.
+	 *
+	 * f(string id, string name)
 	 */
-	void luaNewObjectAction();
+	void luaNewObjectAction(const String& id, const String& name);
 
 	/**
 	 * Lua callback: Add an object.
+	 *
+	 * f(string objectType, int player, float x, float y) -> int id
 	 */
-	void luaNewObject();
+	Number luaNewObject(const String& objectTypeId, Number playerId, Number x, Number y);
 
 	/**
 	 * Lua callback: Delete an object.
+	 *
+	 * f(int id)
+	 */
+	void luaDeleteObject(Number objectId);
+
+	/**
+	 * Lua callback: Make an idle object active, so it is updated again.
+	 *
+	 * f(int id)
 	 */
-	void luaDeleteObject();
+	void luaWakeObject(Number objectId);
 };
 
 #endif
@@ -0,0 +1,33 @@
+#include "GamePool.hpp"
+#include "Game.hpp"
+
+Game::GamePool::GamePool(std::shared_ptr<Map> map_, std::size_t size_):
+	map(map_),
+	size(size_) {
+}
+
+std::shared_ptr<Game::Game> Game::GamePool::take() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!games.empty()) {
+			std::shared_ptr<Game> game(games.back());
+			games.pop_back();
+			return game;
+		}
+	}
+	return std::shared_ptr<Game>(new Game(map));
+}
+
+bool Game::GamePool::fill() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (games.size() >= size) {
+			return false;
+		}
+	}
+	// Set up the game without holding the lock.
+	std::shared_ptr<Game> game(new Game(map));
+	std::lock_guard<std::mutex> lock(mutex);
+	games.push_back(game);
+	return true;
+}
@@ -0,0 +1,67 @@
+#ifndef PUTKARTS_Game_GamePool_HPP
+#define PUTKARTS_Game_GamePool_HPP
+
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <boost/utility.hpp>
+
+namespace Game {
+	class Game;
+	class Map;
+	class GamePool;
+}
+
+/**
+ * A set of games that have been set up in advance.
+ *
+ * Setting up a game (creating the Lua state, running the scripts and
+ * creating the starting units) takes a while, so a host can do it
+ * while it's idle, and a new match can start from a ready game.
+ */
+class Game::GamePool: boost::noncopyable {
+	/** The map for the games. */
+	std::shared_ptr<Map> map;
+
+	/** The number of games to keep ready. */
+	std::size_t size;
+
+	/** Lock for the games. */
+	std::mutex mutex;
+
+	/** The ready games. */
+	std::vector<std::shared_ptr<Game> > games;
+
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param map_ The map for the games.
+	 * @param size_ The number of games to keep ready.
+	 */
+	GamePool(std::shared_ptr<Map> map_, std::size_t size_);
+
+	/**
+	 * Get the map.
+	 */
+	std::shared_ptr<Map> getMap() const {
+		return map;
+	}
+
+	/**
+	 * Take a ready game, or set up a new one if none is ready.
+	 *
+	 * @return The game.
+	 */
+	std::shared_ptr<Game> take();
+
+	/**
+	 * Set up one game if there are fewer than the wanted number ready.
+	 *
+	 * @return true if a game was set up, false if the pool was full.
+	 */
+	bool fill();
+};
+
+#endif
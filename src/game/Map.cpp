@@ -1,5 +1,5 @@
 #include <sstream>
-#include <functional>
+#include <cmath>
 
 #include "util/Path.hpp"
 #include "Game.hpp"
@@ -7,22 +7,20 @@
 #include "Object.hpp"
 
 Game::Map::Map() {
-	bind("tile", std::bind(&Map::luaSetTileInfo, this));
-	bind("row", std::bind(&Map::luaSetTileRow, this));
-	bind("player", std::bind(&Map::luaSetPlayer, this));
+	bind("tile", this, &Map::luaSetTileInfo);
+	bind("row", this, &Map::luaSetTileRow);
+	bind("player", this, &Map::luaSetPlayer);
 }
 
-void Game::Map::luaSetTileInfo() {
+void Game::Map::luaSetTileInfo(const String& tile, Boolean ground, Boolean water, const String& texture) {
 	TileInfo info;
-	char tile = get<String>(1).at(0);
-	info.ground = get<Boolean>(2);
-	info.water = get<Boolean>(3);
-	info.texture = get<String>(4);
-	tileInfoMap[tile] = info;
+	info.ground = ground;
+	info.water = water;
+	info.texture = texture;
+	tileInfoMap[tile.at(0)] = info;
 }
 
-void Game::Map::luaSetTileRow() {
-	std::string row(get<String>(1));
+void Game::Map::luaSetTileRow(const String& row) {
 	if (tileMap.empty()) {
 		tileMap.resize(row.size(), 1);
 	} else {
@@ -40,11 +38,10 @@ void Game::Map::luaSetTileRow() {
 	}
 }
 
-void Game::Map::luaSetPlayer() {
+void Game::Map::luaSetPlayer(Integer which, Number x, Number y) {
 	Player tmp;
-	int which = get<Integer>(1);
-	tmp.startPosition.x = get<Number>(2);
-	tmp.startPosition.y = get<Number>(3);
+	tmp.startPosition.x = x;
+	tmp.startPosition.y = y;
 	players[which] = tmp;
 }
 
@@ -62,3 +59,32 @@ try {
 	tileInfoMap.clear();
 	throw;
 }
+
+void Game::Map::generate(SizeType sizeX, SizeType sizeY, int playerCount)
+try {
+	directory = "maps/generated";
+	directories.clear();
+	tileMap.clear();
+	tileInfoMap.clear();
+	players.clear();
+	runFile<void>(Path::findDataPath("tiles/test.lua"));
+
+	tileMap.resize(sizeX, sizeY, 'G');
+	for (SizeType x = 0; x < sizeX; ++x) {
+		tileMap(x, 0) = tileMap(x, sizeY - 1) = 'W';
+	}
+	for (SizeType y = 0; y < sizeY; ++y) {
+		tileMap(0, y) = tileMap(sizeX - 1, y) = 'W';
+	}
+
+	const double pi = 3.14159265358979323846;
+	for (int i = 0; i < playerCount; ++i) {
+		const double angle = 2 * pi * i / playerCount;
+		luaSetPlayer(i + 1, sizeX * (0.5 + 0.35 * std::cos(angle)), sizeY * (0.5 + 0.35 * std::sin(angle)));
+	}
+} catch (...) {
+	directory.clear();
+	tileMap.clear();
+	tileInfoMap.clear();
+	throw;
+}
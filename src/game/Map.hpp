@@ -84,6 +84,19 @@ public:
 	 */
 	void load(const std::string& directory);
 
+	/**
+	 * Generate a flat map, for testing and benchmarks.
+	 *
+	 * The map is ground with a border of water, and the players start
+	 * evenly around an ellipse. The tiles are from the test tile set.
+	 *
+	 * @param sizeX The width in tiles, at least 3.
+	 * @param sizeY The height in tiles, at least 3.
+	 * @param playerCount The number of players.
+	 * @throw std::runtime_error Thrown if the tiles can't be loaded.
+	 */
+	void generate(SizeType sizeX, SizeType sizeY, int playerCount);
+
 	/**
 	 * Get the map directory; necessary for loading tiles, for example.
 	 */
@@ -132,21 +145,21 @@ private:
 	 *
 	 * f(string char, bool ground, bool water, string texture)
 	 */
-	void luaSetTileInfo();
+	void luaSetTileInfo(const String& tile, Boolean ground, Boolean water, const String& texture);
 
 	/**
 	 * Lua callback: Set tiles.
 	 *
-	 * f(int x0, int y0, string tiles)
+	 * f(string tiles)
 	 */
-	void luaSetTileRow();
+	void luaSetTileRow(const String& row);
 
 	/**
 	 * Lua callback: Set player.
 	 *
 	 * f(int which, float startX, float startY)
 	 */
-	void luaSetPlayer();
+	void luaSetPlayer(Integer which, Number x, Number y);
 };
 
 #endif
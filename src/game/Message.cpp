@@ -4,32 +4,47 @@
 
 Game::Message::Message(const std::string& data) {
 	Deserializer input(data);
+	*this = Message(input);
+}
+
+Game::Message::Message(Deserializer& input) {
 	input.get(client);
+	input.get(sequence);
 	input.get(timestamp);
 	input.get(action);
 	input.get(position);
+	unsigned int n;
 	Object::IdType id;
-	while (input.get(id), id != 0) {
+	input.get(n);
+	while (n--) {
+		input.get(id);
 		actors.push_back(id);
 	}
-	while (input.get(id), id != 0) {
+	input.get(n);
+	while (n--) {
+		input.get(id);
 		targets.push_back(id);
 	}
 }
 
 std::string Game::Message::serialize() const {
 	Serializer output;
+	serialize(output);
+	return output.getData();
+}
+
+void Game::Message::serialize(Serializer& output) const {
 	output.put(client);
+	output.put(sequence);
 	output.put(timestamp);
 	output.put(action);
 	output.put(position);
-	for (std::list<Object::IdType>::const_iterator i = actors.begin(); i != actors.end(); ++i) {
+	output.put((unsigned int) actors.size());
+	for (ObjectListType::const_iterator i = actors.begin(); i != actors.end(); ++i) {
 		output.put(*i);
 	}
-	output.put(Object::IdType(0));
-	for (std::list<Object::IdType>::const_iterator i = targets.begin(); i != targets.end(); ++i) {
+	output.put((unsigned int) targets.size());
+	for (ObjectListType::const_iterator i = targets.begin(); i != targets.end(); ++i) {
 		output.put(*i);
 	}
-	output.put(Object::IdType(0));
-	return output.getData();
 }
@@ -1,15 +1,19 @@
 #ifndef PUTKARTS_Game_Message_HPP
 #define PUTKARTS_Game_Message_HPP
 
-#include <list>
+#include <string>
 
 #include "util/Scalar.hpp"
 #include "util/Vector2.hpp"
+#include "util/SmallVector.hpp"
 
 #include "Client.hpp"
 #include "Object.hpp"
 #include "ObjectAction.hpp"
 
+class Serializer;
+class Deserializer;
+
 namespace Game {
 	class Message;
 }
@@ -19,9 +23,15 @@ namespace Game {
  */
 class Game::Message {
 public:
+	/** Type for lists of objects; small lists don't allocate memory. */
+	typedef SmallVector<Object::IdType, 16> ObjectListType;
+
 	/** The client who sent this message. */
 	Client::IdType client;
 
+	/** The order of the message among messages with the same timestamp; set by the server. */
+	unsigned int sequence;
+
 	/** The timestamp for handling the message. */
 	Scalar<SIUnit::Time> timestamp;
 
@@ -32,16 +42,17 @@ public:
 	Vector2<SIUnit::Position> position;
 
 	/** The actor objects. */
-	std::list<Object::IdType> actors;
+	ObjectListType actors;
 
 	/** The target objects. */
-	std::list<Object::IdType> targets;
+	ObjectListType targets;
 
 	/**
 	 * Default constructor.
 	 */
-	Message() {
-		// Nothing here.
+	Message():
+		client(0),
+		sequence(0) {
 	}
 
 	/**
@@ -51,6 +62,13 @@ public:
 	 */
 	Message(const std::string& data);
 
+	/**
+	 * Constructor that reads a message from a deserializer.
+	 *
+	 * @param input The deserializer.
+	 */
+	Message(Deserializer& input);
+
 	/**
 	 * Serialize the message for sending it over the network.
 	 *
@@ -59,46 +77,26 @@ public:
 	std::string serialize() const;
 
 	/**
-	 * Compare this message to another. The greatest message is the one
-	 * with greatest priority (i.e. the smallest timestamp).
+	 * Write the message to a serializer.
+	 *
+	 * @param output The serializer.
+	 */
+	void serialize(Serializer& output) const;
+
+	/**
+	 * Compare the handling order of this message to another.
+	 *
+	 * Messages are handled in the order of their timestamps, and messages
+	 * with the same timestamp in the order of their sequence numbers.
 	 *
 	 * @param m2 The other message
-	 * @return true if this message is less important than the other.
+	 * @return true if this message should be handled before the other.
 	 */
 	bool operator < (const Message& m2) const {
-		const Message& m1 = *this;
-		if (m1.timestamp != m2.timestamp) {
-			return m1.timestamp > m2.timestamp;
-		}
-		if (m1.client != m2.client) {
-			return m1.client < m2.client;
-		}
-		if (m1.action != m1.action) {
-			return m1.action < m2.action;
-		}
-		if (m1.position.x != m2.position.x) {
-			return m1.position.x < m2.position.x;
-		}
-		if (m1.position.y != m2.position.y) {
-			return m1.position.y < m2.position.y;
-		}
-		if (m1.actors.size() != m2.actors.size()) {
-			return m1.actors.size() < m2.actors.size();
-		}
-		for (std::list<Object::IdType>::const_iterator i = m1.actors.begin(), j = m2.actors.begin(); i != m1.actors.end(); ++i, ++j) {
-			if (*i != *j) {
-				return *i < *j;
-			}
-		}
-		if (m1.targets.size() != m2.targets.size()) {
-			return m1.targets.size() < m2.targets.size();
-		}
-		for (std::list<Object::IdType>::const_iterator i = m1.targets.begin(), j = m2.targets.begin(); i != m1.targets.end(); ++i, ++j) {
-			if (*i != *j) {
-				return *i < *j;
-			}
+		if (timestamp != m2.timestamp) {
+			return timestamp < m2.timestamp;
 		}
-		return m1.serialize() < m2.serialize();
+		return sequence < m2.sequence;
 	}
 };
 
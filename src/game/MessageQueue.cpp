@@ -0,0 +1,57 @@
+#include <algorithm>
+
+#include "MessageQueue.hpp"
+
+Game::MessageQueue::MessageQueue(TickType current_):
+	buckets(64),
+	head(0),
+	current(current_),
+	count(0) {
+}
+
+void Game::MessageQueue::grow(TickType tick) {
+	const std::size_t oldSize = buckets.size();
+	if (tick - current < oldSize) {
+		return;
+	}
+	std::size_t newSize = oldSize;
+	while (tick - current >= newSize) {
+		newSize *= 2;
+	}
+
+	// Unroll the ring so that the current step is first.
+	std::rotate(buckets.begin(), buckets.begin() + head, buckets.end());
+	head = 0;
+	buckets.resize(newSize);
+}
+
+void Game::MessageQueue::push(TickType tick, const Message& message) {
+	tick = std::max(tick, current);
+	grow(tick);
+	const std::size_t index = getIndex(tick);
+	BucketType& bucket = buckets[index];
+
+	// The messages arrive nearly in order, so the place is found near the end.
+	BucketType::iterator position = bucket.end();
+	while (position != bucket.begin() && message < *(position - 1)) {
+		--position;
+	}
+	bucket.insert(position, message);
+	++count;
+}
+
+void Game::MessageQueue::next() {
+	count -= buckets[head].size();
+	buckets[head].clear();
+	head = (head + 1) % buckets.size();
+	++current;
+}
+
+void Game::MessageQueue::reset(TickType current_) {
+	for (std::vector<BucketType>::iterator i = buckets.begin(); i != buckets.end(); ++i) {
+		i->clear();
+	}
+	head = 0;
+	current = current_;
+	count = 0;
+}
@@ -0,0 +1,119 @@
+#ifndef PUTKARTS_Game_MessageQueue_HPP
+#define PUTKARTS_Game_MessageQueue_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Message.hpp"
+
+namespace Game {
+	class MessageQueue;
+}
+
+/**
+ * Queue of messages, with one bucket per simulation step.
+ *
+ * The buckets form a ring starting from the current step, and they keep
+ * their memory when they are emptied, so in the long run adding and
+ * taking messages doesn't allocate. Each bucket is kept in the order
+ * of the sequence numbers as the messages are added, so taking them
+ * needs no sorting.
+ */
+class Game::MessageQueue {
+public:
+	/** Type for step numbers. */
+	typedef std::uint64_t TickType;
+
+	/** Type for the messages of one step. */
+	typedef std::vector<Message> BucketType;
+
+private:
+	/** The buckets. */
+	std::vector<BucketType> buckets;
+
+	/** The index of the bucket of the current step. */
+	std::size_t head;
+
+	/** The current step. */
+	TickType current;
+
+	/** The number of messages. */
+	std::size_t count;
+
+	/**
+	 * Get the index of the bucket of a step.
+	 *
+	 * @param tick The step, not earlier than the current one.
+	 */
+	std::size_t getIndex(TickType tick) const {
+		return (head + (tick - current)) % buckets.size();
+	}
+
+	/**
+	 * Make room for the messages of a step.
+	 *
+	 * @param tick The step, not earlier than the current one.
+	 */
+	void grow(TickType tick);
+
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param current_ The first step.
+	 */
+	MessageQueue(TickType current_ = 0);
+
+	/**
+	 * Get the current step.
+	 */
+	TickType getCurrentTick() const {
+		return current;
+	}
+
+	/**
+	 * Get the number of messages.
+	 */
+	std::size_t size() const {
+		return count;
+	}
+
+	/**
+	 * Is the queue empty?
+	 */
+	bool empty() const {
+		return !count;
+	}
+
+	/**
+	 * Add a message.
+	 *
+	 * @param tick The step for handling the message; earlier steps mean the current step.
+	 * @param message The message.
+	 */
+	void push(TickType tick, const Message& message);
+
+	/**
+	 * Get the messages of the current step, in order.
+	 *
+	 * @return The messages; valid until the next call to push or next.
+	 */
+	BucketType& getCurrent() {
+		return buckets[head];
+	}
+
+	/**
+	 * Drop the messages of the current step and move to the next step.
+	 */
+	void next();
+
+	/**
+	 * Remove all messages and start again from a step.
+	 *
+	 * @param current_ The new current step.
+	 */
+	void reset(TickType current_);
+};
+
+#endif
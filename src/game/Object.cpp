@@ -6,10 +6,17 @@
 Game::Object::Object(const Vector2<SIUnit::Position>& position_):
 	id(0),
 	dead(false),
+	store(0),
+	slot(0),
+	handle(),
 	position(position_),
-	direction(0),
+	heading(Scalar<>(1), Scalar<>(0)),
+	task(0),
 	hitPoints(0),
-	experience(0) {
+	experience(0),
+	inGrid(false),
+	gridX(0),
+	gridY(0) {
 }
 
 void Game::Object::setHitPoints(int hitPoints_) {
@@ -19,6 +26,9 @@ void Game::Object::setHitPoints(int hitPoints_) {
 	} else if (hitPoints < 0) {
 		hitPoints = 0;
 	}
+	if (store) {
+		store->rehash(slot);
+	}
 }
 
 void Game::Object::setExperience(int experience_) {
@@ -28,41 +38,53 @@ void Game::Object::setExperience(int experience_) {
 	}
 }
 
-bool Game::Object::runStep(Scalar<SIUnit::Time> dt, Game& game) {
-	if (dead) {
-		return false;
-	}
+void Game::Object::updateTask() {
+	store->moving[slot] = false;
+	store->finished[slot] = false;
+	store->offRoute[slot] = false;
 	if (!task) {
-		return true;
+		return;
 	}
 
 	// Find the closest target.
-	std::shared_ptr<Object> target;
-	for (std::weak_ptr<Object> objectWeak: task->targets) {
-		std::shared_ptr<Object> object(objectWeak.lock());
+	const Vector2<SIUnit::Position> position = getPosition();
+	bool found = task->hasDestination;
+	Vector2<SIUnit::Position> target = task->destination;
+	for (ObjectStore::Handle handle: task->targets) {
+		const Object* object = store->resolve(handle);
 		if (!object || object->dead) {
 			continue;
 		}
-		if (!target || (position - object->position).pow2() < (position - target->position).pow2()) {
-			target = object;
+		Vector2<SIUnit::Position> objectPosition = object->getPosition();
+		if (!found || (position - objectPosition).pow2() < (position - target).pow2()) {
+			target = objectPosition;
+			found = true;
 		}
 	}
 
-	// If no target is found, the task is finished.
-	if (!target) {
-		task.reset();
-		return true;
+	// If no target is found, or the object has arrived, the task is finished.
+	// A group can't all stand on the destination, so the objects arrive
+	// anywhere in a circle that has room for the whole group; otherwise
+	// they would keep pushing each other off the point.
+	const Scalar<SIUnit::Area> arrival = store->radii[slot] * store->radii[slot] * Scalar<>((double) task->actors.size());
+	if (!found || (task->hasDestination && target == task->destination && (task->destination - position).pow2() <= arrival)) {
+		store->finished[slot] = true;
+		return;
 	}
 
-	// TODO: Handle whatever the object is doing.
-	// TODO: Check collisions before moving!
-	if (position != target->position) {
-		Vector2<SIUnit::Position> old = position;
-		direction = (target->position - position).toAngle();
-		position += Vector2<>::fromAngle(direction) * objectType->maxVelocity * dt;
-		if ((target->position - old).dot(target->position - position).isNegative()) {
-			position = target->position;
+	// Follow the route around obstacles; never go straight, as that may cross unwalkable tiles.
+	if (task->hasDestination && target == task->destination && (!task->route || !task->route->getWaypoint(position, task->destination, target))) {
+		if (task->route && task->route->getStart() != Pathfinder::noTile) {
+			// Pushed off a path: Game plans a new one from here, and the object waits for it.
+			store->offRoute[slot] = true;
+		} else {
+			// There's no way from here to the destination.
+			store->finished[slot] = true;
 		}
+		return;
 	}
-	return true;
+
+	// TODO: Handle whatever the object is doing.
+	store->targets[slot] = target;
+	store->moving[slot] = (position != target);
 }
@@ -5,6 +5,7 @@
 
 #include "util/Vector2.hpp"
 #include "ObjectType.hpp"
+#include "ObjectStore.hpp"
 #include "Player.hpp"
 
 namespace Game {
@@ -13,15 +14,21 @@ namespace Game {
 	class Task;
 	class Object;
 	class ObjectAction;
+	class ObjectGrid;
 }
 
 /**
  * This class describes world object.
+ *
+ * While the object is in the game, its position and direction live in
+ * an ObjectStore, and the object itself is only a handle to its slot.
  */
 class Game::Object {
 public:
 	friend class Game;
 	friend class ObjectAction;
+	friend class ObjectGrid;
+	friend class ObjectStore;
 	typedef unsigned int IdType;
 
 	/** Id of the object. */
@@ -37,14 +44,23 @@ private:
 	/** Set if the object is dead (i.e. ready to be removed from the game). */
 	bool dead;
 
-	/** Object's position. */
+	/** The store holding the object's state, or NULL if the object is not in the game. */
+	ObjectStore* store;
+
+	/** The object's slot in the store. */
+	ObjectStore::SlotType slot;
+
+	/** The object's handle in the store. */
+	ObjectStore::Handle handle;
+
+	/** Object's position, when not in a store. */
 	Vector2<SIUnit::Position> position;
 
-	/** Direction the object is looking. */
-	Scalar<SIUnit::Angle> direction;
+	/** Direction the object is looking as a unit vector, when not in a store. */
+	Vector2<> heading;
 
-	/** The current task of the object. */
-	std::shared_ptr<Task> task;
+	/** The current task of the object, or NULL; the tasks belong to Game. */
+	Task* task;
 
 	/** Object's hit points. */
 	int hitPoints;
@@ -52,6 +68,12 @@ private:
 	/** Object's experience. */
 	int experience;
 
+	/** Is the object stored in an ObjectGrid? */
+	bool inGrid;
+
+	/** The grid cell containing the object; maintained by ObjectGrid. */
+	std::size_t gridX, gridY;
+
 public:
 	/**
 	 * Constructor.
@@ -75,7 +97,7 @@ public:
 	 * @return Position of the object.
 	 */
 	Vector2<SIUnit::Position> getPosition() const {
-		return position;
+		return store ? store->positions[slot] : position;
 	}
 
 	/**
@@ -84,7 +106,16 @@ public:
 	 * @return Direction of the object.
 	 */
 	Scalar<SIUnit::Angle> getDirection() const {
-		return direction;
+		return getHeading().toAngle();
+	}
+
+	/**
+	 * Return the direction the object is looking as a unit vector.
+	 *
+	 * @return Direction of the object.
+	 */
+	Vector2<> getHeading() const {
+		return store ? store->headings[slot] : heading;
 	}
 
 	/**
@@ -113,7 +144,7 @@ public:
 	 * @return True if object is within the given range of the given point.
 	 */
 	bool isNear(const Vector2<SIUnit::Position> &pos, const Scalar<SIUnit::Length> &range = Scalar<SIUnit::Length>(0)) const {
-		return (position - pos).pow2() < (objectType->radius + range).pow2();
+		return (getPosition() - pos).pow2() < (objectType->radius + range).pow2();
 	}
 
 	/**
@@ -125,14 +156,19 @@ public:
 		return owner;
 	}
 
+private:
 	/**
-	 * Move the unit one step in time.
+	 * Choose the position to move towards during this step.
 	 *
-	 * @param dt The time step size.
-	 * @param game The game
-	 * @return true if the object is still alive after the step.
+	 * The result is stored in the object's slot. If the task has no
+	 * targets left, or the object has arrived near the task's destination
+	 * (within a circle that grows with the group), the task is marked
+	 * finished, and Game removes it later.
+	 * This only reads other objects, so it's safe to call in parallel
+	 * for different objects.
 	 */
-	bool runStep(Scalar<SIUnit::Time> dt, Game& game);
+	void updateTask();
+
 protected:
 	/**
 	 * Set object's position.
@@ -140,7 +176,20 @@ protected:
 	 * @param position_ Position to set.
 	 */
 	void setPosition(const Vector2<SIUnit::Position>& position_) {
-		position = position_;
+		if (store) {
+			// An idle object is kept in the broadphase cells of its position.
+			const bool idle = !store->isActive(slot);
+			if (idle) {
+				store->eraseIdle(slot);
+			}
+			store->positions[slot] = position_;
+			if (idle) {
+				store->insertIdle(slot);
+			}
+			store->rehash(slot);
+		} else {
+			position = position_;
+		}
 	}
 
 	/**
@@ -149,7 +198,12 @@ protected:
 	 * @param direction_ Direction to set.
 	 */
 	void setDirection(const Scalar<SIUnit::Angle>& direction_) {
-		direction = direction_;
+		if (store) {
+			store->headings[slot] = Vector2<>::fromAngle(direction_);
+			store->rehash(slot);
+		} else {
+			heading = Vector2<>::fromAngle(direction_);
+		}
 	}
 
 	/**
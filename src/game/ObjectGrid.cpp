@@ -0,0 +1,115 @@
+#include <cmath>
+#include <algorithm>
+
+#include "ObjectGrid.hpp"
+#include "Object.hpp"
+
+Game::ObjectGrid::ObjectGrid(Scalar<SIUnit::Length> sizeX, Scalar<SIUnit::Length> sizeY, Scalar<SIUnit::Length> cellSize_):
+	cellSize(cellSize_),
+	cells(
+		std::max<SizeType>(1, std::ceil((sizeX / cellSize).getDouble())),
+		std::max<SizeType>(1, std::ceil((sizeY / cellSize).getDouble()))
+	) {
+}
+
+void Game::ObjectGrid::getCell(const Vector2<SIUnit::Position>& position, SizeType& x, SizeType& y) const {
+	double fx = std::floor((position.x / cellSize).getDouble());
+	double fy = std::floor((position.y / cellSize).getDouble());
+	x = fx < 0 ? 0 : std::min<SizeType>(fx, cells.getSizeX() - 1);
+	y = fy < 0 ? 0 : std::min<SizeType>(fy, cells.getSizeY() - 1);
+}
+
+void Game::ObjectGrid::getCellRange(const Vector2<SIUnit::Position>& min, const Vector2<SIUnit::Position>& max, SizeType& x0, SizeType& y0, SizeType& x1, SizeType& y1) const {
+	// Objects are stored by their center, so widen the area by the largest radius.
+	Vector2<SIUnit::Position> margin(maxRadius, maxRadius);
+	getCell(min - margin, x0, y0);
+	getCell(max + margin, x1, y1);
+}
+
+std::shared_ptr<Game::Object> Game::ObjectGrid::eraseFromCell(Object& object) {
+	std::shared_ptr<Object> result;
+	CellType& cell = cells(object.gridX, object.gridY);
+	for (CellType::iterator i = cell.begin(); i != cell.end(); ++i) {
+		if (i->get() == &object) {
+			// The order within a cell doesn't matter; swap with the last one.
+			result.swap(*i);
+			std::swap(*i, cell.back());
+			cell.pop_back();
+			break;
+		}
+	}
+	object.inGrid = false;
+	return result;
+}
+
+void Game::ObjectGrid::insert(const std::shared_ptr<Object>& object) {
+	if (object->inGrid) {
+		return update(*object);
+	}
+	getCell(object->getPosition(), object->gridX, object->gridY);
+	cells(object->gridX, object->gridY).push_back(object);
+	object->inGrid = true;
+	if (object->objectType && object->objectType->radius > maxRadius) {
+		maxRadius = object->objectType->radius;
+	}
+}
+
+void Game::ObjectGrid::erase(const std::shared_ptr<Object>& object) {
+	if (object->inGrid) {
+		eraseFromCell(*object);
+	}
+}
+
+void Game::ObjectGrid::update(Object& object) {
+	if (!object.inGrid) {
+		return;
+	}
+	SizeType x, y;
+	getCell(object.getPosition(), x, y);
+	if (x == object.gridX && y == object.gridY) {
+		return;
+	}
+	std::shared_ptr<Object> tmp(eraseFromCell(object));
+	object.gridX = x;
+	object.gridY = y;
+	cells(x, y).push_back(std::move(tmp));
+	object.inGrid = true;
+}
+
+void Game::ObjectGrid::forEachObject(const Vector2<SIUnit::Position>& min, const Vector2<SIUnit::Position>& max, const CallbackType& callback) const {
+	SizeType x0, y0, x1, y1;
+	getCellRange(min, max, x0, y0, x1, y1);
+	for (SizeType y = y0; y <= y1; ++y) {
+		for (SizeType x = x0; x <= x1; ++x) {
+			const CellType& cell = cells(x, y);
+			for (CellType::const_iterator i = cell.begin(); i != cell.end(); ++i) {
+				const Object& object = **i;
+
+				// Find the point of the rectangle closest to the object.
+				const Vector2<SIUnit::Position> position = object.getPosition();
+				Vector2<SIUnit::Position> closest(position);
+				closest.x = std::min(std::max(closest.x, min.x), max.x);
+				closest.y = std::min(std::max(closest.y, min.y), max.y);
+				if ((closest - position).pow2() <= object.objectType->radius.pow2()) {
+					callback(*i);
+				}
+			}
+		}
+	}
+}
+
+void Game::ObjectGrid::forEachObject(const Vector2<SIUnit::Position>& position, Scalar<SIUnit::Length> range, const CallbackType& callback) const {
+	Vector2<SIUnit::Position> extent(range, range);
+	SizeType x0, y0, x1, y1;
+	getCellRange(position - extent, position + extent, x0, y0, x1, y1);
+	for (SizeType y = y0; y <= y1; ++y) {
+		for (SizeType x = x0; x <= x1; ++x) {
+			const CellType& cell = cells(x, y);
+			for (CellType::const_iterator i = cell.begin(); i != cell.end(); ++i) {
+				if ((*i)->isNear(position, range)) {
+					callback(*i);
+				}
+			}
+		}
+	}
+}
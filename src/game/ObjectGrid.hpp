@@ -0,0 +1,125 @@
+#ifndef PUTKARTS_Game_ObjectGrid_HPP
+#define PUTKARTS_Game_ObjectGrid_HPP
+
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include "util/Array2D.hpp"
+#include "util/Scalar.hpp"
+#include "util/Vector2.hpp"
+
+namespace Game {
+	class Object;
+	class ObjectGrid;
+}
+
+/**
+ * Uniform grid for finding objects near a point.
+ *
+ * Each object is stored in the cell that contains its position. Queries
+ * widen the searched area by the largest object radius seen so far, so
+ * objects that merely overlap the area are also found.
+ */
+class Game::ObjectGrid {
+public:
+	/** Type for cell coordinates. */
+	typedef std::size_t SizeType;
+
+	/** Type for the query callbacks. */
+	typedef std::function<void(const std::shared_ptr<Object>&)> CallbackType;
+
+private:
+	/** Type for the contents of one cell. */
+	typedef std::vector<std::shared_ptr<Object> > CellType;
+
+	/** The size of one cell. */
+	const Scalar<SIUnit::Length> cellSize;
+
+	/** The cells. */
+	Array2D<CellType> cells;
+
+	/** The largest object radius in the grid. */
+	Scalar<SIUnit::Length> maxRadius;
+
+	/**
+	 * Get the cell coordinates for a position, clamped to the grid.
+	 *
+	 * @param position The position.
+	 * @param x The x coordinate is stored here.
+	 * @param y The y coordinate is stored here.
+	 */
+	void getCell(const Vector2<SIUnit::Position>& position, SizeType& x, SizeType& y) const;
+
+	/**
+	 * Get the range of cells that may contain objects overlapping the given rectangle.
+	 *
+	 * @param min The minimum corner.
+	 * @param max The maximum corner.
+	 * @param x0 The first x coordinate is stored here.
+	 * @param y0 The first y coordinate is stored here.
+	 * @param x1 The last x coordinate is stored here.
+	 * @param y1 The last y coordinate is stored here.
+	 */
+	void getCellRange(const Vector2<SIUnit::Position>& min, const Vector2<SIUnit::Position>& max, SizeType& x0, SizeType& y0, SizeType& x1, SizeType& y1) const;
+
+	/**
+	 * Remove an object from its current cell.
+	 *
+	 * @param object The object.
+	 * @return The pointer that was stored in the cell.
+	 */
+	std::shared_ptr<Object> eraseFromCell(Object& object);
+
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param sizeX The width of the covered area.
+	 * @param sizeY The height of the covered area.
+	 * @param cellSize The size of one cell.
+	 */
+	ObjectGrid(Scalar<SIUnit::Length> sizeX, Scalar<SIUnit::Length> sizeY, Scalar<SIUnit::Length> cellSize);
+
+	/**
+	 * Insert an object.
+	 *
+	 * @param object The object.
+	 */
+	void insert(const std::shared_ptr<Object>& object);
+
+	/**
+	 * Remove an object.
+	 *
+	 * @param object The object.
+	 */
+	void erase(const std::shared_ptr<Object>& object);
+
+	/**
+	 * Move an object to the correct cell after its position has changed.
+	 *
+	 * @param object The object.
+	 */
+	void update(Object& object);
+
+	/**
+	 * Call a function for each object that overlaps the given rectangle.
+	 *
+	 * @param min The minimum corner.
+	 * @param max The maximum corner.
+	 * @param callback The function to call.
+	 */
+	void forEachObject(const Vector2<SIUnit::Position>& min, const Vector2<SIUnit::Position>& max, const CallbackType& callback) const;
+
+	/**
+	 * Call a function for each object within the given range of a position.
+	 *
+	 * @param position The position.
+	 * @param range The range; the object's radius is added to this.
+	 * @param callback The function to call.
+	 * @see Object::isNear
+	 */
+	void forEachObject(const Vector2<SIUnit::Position>& position, Scalar<SIUnit::Length> range, const CallbackType& callback) const;
+};
+
+#endif
@@ -0,0 +1,571 @@
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+#include "util/Math.hpp"
+#include "ObjectStore.hpp"
+#include "Object.hpp"
+#include "Task.hpp"
+#include "Pathfinder.hpp"
+
+#ifdef PUTKARTS_SIMD_INTEGRATE
+#include <immintrin.h>
+#endif
+
+/**
+ * Mix a value into a hash.
+ *
+ * @param hash The hash so far.
+ * @param value The value.
+ * @return The new hash.
+ */
+static std::uint64_t mix(std::uint64_t hash, std::uint64_t value) {
+	hash = (hash ^ value) * 0x9e3779b97f4a7c15ull;
+	return hash ^ (hash >> 29);
+}
+
+/**
+ * Mix a scalar into a hash; the exact bits are used.
+ *
+ * @param hash The hash so far.
+ * @param value The value.
+ * @return The new hash.
+ */
+template <typename U> static std::uint64_t mix(std::uint64_t hash, const Scalar<U>& value) {
+	static_assert(sizeof(value.value) == sizeof(std::uint64_t), "Scalar must have 64 bits.");
+	std::uint64_t bits;
+	std::memcpy(&bits, &value.value, sizeof(bits));
+	return mix(hash, bits);
+}
+
+Game::ObjectStore::~ObjectStore() {
+	while (!objects.empty()) {
+		erase(*objects.back());
+	}
+}
+
+void Game::ObjectStore::insert(Object& object) {
+	if (object.store) {
+		object.store->erase(object);
+	}
+	object.slot = objects.size();
+	objects.push_back(&object);
+	positions.push_back(object.position);
+	headings.push_back(object.heading);
+	velocities.push_back(object.objectType ? object.objectType->maxVelocity : Scalar<SIUnit::Velocity>());
+	radii.push_back(object.objectType ? object.objectType->radius : Scalar<SIUnit::Length>());
+	immovable.push_back(!velocities.back().isPositive() || (object.objectType && object.objectType->immutable));
+	if (!immovable.back()) {
+		unitRadii += radii.back();
+		++unitCount;
+	}
+	targets.push_back(object.position);
+	moving.push_back(false);
+	finished.push_back(false);
+	offRoute.push_back(false);
+	hashes.push_back(0);
+	object.store = this;
+	rehash(object.slot);
+
+	if (freeHandles.empty()) {
+		freeHandles.push_back(handleObjects.size());
+		handleObjects.push_back(0);
+		handleGenerations.push_back(0);
+	}
+	object.handle.index = freeHandles.back();
+	object.handle.generation = handleGenerations[object.handle.index];
+	handleObjects[object.handle.index] = &object;
+	freeHandles.pop_back();
+
+	swapSlots(object.slot, activeCount);
+	++activeCount;
+}
+
+void Game::ObjectStore::erase(Object& object) {
+	if (object.store != this) {
+		return;
+	}
+	SlotType slot = object.slot;
+	if (slot >= activeCount) {
+		eraseIdle(slot);
+	}
+	if (!immovable[slot]) {
+		unitRadii -= radii[slot];
+		// Don't let rounding errors pile up.
+		if (!--unitCount) {
+			unitRadii = Scalar<SIUnit::Length>();
+		}
+	}
+	object.position = positions[slot];
+	object.heading = headings[slot];
+	object.store = 0;
+	hash ^= hashes[slot];
+
+	// A new generation makes the old handles stale.
+	handleObjects[object.handle.index] = 0;
+	++handleGenerations[object.handle.index];
+	freeHandles.push_back(object.handle.index);
+
+	// Keep the active slots first: the last active object takes the slot.
+	if (slot < activeCount) {
+		--activeCount;
+		swapSlots(slot, activeCount);
+		slot = activeCount;
+	}
+
+	// Move the last object into the freed slot.
+	SlotType last = objects.size() - 1;
+	if (slot != last) {
+		objects[slot] = objects[last];
+		positions[slot] = positions[last];
+		headings[slot] = headings[last];
+		velocities[slot] = velocities[last];
+		radii[slot] = radii[last];
+		immovable[slot] = immovable[last];
+		targets[slot] = targets[last];
+		moving[slot] = moving[last];
+		finished[slot] = finished[last];
+		offRoute[slot] = offRoute[last];
+		hashes[slot] = hashes[last];
+		objects[slot]->slot = slot;
+	}
+	objects.pop_back();
+	positions.pop_back();
+	headings.pop_back();
+	velocities.pop_back();
+	radii.pop_back();
+	immovable.pop_back();
+	targets.pop_back();
+	moving.pop_back();
+	finished.pop_back();
+	offRoute.pop_back();
+	hashes.pop_back();
+}
+
+void Game::ObjectStore::swapSlots(SlotType a, SlotType b) {
+	if (a == b) {
+		return;
+	}
+	std::swap(objects[a], objects[b]);
+	std::swap(positions[a], positions[b]);
+	std::swap(headings[a], headings[b]);
+	std::swap(velocities[a], velocities[b]);
+	std::swap(radii[a], radii[b]);
+	std::swap(immovable[a], immovable[b]);
+	std::swap(targets[a], targets[b]);
+	std::swap(moving[a], moving[b]);
+	std::swap(finished[a], finished[b]);
+	std::swap(offRoute[a], offRoute[b]);
+	std::swap(hashes[a], hashes[b]);
+	objects[a]->slot = a;
+	objects[b]->slot = b;
+}
+
+void Game::ObjectStore::activate(Object& object) {
+	if (object.store != this || object.slot < activeCount) {
+		return;
+	}
+	eraseIdle(object.slot);
+	swapSlots(object.slot, activeCount);
+	++activeCount;
+}
+
+void Game::ObjectStore::deactivate(Object& object) {
+	if (object.store != this || object.slot >= activeCount) {
+		return;
+	}
+	--activeCount;
+	swapSlots(object.slot, activeCount);
+	insertIdle(object.slot);
+}
+
+void Game::ObjectStore::setActiveCount(SlotType count) {
+	activeCount = count;
+	rebuildIdle();
+}
+
+std::uint64_t Game::ObjectStore::computeHash(SlotType slot) const {
+	const Object& object = *objects[slot];
+	std::uint64_t h = mix(0, object.id);
+	h = mix(h, positions[slot].x);
+	h = mix(h, positions[slot].y);
+	h = mix(h, headings[slot].x);
+	h = mix(h, headings[slot].y);
+	h = mix(h, (std::uint64_t) object.hitPoints);
+	if (object.task) {
+		h = mix(h, object.task->hasDestination);
+		h = mix(h, object.task->destination.x);
+		h = mix(h, object.task->destination.y);
+		h = mix(h, object.task->targetHash);
+	}
+	return h;
+}
+
+std::uint64_t Game::ObjectStore::hashIds(const std::vector<Handle>& handles) const {
+	std::uint64_t h = 0;
+	for (Handle handle: handles) {
+		const Object* object = resolve(handle);
+		if (object) {
+			h = mix(h, object->id);
+		}
+	}
+	return h;
+}
+
+void Game::ObjectStore::rehash(SlotType slot) {
+	const std::uint64_t h = computeHash(slot);
+	hash ^= hashes[slot] ^ h;
+	hashes[slot] = h;
+}
+
+void Game::ObjectStore::moveSlot(SlotType slot, Scalar<SIUnit::Length> step) {
+	const Vector2<SIUnit::Position> d = targets[slot] - positions[slot];
+	const Scalar<SIUnit::Length> length = d.length();
+	if (!length || !(step < length)) {
+		positions[slot] = targets[slot];
+	} else {
+		positions[slot] += d * (step / length);
+	}
+	if (length) {
+		headings[slot] = d / length;
+	}
+}
+
+void Game::ObjectStore::integrate(Scalar<SIUnit::Time> dt, SlotType begin, SlotType end) {
+	// Collisions are resolved after all objects have moved; see separate.
+#ifdef PUTKARTS_SIMD_INTEGRATE
+	if (vectorized) {
+		integrateVectorized(dt, begin, end);
+		return;
+	}
+#endif
+	for (SlotType i = begin; i < end; ++i) {
+		if (moving[i]) {
+			moveSlot(i, velocities[i] * dt);
+		}
+	}
+}
+
+#ifdef PUTKARTS_SIMD_INTEGRATE
+void Game::ObjectStore::integrateVectorized(Scalar<SIUnit::Time> dt, SlotType begin, SlotType end) {
+	static_assert(sizeof(Vector2<SIUnit::Position>) == 2 * sizeof(double) && sizeof(Vector2<>) == 2 * sizeof(double), "Vector2 must be two packed doubles.");
+	double* const position = reinterpret_cast<double*>(positions.data());
+	const double* const target = reinterpret_cast<const double*>(targets.data());
+	double* const heading = reinterpret_cast<double*>(headings.data());
+	SlotType i = begin;
+
+#ifdef __AVX2__
+	// Two objects at a time, [x0 y0 x1 y1].
+	for (; i + 1 < end; i += 2) {
+		if (!moving[i] || !moving[i + 1]) {
+			for (SlotType j = i; j < i + 2; ++j) {
+				if (moving[j]) {
+					moveSlot(j, velocities[j] * dt);
+				}
+			}
+			continue;
+		}
+		const __m256d p = _mm256_loadu_pd(position + 2 * i);
+		const __m256d t = _mm256_loadu_pd(target + 2 * i);
+		const __m256d d = _mm256_sub_pd(t, p);
+		const __m256d d2 = _mm256_mul_pd(d, d);
+		const __m256d length = _mm256_sqrt_pd(_mm256_add_pd(d2, _mm256_permute_pd(d2, 0x5)));
+		if (_mm256_movemask_pd(_mm256_cmp_pd(length, _mm256_setzero_pd(), _CMP_EQ_OQ))) {
+			moveSlot(i, velocities[i] * dt);
+			moveSlot(i + 1, velocities[i + 1] * dt);
+			continue;
+		}
+		const double step0 = (velocities[i] * dt).getDouble(), step1 = (velocities[i + 1] * dt).getDouble();
+		const __m256d step = _mm256_set_pd(step1, step1, step0, step0);
+		const __m256d moved = _mm256_add_pd(p, _mm256_mul_pd(d, _mm256_div_pd(step, length)));
+		_mm256_storeu_pd(position + 2 * i, _mm256_blendv_pd(t, moved, _mm256_cmp_pd(step, length, _CMP_LT_OQ)));
+		_mm256_storeu_pd(heading + 2 * i, _mm256_div_pd(d, length));
+	}
+#endif
+
+	// One object at a time, [x y].
+	for (; i < end; ++i) {
+		if (!moving[i]) {
+			continue;
+		}
+		const __m128d p = _mm_loadu_pd(position + 2 * i);
+		const __m128d t = _mm_loadu_pd(target + 2 * i);
+		const __m128d d = _mm_sub_pd(t, p);
+		const __m128d d2 = _mm_mul_pd(d, d);
+		const __m128d length = _mm_sqrt_pd(_mm_add_pd(d2, _mm_shuffle_pd(d2, d2, 1)));
+		if (_mm_cvtsd_f64(length) == 0) {
+			moveSlot(i, velocities[i] * dt);
+			continue;
+		}
+		const __m128d step = _mm_set1_pd((velocities[i] * dt).getDouble());
+		const __m128d moved = _mm_add_pd(p, _mm_mul_pd(d, _mm_div_pd(step, length)));
+		const __m128d mask = _mm_cmplt_pd(step, length);
+		_mm_storeu_pd(position + 2 * i, _mm_or_pd(_mm_and_pd(mask, moved), _mm_andnot_pd(mask, t)));
+		_mm_storeu_pd(heading + 2 * i, _mm_div_pd(d, length));
+	}
+}
+#endif
+
+/**
+ * Get the number of broadphase cells that cover a length.
+ *
+ * @param size The length.
+ * @param cellSize The size of a cell.
+ * @return The number of cells, at least one and at most what a cell coordinate can hold.
+ */
+static std::uint32_t countCells(Scalar<SIUnit::Length> size, Scalar<SIUnit::Length> cellSize) {
+	const double cells = std::ceil((size / cellSize).getDouble());
+	if (!(cells >= 1)) {
+		return 1;
+	}
+	return cells < std::numeric_limits<std::uint32_t>::max() ? (std::uint32_t) cells : std::numeric_limits<std::uint32_t>::max();
+}
+
+/**
+ * Round a cell size to the nearest power of two.
+ *
+ * The result only depends on the size, not on how it was summed up,
+ * except exactly between two powers, which sums of radii don't hit.
+ *
+ * @param size The size.
+ * @return The rounded size, or one if the size is not positive.
+ */
+static Scalar<SIUnit::Length> roundCellSize(Scalar<SIUnit::Length> size) {
+	const double value = size.getDouble();
+	if (!(value > 0)) {
+		return Scalar<SIUnit::Length>(1);
+	}
+	// value = m * 2^e with 0.5 <= m < 1; round up if value >= sqrt(2) * 2^(e - 1).
+	int e;
+	const double m = std::frexp(value, &e);
+	const Scalar<SIUnit::Length> result(std::ldexp(1.0, m * m < 0.5 ? e - 1 : e));
+	return result.isPositive() ? result : Scalar<SIUnit::Length>(1);
+}
+
+/**
+ * Order objects by their ids.
+ */
+static bool isLowerId(const Game::Object* a, const Game::Object* b) {
+	return a->id < b->id;
+}
+
+std::uint32_t Game::ObjectStore::getCell(Scalar<SIUnit::Position> position, std::uint32_t cells) const {
+	const double cell = std::floor((position / cellSize).getDouble());
+	return !(cell >= 0) ? 0 : std::min<double>(cell, cells - 1);
+}
+
+void Game::ObjectStore::getCells(SlotType slot, std::uint32_t& x0, std::uint32_t& y0, std::uint32_t& x1, std::uint32_t& y1) const {
+	x0 = getCell(positions[slot].x - radii[slot], cellsX);
+	y0 = getCell(positions[slot].y - radii[slot], cellsY);
+	x1 = getCell(positions[slot].x + radii[slot], cellsX);
+	y1 = getCell(positions[slot].y + radii[slot], cellsY);
+}
+
+void Game::ObjectStore::findCell(std::uint32_t x, std::uint32_t y, std::vector<CellEntryType>::const_iterator& begin, std::vector<CellEntryType>::const_iterator& end) const {
+	const std::uint64_t cell = x + (std::uint64_t) y * cellsX;
+	begin = std::lower_bound(cellEntries.begin(), cellEntries.end(), CellEntryType(cell, 0));
+	end = std::lower_bound(begin, cellEntries.end(), CellEntryType(cell + 1, 0));
+}
+
+bool Game::ObjectStore::isFirstCell(std::uint32_t x0, std::uint32_t y0, SlotType j, std::uint32_t x, std::uint32_t y) const {
+	return x == std::max(x0, getCell(positions[j].x - radii[j], cellsX)) && y == std::max(y0, getCell(positions[j].y - radii[j], cellsY));
+}
+
+const Game::ObjectStore::IdleCellType* Game::ObjectStore::findIdleCell(std::uint32_t x, std::uint32_t y) const {
+	std::unordered_map<std::uint64_t, IdleCellType>::const_iterator found = idleCells.find(x + (std::uint64_t) y * cellsX);
+	return found == idleCells.end() ? 0 : &found->second;
+}
+
+void Game::ObjectStore::insertIdle(SlotType slot) {
+	// Before the first broadphase there are no cells; rebuildIdle adds the objects then.
+	if (!cellSize.isPositive()) {
+		return;
+	}
+	std::uint32_t x0, y0, x1, y1;
+	getCells(slot, x0, y0, x1, y1);
+	for (std::uint32_t y = y0; y <= y1; ++y) {
+		for (std::uint32_t x = x0; x <= x1; ++x) {
+			IdleCellType& cell = idleCells[x + (std::uint64_t) y * cellsX];
+			cell.insert(std::upper_bound(cell.begin(), cell.end(), objects[slot], isLowerId), objects[slot]);
+		}
+	}
+}
+
+void Game::ObjectStore::eraseIdle(SlotType slot) {
+	if (!cellSize.isPositive()) {
+		return;
+	}
+	// The object hasn't moved since it was inserted, so it's in the same cells.
+	std::uint32_t x0, y0, x1, y1;
+	getCells(slot, x0, y0, x1, y1);
+	for (std::uint32_t y = y0; y <= y1; ++y) {
+		for (std::uint32_t x = x0; x <= x1; ++x) {
+			std::unordered_map<std::uint64_t, IdleCellType>::iterator cell = idleCells.find(x + (std::uint64_t) y * cellsX);
+			if (cell == idleCells.end()) {
+				continue;
+			}
+			IdleCellType::iterator found = std::lower_bound(cell->second.begin(), cell->second.end(), objects[slot], isLowerId);
+			if (found != cell->second.end() && *found == objects[slot]) {
+				cell->second.erase(found);
+			}
+			if (cell->second.empty()) {
+				idleCells.erase(cell);
+			}
+		}
+	}
+}
+
+void Game::ObjectStore::rebuildIdle() {
+	idleCells.clear();
+	for (SlotType i = activeCount; i < objects.size(); ++i) {
+		insertIdle(i);
+	}
+}
+
+bool Game::ObjectStore::addPush(SlotType i, SlotType j, Vector2<SIUnit::Position>& push) const {
+	const Vector2<SIUnit::Position> d = positions[i] - positions[j];
+	const Scalar<SIUnit::Length> minDistance = radii[i] + radii[j];
+	if (!(d.pow2() < minDistance * minDistance)) {
+		return false;
+	}
+
+	// Both objects move half of the overlap, in opposite directions,
+	// or this one moves all of it if the other one can't move.
+	// Objects on the same point get a direction from their ids.
+	const Scalar<> share(immovable[j] ? 1 : 2);
+	if (!d) {
+		const Object::IdType low = std::min(objects[i]->id, objects[j]->id), high = std::max(objects[i]->id, objects[j]->id);
+		const Scalar<SIUnit::Angle> angle(Math::toRadians((low * 2654435761u + high) % 360 + (objects[i]->id == low ? 0 : 180)));
+		push += Vector2<>::fromAngle(angle) * (minDistance / share);
+	} else {
+		const Scalar<SIUnit::Length> distance = d.length();
+		push += d * ((minDistance - distance) / (share * distance));
+	}
+	return true;
+}
+
+void Game::ObjectStore::buildBroadphase(Scalar<SIUnit::Length> sizeX, Scalar<SIUnit::Length> sizeY) {
+	separations.assign(activeCount, Vector2<SIUnit::Position>());
+	pushed.assign(activeCount, false);
+	touchedIdle.assign(activeCount, false);
+	if (!activeCount) {
+		return;
+	}
+
+	// The cells are about as wide as an average unit; a few large objects
+	// such as buildings would make them too large for the units. The size
+	// is a power of two, so it changes rarely, and only then are the idle
+	// objects sorted into the cells again.
+	const Scalar<SIUnit::Length> newCellSize = roundCellSize(unitCount ? unitRadii * Scalar<>(2.0 / unitCount) : Scalar<SIUnit::Length>());
+	const std::uint32_t newCellsX = countCells(sizeX, newCellSize), newCellsY = countCells(sizeY, newCellSize);
+	if (newCellSize != cellSize || newCellsX != cellsX || newCellsY != cellsY) {
+		cellSize = newCellSize;
+		cellsX = newCellsX;
+		cellsY = newCellsY;
+		rebuildIdle();
+	}
+
+	// Sort the entries of the active slots by cell; the cell numbers need 64 bits on big maps.
+	cellEntries.clear();
+	std::uint32_t x0, y0, x1, y1;
+	for (SlotType i = 0; i < activeCount; ++i) {
+		getCells(i, x0, y0, x1, y1);
+		for (std::uint32_t y = y0; y <= y1; ++y) {
+			for (std::uint32_t x = x0; x <= x1; ++x) {
+				cellEntries.push_back(CellEntryType(x + (std::uint64_t) y * cellsX, i));
+			}
+		}
+	}
+	std::sort(cellEntries.begin(), cellEntries.end());
+}
+
+void Game::ObjectStore::separate(SlotType begin, SlotType end) {
+	for (SlotType i = begin; i < end; ++i) {
+		if (immovable[i]) {
+			continue;
+		}
+		std::uint32_t x0, y0, x1, y1;
+		getCells(i, x0, y0, x1, y1);
+		Vector2<SIUnit::Position> push;
+		unsigned int contacts = 0;
+		bool touched = false;
+		for (std::uint32_t y = y0; y <= y1 && contacts < maxContacts; ++y) {
+			for (std::uint32_t x = x0; x <= x1 && contacts < maxContacts; ++x) {
+				std::vector<CellEntryType>::const_iterator k, cellEnd;
+				findCell(x, y, k, cellEnd);
+				for (; k != cellEnd && contacts < maxContacts; ++k) {
+					const SlotType j = k->second;
+					if (j != i && isFirstCell(x0, y0, j, x, y) && addPush(i, j, push)) {
+						++contacts;
+					}
+				}
+
+				// The idle objects push too, and the ones that can move wake up.
+				const IdleCellType* idle = findIdleCell(x, y);
+				if (!idle) {
+					continue;
+				}
+				for (IdleCellType::const_iterator o = idle->begin(); o != idle->end() && contacts < maxContacts; ++o) {
+					const SlotType j = (*o)->slot;
+					if (isFirstCell(x0, y0, j, x, y) && addPush(i, j, push)) {
+						++contacts;
+						touched = touched || !immovable[j];
+					}
+				}
+			}
+		}
+
+		// Don't go further than the radius in one step.
+		if (push && radii[i] < push.length()) {
+			push = push * (radii[i] / push.length());
+		}
+		separations[i] = push;
+		touchedIdle[i] = touched;
+	}
+}
+
+void Game::ObjectStore::applySeparation(const Pathfinder& pathfinder, SlotType begin, SlotType end) {
+	for (SlotType i = begin; i < end; ++i) {
+		if (!separations[i]) {
+			continue;
+		}
+		// Slide along walls: try the whole push, then each axis alone.
+		const Vector2<SIUnit::Position> candidates[3] = {
+			positions[i] + separations[i],
+			Vector2<SIUnit::Position>(positions[i].x + separations[i].x, positions[i].y),
+			Vector2<SIUnit::Position>(positions[i].x, positions[i].y + separations[i].y),
+		};
+		const bool walkableNow = pathfinder.isWalkable(pathfinder.getTile(positions[i]));
+		for (const Vector2<SIUnit::Position>& candidate: candidates) {
+			// An object already on a bad tile may be pushed anywhere.
+			if (!walkableNow || pathfinder.isWalkable(pathfinder.getTile(candidate))) {
+				positions[i] = candidate;
+				pushed[i] = true;
+				break;
+			}
+		}
+	}
+}
+
+void Game::ObjectStore::getIdleContacts(SlotType slot, std::vector<Object*>& result) const {
+	std::uint32_t x0, y0, x1, y1;
+	getCells(slot, x0, y0, x1, y1);
+	unsigned int contacts = 0;
+	for (std::uint32_t y = y0; y <= y1 && contacts < maxContacts; ++y) {
+		for (std::uint32_t x = x0; x <= x1 && contacts < maxContacts; ++x) {
+			const IdleCellType* idle = findIdleCell(x, y);
+			if (!idle) {
+				continue;
+			}
+			for (IdleCellType::const_iterator k = idle->begin(); k != idle->end() && contacts < maxContacts; ++k) {
+				const SlotType j = (*k)->slot;
+				const Scalar<SIUnit::Length> minDistance = radii[slot] + radii[j];
+				if (!immovable[j] && (positions[slot] - positions[j]).pow2() < minDistance * minDistance && isFirstCell(x0, y0, j, x, y)) {
+					result.push_back(objects[j]);
+					++contacts;
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,546 @@
+#ifndef PUTKARTS_Game_ObjectStore_HPP
+#define PUTKARTS_Game_ObjectStore_HPP
+
+#include <cstdint>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+
+#include "util/Scalar.hpp"
+#include "util/Vector2.hpp"
+
+// The SIMD code works on doubles.
+#if !defined(USE_FIXED_POINT) && (defined(__SSE2__) || defined(_M_X64))
+#define PUTKARTS_SIMD_INTEGRATE
+#endif
+
+namespace Game {
+	class Object;
+	class ObjectStore;
+	class Pathfinder;
+}
+
+/**
+ * Packed storage for the simulation state of the objects.
+ *
+ * Each object in the game owns one slot, and the slots are kept dense:
+ * when an object is removed, the last object is moved into its place.
+ * The state is stored one array per component so that the movement
+ * step can run through it linearly. The movement normalizes the vector
+ * to the target instead of going through an angle; with SSE2 or AVX2
+ * several objects are moved at once. The SIMD code does the same IEEE
+ * operations in the same order as the scalar code, so the results are
+ * identical, and it can be turned off to compare with the scalar code.
+ *
+ * Objects can also be referred to with handles. A handle doesn't change
+ * when the object's slot does, and it stops resolving when the object
+ * leaves the store, even if the handle number is reused later.
+ *
+ * The store keeps a hash of the state of each object and the XOR of
+ * them all, so the hash of the whole game is updated only for the
+ * objects that change. The hash doesn't depend on the order of the slots.
+ *
+ * After moving, overlapping objects are pushed apart. The slots are
+ * sorted into a grid of cells about as wide as an average unit, and an
+ * object that is larger goes into every cell its bounding box covers,
+ * so only the cells under an object are checked. Only the occupied cells
+ * are stored, as a sorted list, so the cost doesn't depend on the map
+ * size. Each object handles at most maxContacts overlaps per step, so
+ * even a clump of objects on one point takes linear time. The pushes are
+ * computed from the positions before any of them is applied, so the
+ * result is deterministic. Immutable objects and objects that can't move
+ * are never pushed; an object that overlaps one is pushed out by the
+ * whole overlap.
+ *
+ * The slots are split into active ones first and idle ones after them.
+ * Only the active slots are moved and separated. The idle objects stay
+ * in cells of their own, which change only when an object goes idle or
+ * wakes up, so the active ones still bump into them but a step costs
+ * nothing per idle object. The order of the slots in each part follows
+ * from the order of activate and deactivate calls, so it is the same on
+ * every computer.
+ */
+class Game::ObjectStore {
+	friend class Object;
+
+public:
+	/** Type for slot numbers. */
+	typedef std::vector<Object*>::size_type SlotType;
+
+	/** The largest number of overlaps an object resolves in one step. */
+	static const unsigned int maxContacts = 12;
+
+	/** Generation counted reference to an object in the store. */
+	struct Handle {
+		/** The index in the handle table. */
+		std::uint32_t index;
+
+		/** The generation of the index when the handle was made. */
+		std::uint32_t generation;
+	};
+
+private:
+	/** The object for each handle index, or NULL if the index is free. */
+	std::vector<Object*> handleObjects;
+
+	/** The current generation of each handle index. */
+	std::vector<std::uint32_t> handleGenerations;
+
+	/** Free handle indices. */
+	std::vector<std::uint32_t> freeHandles;
+
+	/** The object in each slot. */
+	std::vector<Object*> objects;
+
+	/** Positions. */
+	std::vector<Vector2<SIUnit::Position> > positions;
+
+	/** The directions the objects are looking, as unit vectors. */
+	std::vector<Vector2<> > headings;
+
+	/** Maximum velocities. */
+	std::vector<Scalar<SIUnit::Velocity> > velocities;
+
+	/** Radii. */
+	std::vector<Scalar<SIUnit::Length> > radii;
+
+	/** Is the object immutable or unable to move, so that others can't push it? */
+	std::vector<char> immovable;
+
+	/** The position each object is moving towards during this step. */
+	std::vector<Vector2<SIUnit::Position> > targets;
+
+	/** Is the object moving during this step? (Not vector<bool>, it's slow.) */
+	std::vector<char> moving;
+
+	/** Has the object's task run out of targets, or reached its destination, during this step? */
+	std::vector<char> finished;
+
+	/** Has the object left the path of its task during this step, so that the path must be planned again? */
+	std::vector<char> offRoute;
+
+	/** The hash of the state of each object. */
+	std::vector<std::uint64_t> hashes;
+
+	/** The XOR of the hashes. */
+	std::uint64_t hash;
+
+	/** The number of active slots; they come before the idle ones. */
+	SlotType activeCount;
+
+	/** Does integrate use SIMD instructions, if they are available? */
+	bool vectorized;
+
+	/** How far each object is pushed by the others during this step. */
+	std::vector<Vector2<SIUnit::Position> > separations;
+
+	/** Has the object been pushed during this step? */
+	std::vector<char> pushed;
+
+	/** Has the object overlapped an idle object during this step? */
+	std::vector<char> touchedIdle;
+
+	/** The sum of the radii of the objects that can move; with unitCount, it sets the cell size. */
+	Scalar<SIUnit::Length> unitRadii;
+
+	/** The number of objects that can move. */
+	SlotType unitCount;
+
+	/** The size of the broadphase cells, or zero before the first broadphase. */
+	Scalar<SIUnit::Length> cellSize;
+
+	/** The number of broadphase cells in the x and y directions; the positions are clamped to these. */
+	std::uint32_t cellsX, cellsY;
+
+	/** Type for broadphase entries: a cell number, x + y * cellsX, and a slot in the cell. */
+	typedef std::pair<std::uint64_t, SlotType> CellEntryType;
+
+	/** The active slots in the occupied cells, sorted by cell and by slot; a slot may be in several cells. */
+	std::vector<CellEntryType> cellEntries;
+
+	/** Type for the idle objects of a cell, sorted by id. */
+	typedef std::vector<Object*> IdleCellType;
+
+	/**
+	 * The idle objects by cell number.
+	 *
+	 * Idle objects don't move, so this is only updated when an object
+	 * goes idle or wakes up, and the broadphase of a step only sorts the
+	 * active slots. Empty cells are removed.
+	 */
+	std::unordered_map<std::uint64_t, IdleCellType> idleCells;
+
+	/**
+	 * Get the broadphase cell coordinate for a position coordinate, clamped to the grid.
+	 *
+	 * @param position The coordinate.
+	 * @param cells The number of cells in the direction.
+	 */
+	std::uint32_t getCell(Scalar<SIUnit::Position> position, std::uint32_t cells) const;
+
+	/**
+	 * Get the broadphase cells covered by the bounding box of an object.
+	 *
+	 * @param slot The slot of the object.
+	 * @param x0 The first cell in the x direction is stored here.
+	 * @param y0 The first cell in the y direction is stored here.
+	 * @param x1 The last cell in the x direction is stored here.
+	 * @param y1 The last cell in the y direction is stored here.
+	 */
+	void getCells(SlotType slot, std::uint32_t& x0, std::uint32_t& y0, std::uint32_t& x1, std::uint32_t& y1) const;
+
+	/**
+	 * Find the broadphase entries of a cell.
+	 *
+	 * @param x The x coordinate of the cell.
+	 * @param y The y coordinate of the cell.
+	 * @param begin The first entry is stored here.
+	 * @param end The entry after the last one is stored here.
+	 */
+	void findCell(std::uint32_t x, std::uint32_t y, std::vector<CellEntryType>::const_iterator& begin, std::vector<CellEntryType>::const_iterator& end) const;
+
+	/**
+	 * Is a pair of objects found in a cell for the first time?
+	 *
+	 * Objects that span several cells may share more than one; the pair
+	 * counts only in the cell of the corner of their overlapping boxes.
+	 *
+	 * @param x0 The first cell of the first object in the x direction.
+	 * @param y0 The first cell of the first object in the y direction.
+	 * @param j The slot of the second object.
+	 * @param x The x coordinate of the cell.
+	 * @param y The y coordinate of the cell.
+	 */
+	bool isFirstCell(std::uint32_t x0, std::uint32_t y0, SlotType j, std::uint32_t x, std::uint32_t y) const;
+
+	/**
+	 * Find the idle objects of a cell.
+	 *
+	 * @param x The x coordinate of the cell.
+	 * @param y The y coordinate of the cell.
+	 * @return The objects, or NULL if there are none.
+	 */
+	const IdleCellType* findIdleCell(std::uint32_t x, std::uint32_t y) const;
+
+	/**
+	 * Add the object in an idle slot to the idle cells.
+	 *
+	 * @param slot The slot.
+	 */
+	void insertIdle(SlotType slot);
+
+	/**
+	 * Remove the object in an idle slot from the idle cells.
+	 *
+	 * @param slot The slot.
+	 */
+	void eraseIdle(SlotType slot);
+
+	/**
+	 * Sort all idle slots into the idle cells again, after the cells have changed.
+	 */
+	void rebuildIdle();
+
+	/**
+	 * Add the push from one overlapping object to another.
+	 *
+	 * @param i The slot of the object that is pushed.
+	 * @param j The slot of the object that pushes.
+	 * @param push The push is added here.
+	 * @return True if the objects overlap.
+	 */
+	bool addPush(SlotType i, SlotType j, Vector2<SIUnit::Position>& push) const;
+
+	/**
+	 * Exchange the objects in two slots.
+	 *
+	 * Only the lasting state moves; the results of the current step
+	 * (pushes and the broadphase) are left in place.
+	 *
+	 * @param a The first slot.
+	 * @param b The second slot.
+	 */
+	void swapSlots(SlotType a, SlotType b);
+
+	/**
+	 * Move one object towards its target; this is the scalar reference for the SIMD code.
+	 *
+	 * @param slot The slot.
+	 * @param step The distance to move.
+	 */
+	void moveSlot(SlotType slot, Scalar<SIUnit::Length> step);
+
+#ifdef PUTKARTS_SIMD_INTEGRATE
+	/**
+	 * The SIMD version of integrate.
+	 */
+	void integrateVectorized(Scalar<SIUnit::Time> dt, SlotType begin, SlotType end);
+#endif
+
+	/**
+	 * Compute the hash of the object in a slot.
+	 *
+	 * It covers the id, position, heading, hit points and the task's destination and targets.
+	 *
+	 * @param slot The slot.
+	 * @return The hash.
+	 */
+	std::uint64_t computeHash(SlotType slot) const;
+
+public:
+	/**
+	 * Constructor.
+	 */
+	ObjectStore():
+		hash(0),
+		activeCount(0),
+		vectorized(true),
+		unitCount(0),
+		cellsX(0),
+		cellsY(0) {
+	}
+
+	/**
+	 * Destructor; detaches any remaining objects.
+	 */
+	~ObjectStore();
+
+	/**
+	 * Get the number of used slots.
+	 */
+	SlotType size() const {
+		return objects.size();
+	}
+
+	/**
+	 * Get the number of active slots; the active slots are [0, getActiveCount()).
+	 */
+	SlotType getActiveCount() const {
+		return activeCount;
+	}
+
+	/**
+	 * Is the object in a slot active?
+	 *
+	 * @param slot The slot.
+	 */
+	bool isActive(SlotType slot) const {
+		return slot < activeCount;
+	}
+
+	/**
+	 * Get the object in a slot.
+	 *
+	 * @param slot The slot.
+	 * @return The object.
+	 */
+	Object& getObject(SlotType slot) const {
+		return *objects[slot];
+	}
+
+	/**
+	 * Find the object of a handle.
+	 *
+	 * @param handle The handle.
+	 * @return The object, or NULL if it has left the store.
+	 */
+	Object* resolve(Handle handle) const {
+		if (handle.index >= handleObjects.size() || handleGenerations[handle.index] != handle.generation) {
+			return 0;
+		}
+		return handleObjects[handle.index];
+	}
+
+	/**
+	 * Hash the ids of some objects, in order.
+	 *
+	 * @param handles The objects; those that have left the store are skipped.
+	 * @return The hash.
+	 */
+	std::uint64_t hashIds(const std::vector<Handle>& handles) const;
+
+	/**
+	 * Is the object in a slot moving during this step?
+	 *
+	 * @param slot The slot.
+	 */
+	bool isMoving(SlotType slot) const {
+		return moving[slot];
+	}
+
+	/**
+	 * Has the object in a slot been pushed by others during this step?
+	 *
+	 * @param slot The slot.
+	 */
+	bool isPushed(SlotType slot) const {
+		return pushed[slot];
+	}
+
+	/**
+	 * Has the object in a slot overlapped an idle object during this step?
+	 *
+	 * @param slot The slot.
+	 */
+	bool hasTouchedIdle(SlotType slot) const {
+		return touchedIdle[slot];
+	}
+
+	/**
+	 * Has the task of the object in a slot run out of targets, or reached its destination, during this step?
+	 *
+	 * @param slot The slot.
+	 */
+	bool isFinished(SlotType slot) const {
+		return finished[slot];
+	}
+
+	/**
+	 * Has the object in a slot left the path of its task during this step?
+	 *
+	 * @param slot The slot.
+	 */
+	bool isOffRoute(SlotType slot) const {
+		return offRoute[slot];
+	}
+
+	/**
+	 * Get the hash of the state of all objects.
+	 */
+	std::uint64_t getHash() const {
+		return hash;
+	}
+
+	/**
+	 * Get the hash of the state of the object in a slot.
+	 *
+	 * @param slot The slot.
+	 */
+	std::uint64_t getHash(SlotType slot) const {
+		return hashes[slot];
+	}
+
+	/**
+	 * Update the hash of an object after its state has changed.
+	 *
+	 * @param slot The slot of the object.
+	 */
+	void rehash(SlotType slot);
+
+	/**
+	 * Give an object a slot and a handle; the object's current state is copied in.
+	 *
+	 * The object starts active, so it gets separated from the others
+	 * before it goes idle.
+	 *
+	 * @param object The object.
+	 */
+	void insert(Object& object);
+
+	/**
+	 * Take the slot away from an object and invalidate its handle; the state is copied back to the object.
+	 *
+	 * @param object The object.
+	 */
+	void erase(Object& object);
+
+	/**
+	 * Move an object to the active slots; nothing happens if it is already active.
+	 *
+	 * This changes the slots of two objects, so it must not be called
+	 * while the slots are being processed.
+	 *
+	 * @param object The object.
+	 */
+	void activate(Object& object);
+
+	/**
+	 * Move an object to the idle slots; nothing happens if it is already idle.
+	 *
+	 * This changes the slots of two objects, so it must not be called
+	 * while the slots are being processed.
+	 *
+	 * @param object The object.
+	 */
+	void deactivate(Object& object);
+
+	/**
+	 * Set the number of active slots without moving any objects, e.g. when loading a saved game.
+	 *
+	 * @param count The number of active slots; the rest are idle.
+	 */
+	void setActiveCount(SlotType count);
+
+	/**
+	 * Choose between the SIMD and the scalar movement code.
+	 *
+	 * Without USE_FIXED_POINT and with SSE2 or AVX2 enabled in the
+	 * compiler, the SIMD code is used by default; otherwise this has no
+	 * effect. Both give the same results.
+	 *
+	 * @param vectorized_ Use SIMD instructions?
+	 */
+	void setVectorized(bool vectorized_) {
+		vectorized = vectorized_;
+	}
+
+	/**
+	 * Move the moving objects in the given slots towards their targets.
+	 *
+	 * Each slot is handled independently, so different ranges may be
+	 * processed in parallel.
+	 *
+	 * @param dt The time step length.
+	 * @param begin The first slot.
+	 * @param end The slot after the last one.
+	 */
+	void integrate(Scalar<SIUnit::Time> dt, SlotType begin, SlotType end);
+
+	/**
+	 * Sort the active slots into the broadphase grid; call after moving and before separate.
+	 *
+	 * @param sizeX The width of the area the objects are in.
+	 * @param sizeY The height of the area the objects are in.
+	 */
+	void buildBroadphase(Scalar<SIUnit::Length> sizeX, Scalar<SIUnit::Length> sizeY);
+
+	/**
+	 * Compute how far the objects in the given slots are pushed by the objects they overlap.
+	 *
+	 * Immovable objects get no push, and they push the others by the
+	 * whole overlap instead of half of it.
+	 *
+	 * The slots must be active. Idle objects push the active ones but
+	 * aren't pushed themselves; an active object that overlaps one is
+	 * marked, and the idle object can be found with getIdleContacts.
+	 *
+	 * Each slot is handled independently, so different ranges may be
+	 * processed in parallel.
+	 *
+	 * @param begin The first slot.
+	 * @param end The slot after the last one.
+	 */
+	void separate(SlotType begin, SlotType end);
+
+	/**
+	 * Move the objects in the given slots by their pushes, but not onto unwalkable tiles.
+	 *
+	 * Each slot is handled independently, so different ranges may be
+	 * processed in parallel.
+	 *
+	 * @param pathfinder The pathfinder that knows the walkable tiles.
+	 * @param begin The first slot.
+	 * @param end The slot after the last one.
+	 */
+	void applySeparation(const Pathfinder& pathfinder, SlotType begin, SlotType end);
+
+	/**
+	 * Find the idle objects that an active object overlaps.
+	 *
+	 * @param slot The slot of the active object.
+	 * @param result The objects are appended here.
+	 */
+	void getIdleContacts(SlotType slot, std::vector<Object*>& result) const;
+};
+
+#endif
@@ -0,0 +1,150 @@
+#include <stdexcept>
+#include <algorithm>
+
+#include "PathGraph.hpp"
+#include "util/Serializer.hpp"
+#include "util/Deserializer.hpp"
+
+const std::string Game::PathGraph::magic("PutkaRTS paths");
+const unsigned int Game::PathGraph::version;
+
+/**
+ * Compare edges by their source node.
+ */
+static bool compareSources(const std::pair<Game::PathGraph::NodeType, Game::PathGraph::Edge>& a, const std::pair<Game::PathGraph::NodeType, Game::PathGraph::Edge>& b) {
+	return a.first < b.first || (a.first == b.first && a.second.node < b.second.node);
+}
+
+Game::PathGraph::PathGraph():
+	sizeX(0),
+	sizeY(0),
+	clusterSize(1),
+	tileHash(0) {
+}
+
+void Game::PathGraph::clear() {
+	tiles.clear();
+	clusterBegins.clear();
+	edgeBegins.clear();
+	edges.clear();
+}
+
+void Game::PathGraph::indexClusters() {
+	const std::uint32_t clusterCount = ((sizeX + clusterSize - 1) / clusterSize) * ((sizeY + clusterSize - 1) / clusterSize);
+	clusterBegins.assign(clusterCount + 1, 0);
+	for (TileType tile: tiles) {
+		++clusterBegins[getCluster(tile) + 1];
+	}
+	for (std::uint32_t i = 0; i < clusterCount; ++i) {
+		clusterBegins[i + 1] += clusterBegins[i];
+	}
+}
+
+void Game::PathGraph::build(TileType sizeX_, TileType sizeY_, TileType clusterSize_, std::uint64_t tileHash_, const std::vector<TileType>& tiles_, std::vector<std::pair<NodeType, Edge> >& edgeList) {
+	sizeX = sizeX_;
+	sizeY = sizeY_;
+	clusterSize = clusterSize_;
+	tileHash = tileHash_;
+	tiles = tiles_;
+	indexClusters();
+
+	std::sort(edgeList.begin(), edgeList.end(), compareSources);
+	edgeBegins.assign(tiles.size() + 1, 0);
+	edges.clear();
+	edges.reserve(edgeList.size());
+	for (const std::pair<NodeType, Edge>& edge: edgeList) {
+		++edgeBegins[edge.first + 1];
+		edges.push_back(edge.second);
+	}
+	for (NodeType i = 0; i < tiles.size(); ++i) {
+		edgeBegins[i + 1] += edgeBegins[i];
+	}
+}
+
+Game::PathGraph::NodeType Game::PathGraph::findNode(TileType tile) const {
+	const std::uint32_t cluster = getCluster(tile);
+	std::vector<TileType>::const_iterator begin = tiles.begin() + clusterBegins[cluster];
+	std::vector<TileType>::const_iterator end = tiles.begin() + clusterBegins[cluster + 1];
+	std::vector<TileType>::const_iterator found = std::lower_bound(begin, end, tile);
+	if (found == end || *found != tile) {
+		throw std::logic_error("PathGraph::findNode: No node at the tile!");
+	}
+	return found - tiles.begin();
+}
+
+std::string Game::PathGraph::serialize() const {
+	Serializer output;
+	output.put(magic);
+	output.put(version);
+	output.put(sizeX);
+	output.put(sizeY);
+	output.put(clusterSize);
+	output.put(tileHash);
+	output.put((unsigned int) tiles.size());
+	for (NodeType i = 0; i < tiles.size(); ++i) {
+		output.put(tiles[i]);
+		output.put(edgeBegins[i + 1] - edgeBegins[i]);
+		for (std::uint32_t j = edgeBegins[i]; j < edgeBegins[i + 1]; ++j) {
+			output.put(edges[j].node);
+			output.put(edges[j].cost);
+		}
+	}
+	return output.getData();
+}
+
+bool Game::PathGraph::deserialize(const std::string& data, TileType sizeX_, TileType sizeY_, TileType clusterSize_, std::uint64_t tileHash_) {
+	Deserializer input(data);
+	std::string fileMagic;
+	unsigned int fileVersion;
+	TileType fileSizeX, fileSizeY, fileClusterSize;
+	std::uint64_t fileTileHash;
+	input.get(fileMagic);
+	input.get(fileVersion);
+	if (fileMagic != magic || fileVersion != version) {
+		return false;
+	}
+	input.get(fileSizeX);
+	input.get(fileSizeY);
+	input.get(fileClusterSize);
+	input.get(fileTileHash);
+	if (fileSizeX != sizeX_ || fileSizeY != sizeY_ || fileClusterSize != clusterSize_ || fileTileHash != tileHash_) {
+		return false;
+	}
+
+	unsigned int count;
+	input.get(count);
+	if (count > sizeX_ * sizeY_) {
+		throw std::runtime_error("PathGraph: invalid node count!");
+	}
+	std::vector<TileType> fileTiles;
+	std::vector<std::pair<NodeType, Edge> > edgeList;
+	for (NodeType i = 0; i < count; ++i) {
+		TileType tile;
+		unsigned int edgeCount;
+		input.get(tile);
+		input.get(edgeCount);
+		if (tile >= sizeX_ * sizeY_) {
+			throw std::runtime_error("PathGraph: invalid node!");
+		}
+		fileTiles.push_back(tile);
+		while (edgeCount--) {
+			Edge edge;
+			input.get(edge.node);
+			input.get(edge.cost);
+			if (edge.node >= count) {
+				throw std::runtime_error("PathGraph: invalid edge!");
+			}
+			edgeList.push_back(std::make_pair(i, edge));
+		}
+	}
+	build(sizeX_, sizeY_, clusterSize_, tileHash_, fileTiles, edgeList);
+
+	// findNode needs the order.
+	for (NodeType i = 1; i < tiles.size(); ++i) {
+		if (std::make_pair(getCluster(tiles[i - 1]), tiles[i - 1]) >= std::make_pair(getCluster(tiles[i]), tiles[i])) {
+			clear();
+			throw std::runtime_error("PathGraph: invalid node order!");
+		}
+	}
+	return true;
+}
@@ -0,0 +1,188 @@
+#ifndef PUTKARTS_Game_PathGraph_HPP
+#define PUTKARTS_Game_PathGraph_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <utility>
+
+namespace Game {
+	class PathGraph;
+}
+
+/**
+ * Abstract graph of the map for long path queries.
+ *
+ * The map is divided into square clusters. Where a cluster meets its
+ * neighbour, each run of walkable tile pairs is an entrance, and the
+ * tiles in the middle of the run become nodes on both sides. The nodes
+ * of one cluster are connected with the costs of the shortest paths
+ * inside the cluster, and the two nodes of an entrance with one step.
+ *
+ * The graph is only data; Pathfinder builds it and searches it. It can
+ * be saved to a file with the size and a hash of the walkable tiles, so
+ * a changed map is noticed when the file is loaded.
+ */
+class Game::PathGraph {
+public:
+	/** Type for node numbers. */
+	typedef std::uint32_t NodeType;
+
+	/** Type for tile indices; the same as Pathfinder::TileType. */
+	typedef std::uint32_t TileType;
+
+	/** An edge to another node. */
+	struct Edge {
+		/** The other node. */
+		NodeType node;
+
+		/** The cost of the move. */
+		std::uint32_t cost;
+	};
+
+	/** The identifier at the start of a saved graph. */
+	static const std::string magic;
+
+	/** The format version of a saved graph. */
+	static const unsigned int version = 1;
+
+private:
+	/** The width of the map. */
+	TileType sizeX;
+
+	/** The height of the map. */
+	TileType sizeY;
+
+	/** The width and height of a cluster. */
+	TileType clusterSize;
+
+	/** The hash of the walkable tiles of the map. */
+	std::uint64_t tileHash;
+
+	/** The tile of each node, sorted by cluster and then by tile. */
+	std::vector<TileType> tiles;
+
+	/** The first node of each cluster, and the number of nodes at the end. */
+	std::vector<NodeType> clusterBegins;
+
+	/** The first edge of each node, and the number of edges at the end. */
+	std::vector<std::uint32_t> edgeBegins;
+
+	/** The edges of all nodes. */
+	std::vector<Edge> edges;
+
+	/**
+	 * Fill in clusterBegins from the tiles.
+	 */
+	void indexClusters();
+
+public:
+	/**
+	 * Constructor; the graph is empty.
+	 */
+	PathGraph();
+
+	/**
+	 * Make the graph empty.
+	 */
+	void clear();
+
+	/**
+	 * Is the graph empty?
+	 */
+	bool empty() const {
+		return tiles.empty();
+	}
+
+	/**
+	 * Get the cluster of a tile.
+	 *
+	 * @param tile The tile.
+	 */
+	std::uint32_t getCluster(TileType tile) const {
+		return (tile % sizeX) / clusterSize + (tile / sizeX) / clusterSize * ((sizeX + clusterSize - 1) / clusterSize);
+	}
+
+	/**
+	 * Get the number of nodes.
+	 */
+	NodeType size() const {
+		return tiles.size();
+	}
+
+	/**
+	 * Get the tile of a node.
+	 *
+	 * @param node The node.
+	 */
+	TileType getTile(NodeType node) const {
+		return tiles[node];
+	}
+
+	/**
+	 * Get the nodes of a cluster.
+	 *
+	 * @param cluster The cluster.
+	 * @param begin The first node is stored here.
+	 * @param end The node after the last one is stored here.
+	 */
+	void getClusterNodes(std::uint32_t cluster, NodeType& begin, NodeType& end) const {
+		begin = clusterBegins[cluster];
+		end = clusterBegins[cluster + 1];
+	}
+
+	/**
+	 * Get the edges of a node.
+	 *
+	 * @param node The node.
+	 * @param begin The first edge is stored here.
+	 * @param end The edge after the last one is stored here.
+	 */
+	void getEdges(NodeType node, const Edge*& begin, const Edge*& end) const {
+		begin = edges.data() + edgeBegins[node];
+		end = edges.data() + edgeBegins[node + 1];
+	}
+
+	/**
+	 * Fill the graph.
+	 *
+	 * @param sizeX_ The width of the map.
+	 * @param sizeY_ The height of the map.
+	 * @param clusterSize_ The width and height of a cluster.
+	 * @param tileHash_ The hash of the walkable tiles.
+	 * @param tiles_ The tiles of the nodes, sorted by cluster and then by tile.
+	 * @param edgeList The edges as (from, edge) pairs, in any order.
+	 */
+	void build(TileType sizeX_, TileType sizeY_, TileType clusterSize_, std::uint64_t tileHash_, const std::vector<TileType>& tiles_, std::vector<std::pair<NodeType, Edge> >& edgeList);
+
+	/**
+	 * Find the node at a tile.
+	 *
+	 * @param tile The tile.
+	 * @return The node.
+	 * @throw std::logic_error Thrown if there is no node at the tile.
+	 */
+	NodeType findNode(TileType tile) const;
+
+	/**
+	 * Save the graph.
+	 *
+	 * @return The data.
+	 */
+	std::string serialize() const;
+
+	/**
+	 * Load a graph, if it's for the same map.
+	 *
+	 * @param data The data from serialize.
+	 * @param sizeX_ The width of the map.
+	 * @param sizeY_ The height of the map.
+	 * @param clusterSize_ The width and height of a cluster.
+	 * @param tileHash_ The hash of the walkable tiles.
+	 * @return false if the data is for a different map; the graph is then unchanged.
+	 * @throw std::runtime_error Thrown if the data is invalid.
+	 */
+	bool deserialize(const std::string& data, TileType sizeX_, TileType sizeY_, TileType clusterSize_, std::uint64_t tileHash_);
+};
+
+#endif
@@ -0,0 +1,596 @@
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+#include <functional>
+
+#include "Pathfinder.hpp"
+#include "Map.hpp"
+#include "util/Path.hpp"
+
+const Game::Pathfinder::TileType Game::Pathfinder::noTile;
+const std::uint32_t Game::Pathfinder::FlowField::unreachable;
+
+/** The cost of a move to a side. */
+static const std::uint32_t straightCost = 10;
+
+/** The cost of a diagonal move; about straightCost * sqrt(2). */
+static const std::uint32_t diagonalCost = 14;
+
+/**
+ * Get the octile distance between two tiles, which is never more than the cost of a path.
+ *
+ * @param a The first tile.
+ * @param b The second tile.
+ * @param sizeX The width of the map.
+ * @return The distance in move costs.
+ */
+static std::uint32_t estimateCost(Game::Pathfinder::TileType a, Game::Pathfinder::TileType b, Game::Pathfinder::TileType sizeX) {
+	const Game::Pathfinder::TileType dx = std::max(a % sizeX, b % sizeX) - std::min(a % sizeX, b % sizeX);
+	const Game::Pathfinder::TileType dy = std::max(a / sizeX, b / sizeX) - std::min(a / sizeX, b / sizeX);
+	return straightCost * std::max(dx, dy) + (diagonalCost - straightCost) * std::min(dx, dy);
+}
+
+/**
+ * Get the tile at a position.
+ *
+ * @param position The position.
+ * @param sizeX The width of the map.
+ * @param sizeY The height of the map.
+ * @return The tile, or noTile if the position is outside the map.
+ */
+static Game::Pathfinder::TileType findTile(const Vector2<SIUnit::Position>& position, Game::Pathfinder::TileType sizeX, Game::Pathfinder::TileType sizeY) {
+	const double x = std::floor(position.x.getDouble());
+	const double y = std::floor(position.y.getDouble());
+	if (x < 0 || y < 0 || x >= sizeX || y >= sizeY) {
+		return Game::Pathfinder::noTile;
+	}
+	return (Game::Pathfinder::TileType) x + (Game::Pathfinder::TileType) y * sizeX;
+}
+
+Game::Pathfinder::TileType Game::Pathfinder::Route::getTile(const Vector2<SIUnit::Position>& position) const {
+	return findTile(position, sizeX, sizeY);
+}
+
+bool Game::Pathfinder::FlowField::getWaypoint(const Vector2<SIUnit::Position>& position, const Vector2<SIUnit::Position>& destination, Vector2<SIUnit::Position>& waypoint) const {
+	const TileType tile = getTile(position);
+	if (tile == noTile || distances[tile] == unreachable) {
+		return false;
+	}
+
+	// Go to the neighbour closest to the goal. Tiles next to a reachable
+	// tile are reachable if they are walkable, so the distances also tell
+	// which corners are blocked.
+	const TileType x = tile % sizeX, y = tile / sizeX;
+	const bool left = x > 0 && distances[tile - 1] != unreachable;
+	const bool right = x + 1 < sizeX && distances[tile + 1] != unreachable;
+	const bool up = y > 0 && distances[tile - sizeX] != unreachable;
+	const bool down = y + 1 < sizeY && distances[tile + sizeX] != unreachable;
+	TileType best = tile;
+	const TileType candidates[8] = {
+		left ? tile - 1 : tile,
+		right ? tile + 1 : tile,
+		up ? tile - sizeX : tile,
+		down ? tile + sizeX : tile,
+		left && up ? tile - sizeX - 1 : tile,
+		right && up ? tile - sizeX + 1 : tile,
+		left && down ? tile + sizeX - 1 : tile,
+		right && down ? tile + sizeX + 1 : tile,
+	};
+	for (TileType candidate: candidates) {
+		if (distances[candidate] < distances[best]) {
+			best = candidate;
+		}
+	}
+	waypoint = (best == goal || tile == goal) ? destination : getCenter(best);
+	return true;
+}
+
+bool Game::Pathfinder::Path::getWaypoint(const Vector2<SIUnit::Position>& position, const Vector2<SIUnit::Position>& destination, Vector2<SIUnit::Position>& waypoint) const {
+	const TileType tile = getTile(position);
+	std::vector<std::pair<TileType, std::uint32_t> >::const_iterator found = std::lower_bound(order.begin(), order.end(), std::make_pair(tile, (std::uint32_t) 0));
+	if (tile == noTile || found == order.end() || found->first != tile) {
+		return false;
+	}
+	const std::uint32_t next = found->second + 1;
+	waypoint = (next >= tiles.size() || tiles[next] == goal) ? destination : getCenter(tiles[next]);
+	return true;
+}
+
+Game::Pathfinder::Pathfinder():
+	sizeX(0),
+	sizeY(0),
+	regionsX(0),
+	changeCount(0),
+	graphChanged(false) {
+}
+
+void Game::Pathfinder::setMap(const Map& map) {
+	sizeX = map.getSizeX();
+	sizeY = map.getSizeY();
+	walkable.assign(sizeX * sizeY, false);
+	for (TileType y = 0; y < sizeY; ++y) {
+		for (TileType x = 0; x < sizeX; ++x) {
+			walkable[x + y * sizeX] = map(x, y).ground;
+		}
+	}
+	regionsX = (sizeX + regionSize - 1) / regionSize;
+	regionChanges.assign(regionsX * ((sizeY + regionSize - 1) / regionSize), 0);
+	visitedRegions.assign(regionChanges.size(), false);
+	costs.assign(walkable.size(), FlowField::unreachable);
+	parents.assign(walkable.size(), noTile);
+	flowFields.clear();
+	paths.clear();
+	graph.clear();
+	graphChanged = false;
+}
+
+void Game::Pathfinder::loadGraph(const std::string& cachePath) {
+	const std::uint64_t tileHash = hashTiles();
+	try {
+		if (::Path::exists(cachePath) && graph.deserialize(::Path::readFile(cachePath), sizeX, sizeY, regionSize, tileHash)) {
+			graphChanged = false;
+			return;
+		}
+	} catch (std::runtime_error& e) {
+		// A broken cache is simply replaced.
+	}
+
+	buildGraph();
+	::Path::mkdirForFile(cachePath);
+	try {
+		// Many games may build the graph at once; each replaces the whole file.
+		::Path::writeFile(cachePath, graph.serialize());
+	} catch (std::runtime_error& e) {
+		// The graph is simply built again next time.
+	}
+}
+
+void Game::Pathfinder::buildGraph() {
+	// Find the entrances: runs of walkable tile pairs across region borders.
+	std::vector<TileType> nodeTiles;
+	std::vector<std::pair<TileType, TileType> > entrances;
+	for (int vertical = 0; vertical < 2; ++vertical) {
+		// Along the border, i runs across and j along; a is the tile before the border and b after it.
+		const TileType sizeI = vertical ? sizeX : sizeY;
+		const TileType sizeJ = vertical ? sizeY : sizeX;
+		const TileType stepI = vertical ? 1 : sizeX;
+		const TileType stepJ = vertical ? sizeX : 1;
+		for (TileType i = regionSize; i < sizeI; i += regionSize) {
+			TileType j = 0;
+			while (j < sizeJ) {
+				const TileType a = (i - 1) * stepI + j * stepJ;
+				if (!walkable[a] || !walkable[a + stepI]) {
+					++j;
+					continue;
+				}
+				// The run ends at the end of the region or at a blocked pair.
+				const TileType runEnd = std::min(sizeJ, (j / regionSize + 1) * regionSize);
+				TileType end = j + 1;
+				while (end < runEnd && walkable[(i - 1) * stepI + end * stepJ] && walkable[i * stepI + end * stepJ]) {
+					++end;
+				}
+				const TileType middle = (i - 1) * stepI + (j + end - 1) / 2 * stepJ;
+				entrances.push_back(std::make_pair(middle, middle + stepI));
+				nodeTiles.push_back(middle);
+				nodeTiles.push_back(middle + stepI);
+				j = end;
+			}
+		}
+	}
+
+	// The graph wants the nodes by region and then by tile.
+	std::vector<std::pair<std::uint32_t, TileType> > sortedTiles;
+	for (TileType tile: nodeTiles) {
+		sortedTiles.push_back(std::make_pair(getRegion(tile), tile));
+	}
+	std::sort(sortedTiles.begin(), sortedTiles.end());
+	sortedTiles.erase(std::unique(sortedTiles.begin(), sortedTiles.end()), sortedTiles.end());
+	nodeTiles.clear();
+	for (const std::pair<std::uint32_t, TileType>& tile: sortedTiles) {
+		nodeTiles.push_back(tile.second);
+	}
+	std::vector<std::pair<PathGraph::NodeType, PathGraph::Edge> > edgeList;
+	graph.build(sizeX, sizeY, regionSize, hashTiles(), nodeTiles, edgeList);
+
+	// Connect the two sides of each entrance.
+	for (const std::pair<TileType, TileType>& entrance: entrances) {
+		const PathGraph::NodeType a = graph.findNode(entrance.first), b = graph.findNode(entrance.second);
+		const PathGraph::Edge ab = {b, straightCost}, ba = {a, straightCost};
+		edgeList.push_back(std::make_pair(a, ab));
+		edgeList.push_back(std::make_pair(b, ba));
+	}
+
+	// Connect the nodes of each region with the paths inside it.
+	for (std::uint32_t region = 0; region < regionChanges.size(); ++region) {
+		const Area area = getRegionArea(region);
+		PathGraph::NodeType begin, end;
+		graph.getClusterNodes(region, begin, end);
+		for (PathGraph::NodeType a = begin; a < end; ++a) {
+			searchArea(graph.getTile(a), area);
+			for (PathGraph::NodeType b = begin; b < end; ++b) {
+				if (b != a && costs[graph.getTile(b)] != FlowField::unreachable) {
+					const PathGraph::Edge edge = {b, costs[graph.getTile(b)]};
+					edgeList.push_back(std::make_pair(a, edge));
+				}
+			}
+		}
+	}
+	graph.build(sizeX, sizeY, regionSize, hashTiles(), nodeTiles, edgeList);
+	graphChanged = false;
+}
+
+std::uint64_t Game::Pathfinder::hashTiles() const {
+	// FNV-1a.
+	std::uint64_t hash = 0xcbf29ce484222325ull;
+	const std::uint64_t sizes[2] = {sizeX, sizeY};
+	for (std::uint64_t size: sizes) {
+		hash = (hash ^ size) * 0x100000001b3ull;
+	}
+	for (char tile: walkable) {
+		hash = (hash ^ (unsigned char) tile) * 0x100000001b3ull;
+	}
+	return hash;
+}
+
+Game::Pathfinder::TileType Game::Pathfinder::getTile(const Vector2<SIUnit::Position>& position) const {
+	return findTile(position, sizeX, sizeY);
+}
+
+void Game::Pathfinder::setWalkable(TileType x, TileType y, bool value) {
+	if (x >= sizeX || y >= sizeY || walkable[x + y * sizeX] == value) {
+		return;
+	}
+	walkable[x + y * sizeX] = value;
+	regionChanges[getRegion(x + y * sizeX)] = ++changeCount;
+	graphChanged = true;
+}
+
+bool Game::Pathfinder::isCurrent(const Route& route) const {
+	for (std::uint32_t region: route.regions) {
+		if (regionChanges[region] > route.changeCount) {
+			return false;
+		}
+	}
+	return true;
+}
+
+Game::Pathfinder::Area Game::Pathfinder::getMapArea() const {
+	const Area area = {0, 0, sizeX, sizeY};
+	return area;
+}
+
+Game::Pathfinder::Area Game::Pathfinder::getRegionArea(std::uint32_t region) const {
+	const TileType x0 = region % regionsX * regionSize, y0 = region / regionsX * regionSize;
+	const Area area = {x0, y0, std::min(sizeX, x0 + regionSize), std::min(sizeY, y0 + regionSize)};
+	return area;
+}
+
+unsigned int Game::Pathfinder::getNeighbours(TileType tile, const Area& area, TileType neighbours[8], std::uint32_t moveCosts[8]) const {
+	const TileType x = tile % sizeX, y = tile / sizeX;
+	const bool left = x > area.x0 && walkable[tile - 1];
+	const bool right = x + 1 < area.x1 && walkable[tile + 1];
+	const bool up = y > area.y0 && walkable[tile - sizeX];
+	const bool down = y + 1 < area.y1 && walkable[tile + sizeX];
+	unsigned int count = 0;
+	if (left) {
+		neighbours[count] = tile - 1;
+		moveCosts[count++] = straightCost;
+	}
+	if (right) {
+		neighbours[count] = tile + 1;
+		moveCosts[count++] = straightCost;
+	}
+	if (up) {
+		neighbours[count] = tile - sizeX;
+		moveCosts[count++] = straightCost;
+	}
+	if (down) {
+		neighbours[count] = tile + sizeX;
+		moveCosts[count++] = straightCost;
+	}
+	// Diagonal moves may not cut corners.
+	if (left && up && walkable[tile - sizeX - 1]) {
+		neighbours[count] = tile - sizeX - 1;
+		moveCosts[count++] = diagonalCost;
+	}
+	if (right && up && walkable[tile - sizeX + 1]) {
+		neighbours[count] = tile - sizeX + 1;
+		moveCosts[count++] = diagonalCost;
+	}
+	if (left && down && walkable[tile + sizeX - 1]) {
+		neighbours[count] = tile + sizeX - 1;
+		moveCosts[count++] = diagonalCost;
+	}
+	if (right && down && walkable[tile + sizeX + 1]) {
+		neighbours[count] = tile + sizeX + 1;
+		moveCosts[count++] = diagonalCost;
+	}
+	return count;
+}
+
+void Game::Pathfinder::resetSearch(const Area& area) {
+	for (TileType y = area.y0; y < area.y1; ++y) {
+		std::fill(costs.begin() + y * sizeX + area.x0, costs.begin() + y * sizeX + area.x1, FlowField::unreachable);
+	}
+	open.clear();
+}
+
+void Game::Pathfinder::finishRoute(Route& route, TileType goal) const {
+	route.sizeX = sizeX;
+	route.sizeY = sizeY;
+	route.goal = goal;
+	route.changeCount = changeCount;
+	for (std::uint32_t i = 0; i < visitedRegions.size(); ++i) {
+		if (visitedRegions[i]) {
+			route.regions.push_back(i);
+		}
+	}
+}
+
+void Game::Pathfinder::searchArea(TileType start, const Area& area) {
+	resetSearch(area);
+	costs[start] = 0;
+	open.push_back(std::make_pair(0, start));
+	visit(start);
+
+	// Dijkstra's algorithm; old entries in the heap are skipped.
+	TileType neighbours[8];
+	std::uint32_t moveCosts[8];
+	while (!open.empty()) {
+		std::pop_heap(open.begin(), open.end(), std::greater<std::pair<std::uint32_t, TileType> >());
+		const std::pair<std::uint32_t, TileType> current = open.back();
+		open.pop_back();
+		if (current.first != costs[current.second]) {
+			continue;
+		}
+		const unsigned int count = getNeighbours(current.second, area, neighbours, moveCosts);
+		for (unsigned int i = 0; i < count; ++i) {
+			const std::uint32_t cost = current.first + moveCosts[i];
+			if (cost < costs[neighbours[i]]) {
+				costs[neighbours[i]] = cost;
+				open.push_back(std::make_pair(cost, neighbours[i]));
+				std::push_heap(open.begin(), open.end(), std::greater<std::pair<std::uint32_t, TileType> >());
+				visit(neighbours[i]);
+			}
+		}
+	}
+}
+
+bool Game::Pathfinder::searchPath(TileType start, TileType goal, const Area& area, std::vector<TileType>& tiles) {
+	resetSearch(area);
+	costs[start] = 0;
+	parents[start] = noTile;
+	open.push_back(std::make_pair(estimateCost(start, goal, sizeX), start));
+	visit(start);
+
+	// A*; old entries in the heap are skipped.
+	TileType neighbours[8];
+	std::uint32_t moveCosts[8];
+	bool found = false;
+	while (!open.empty()) {
+		std::pop_heap(open.begin(), open.end(), std::greater<std::pair<std::uint32_t, TileType> >());
+		const std::pair<std::uint32_t, TileType> current = open.back();
+		open.pop_back();
+		if (current.second == goal) {
+			found = true;
+			break;
+		}
+		if (current.first != costs[current.second] + estimateCost(current.second, goal, sizeX)) {
+			continue;
+		}
+		const unsigned int count = getNeighbours(current.second, area, neighbours, moveCosts);
+		for (unsigned int i = 0; i < count; ++i) {
+			const TileType next = neighbours[i];
+			const std::uint32_t cost = costs[current.second] + moveCosts[i];
+			if (cost >= costs[next]) {
+				continue;
+			}
+			costs[next] = cost;
+			parents[next] = current.second;
+			open.push_back(std::make_pair(cost + estimateCost(next, goal, sizeX), next));
+			std::push_heap(open.begin(), open.end(), std::greater<std::pair<std::uint32_t, TileType> >());
+			visit(next);
+		}
+	}
+	if (!found) {
+		return false;
+	}
+
+	const std::vector<TileType>::size_type first = tiles.size();
+	for (TileType tile = goal; tile != start; tile = parents[tile]) {
+		tiles.push_back(tile);
+	}
+	std::reverse(tiles.begin() + first, tiles.end());
+	return true;
+}
+
+bool Game::Pathfinder::searchGraph(TileType start, TileType goal, std::vector<TileType>& tiles) {
+	const PathGraph::NodeType nodeCount = graph.size();
+	const PathGraph::NodeType startNode = nodeCount, goalNode = nodeCount + 1;
+	PathGraph::NodeType begin, end;
+
+	// Connect the start and the goal to the nodes of their regions.
+	startEdges.clear();
+	searchArea(start, getRegionArea(getRegion(start)));
+	graph.getClusterNodes(getRegion(start), begin, end);
+	for (PathGraph::NodeType i = begin; i < end; ++i) {
+		if (costs[graph.getTile(i)] != FlowField::unreachable) {
+			const PathGraph::Edge edge = {i, costs[graph.getTile(i)]};
+			startEdges.push_back(edge);
+		}
+	}
+	goalCosts.assign(nodeCount, FlowField::unreachable);
+	searchArea(goal, getRegionArea(getRegion(goal)));
+	graph.getClusterNodes(getRegion(goal), begin, end);
+	for (PathGraph::NodeType i = begin; i < end; ++i) {
+		goalCosts[i] = costs[graph.getTile(i)];
+	}
+
+	// A* on the graph; old entries in the heap are skipped.
+	nodeCosts.assign(nodeCount + 2, FlowField::unreachable);
+	nodeParents.assign(nodeCount + 2, startNode);
+	nodeCosts[startNode] = 0;
+	open.clear();
+	open.push_back(std::make_pair(estimateCost(start, goal, sizeX), startNode));
+	bool found = false;
+	while (!open.empty()) {
+		std::pop_heap(open.begin(), open.end(), std::greater<std::pair<std::uint32_t, PathGraph::NodeType> >());
+		const std::pair<std::uint32_t, PathGraph::NodeType> current = open.back();
+		open.pop_back();
+		if (current.second == goalNode) {
+			found = true;
+			break;
+		}
+		const TileType tile = current.second == startNode ? start : graph.getTile(current.second);
+		if (current.first != nodeCosts[current.second] + estimateCost(tile, goal, sizeX)) {
+			continue;
+		}
+		visit(tile);
+
+		const PathGraph::Edge *edge, *edgesEnd;
+		if (current.second == startNode) {
+			edge = startEdges.data();
+			edgesEnd = edge + startEdges.size();
+		} else {
+			graph.getEdges(current.second, edge, edgesEnd);
+			// The goal is the last edge of the nodes in its region.
+			if (goalCosts[current.second] != FlowField::unreachable) {
+				const std::uint32_t cost = nodeCosts[current.second] + goalCosts[current.second];
+				if (cost < nodeCosts[goalNode]) {
+					nodeCosts[goalNode] = cost;
+					nodeParents[goalNode] = current.second;
+					open.push_back(std::make_pair(cost, goalNode));
+					std::push_heap(open.begin(), open.end(), std::greater<std::pair<std::uint32_t, PathGraph::NodeType> >());
+				}
+			}
+		}
+		for (; edge != edgesEnd; ++edge) {
+			const std::uint32_t cost = nodeCosts[current.second] + edge->cost;
+			if (cost >= nodeCosts[edge->node]) {
+				continue;
+			}
+			nodeCosts[edge->node] = cost;
+			nodeParents[edge->node] = current.second;
+			open.push_back(std::make_pair(cost + estimateCost(graph.getTile(edge->node), goal, sizeX), edge->node));
+			std::push_heap(open.begin(), open.end(), std::greater<std::pair<std::uint32_t, PathGraph::NodeType> >());
+		}
+	}
+	if (!found) {
+		return false;
+	}
+
+	// Refine each step inside its region; the steps across borders are single moves.
+	std::vector<TileType> waypoints(1, goal);
+	for (PathGraph::NodeType node = nodeParents[goalNode]; node != startNode; node = nodeParents[node]) {
+		waypoints.push_back(graph.getTile(node));
+	}
+	waypoints.push_back(start);
+	std::reverse(waypoints.begin(), waypoints.end());
+	for (std::vector<TileType>::size_type i = 1; i < waypoints.size(); ++i) {
+		const TileType from = waypoints[i - 1], to = waypoints[i];
+		if (from == to) {
+			continue;
+		}
+		if (getRegion(from) != getRegion(to)) {
+			tiles.push_back(to);
+		} else if (!searchPath(from, to, getRegionArea(getRegion(from)), tiles)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+std::shared_ptr<const Game::Pathfinder::FlowField> Game::Pathfinder::computeFlowField(TileType goal) {
+	clearVisited();
+	searchArea(goal, getMapArea());
+	std::shared_ptr<FlowField> field(new FlowField);
+	field->distances = costs;
+	finishRoute(*field, goal);
+	return field;
+}
+
+std::shared_ptr<const Game::Pathfinder::Path> Game::Pathfinder::computePath(TileType start, TileType goal) {
+	if (graphChanged) {
+		buildGraph();
+	}
+
+	// Regions that touch are close enough for a search on the tiles.
+	clearVisited();
+	std::shared_ptr<Path> path(new Path);
+	path->tiles.push_back(start);
+	const TileType dx = std::max(start % sizeX, goal % sizeX) / regionSize - std::min(start % sizeX, goal % sizeX) / regionSize;
+	const TileType dy = std::max(start / sizeX, goal / sizeX) / regionSize - std::min(start / sizeX, goal / sizeX) / regionSize;
+	const bool found = (graph.empty() || (dx <= 1 && dy <= 1))
+		? searchPath(start, goal, getMapArea(), path->tiles)
+		: searchGraph(start, goal, path->tiles);
+	if (!found) {
+		return std::shared_ptr<const Path>();
+	}
+
+	// If the path visits a tile twice, the later visit is used, so the loop is skipped.
+	for (std::uint32_t i = 0; i < path->tiles.size(); ++i) {
+		path->order.push_back(std::make_pair(path->tiles[i], i));
+	}
+	std::sort(path->order.begin(), path->order.end());
+	std::vector<std::pair<TileType, std::uint32_t> >::iterator last = path->order.begin();
+	for (std::vector<std::pair<TileType, std::uint32_t> >::iterator i = path->order.begin(); i != path->order.end(); ++i) {
+		if (last->first == i->first) {
+			*last = *i;
+		} else {
+			*++last = *i;
+		}
+	}
+	path->order.erase(last + 1, path->order.end());
+	finishRoute(*path, goal);
+	return path;
+}
+
+template <typename K, typename V> void Game::Pathfinder::trimCache(std::map<K, std::shared_ptr<const V> >& routes) const {
+	if (routes.size() <= maxCachedRoutes) {
+		return;
+	}
+	typename std::map<K, std::shared_ptr<const V> >::iterator i = routes.begin();
+	while (i != routes.end()) {
+		if (i->second.use_count() == 1 || !isCurrent(*i->second)) {
+			routes.erase(i++);
+		} else {
+			++i;
+		}
+	}
+}
+
+std::shared_ptr<const Game::Pathfinder::FlowField> Game::Pathfinder::getFlowField(const Vector2<SIUnit::Position>& destination) {
+	const TileType goal = getTile(destination);
+	if (!isWalkable(goal)) {
+		return std::shared_ptr<const FlowField>();
+	}
+	std::shared_ptr<const FlowField>& field = flowFields[goal];
+	if (!field || !isCurrent(*field)) {
+		field = computeFlowField(goal);
+	}
+	std::shared_ptr<const FlowField> result(field);
+	trimCache(flowFields);
+	return result;
+}
+
+std::shared_ptr<const Game::Pathfinder::Path> Game::Pathfinder::getPath(TileType start, TileType goal) {
+	if (!isWalkable(start) || !isWalkable(goal)) {
+		return std::shared_ptr<const Path>();
+	}
+	const std::pair<TileType, TileType> key(start, goal);
+	std::map<std::pair<TileType, TileType>, std::shared_ptr<const Path> >::iterator found = paths.find(key);
+	if (found != paths.end() && isCurrent(*found->second)) {
+		return found->second;
+	}
+	std::shared_ptr<const Path> path(computePath(start, goal));
+	if (!path) {
+		// Failures aren't cached; they would have no regions to invalidate them.
+		if (found != paths.end()) {
+			paths.erase(found);
+		}
+		return path;
+	}
+	paths[key] = path;
+	trimCache(paths);
+	return path;
+}
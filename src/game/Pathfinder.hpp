@@ -0,0 +1,430 @@
+#ifndef PUTKARTS_Game_Pathfinder_HPP
+#define PUTKARTS_Game_Pathfinder_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <memory>
+
+#include "util/Scalar.hpp"
+#include "util/Vector2.hpp"
+#include "PathGraph.hpp"
+
+namespace Game {
+	class Map;
+	class Pathfinder;
+}
+
+/**
+ * Route planning on the tile grid of the map.
+ *
+ * The map is reduced to a bitmap of walkable tiles (ground tiles), and
+ * objects move from the center of one tile to the next, diagonally only
+ * if neither corner is blocked. A single object gets an A* path; a group
+ * with a common destination shares one flow field, which tells the way
+ * to the destination from every tile.
+ *
+ * Paths between distant regions are first searched on a PathGraph whose
+ * clusters are the regions, and then refined with A* inside each cluster.
+ * The graph can be saved in a cache file for the next game on the map.
+ *
+ * The routes are cached by their tiles. Each route remembers the regions
+ * of the map it looked at, and a change in the walkability of a region
+ * makes those routes stale. Everything is computed with integer costs,
+ * so the routes are the same on every computer.
+ */
+class Game::Pathfinder {
+public:
+	/** Type for tile indices, x + y * width. */
+	typedef std::uint32_t TileType;
+
+	/** Index that refers to no tile. */
+	static const TileType noTile = 0xffffffffu;
+
+	/** The width and height of a region, in tiles. */
+	static const unsigned int regionSize = 16;
+
+	/** The number of cached routes of each kind that are kept when no task uses them. */
+	static const std::size_t maxCachedRoutes = 64;
+
+	/**
+	 * A planned route to a destination tile.
+	 */
+	class Route {
+		friend class Pathfinder;
+
+	protected:
+		/** The width of the map. */
+		TileType sizeX;
+
+		/** The height of the map. */
+		TileType sizeY;
+
+		/** The destination tile. */
+		TileType goal;
+
+		/** The regions whose walkability the route depends on. */
+		std::vector<std::uint32_t> regions;
+
+		/** The value of the change counter when the route was made. */
+		std::uint64_t changeCount;
+
+		/**
+		 * Get the tile at a position.
+		 *
+		 * @param position The position.
+		 * @return The tile, or noTile if the position is outside the map.
+		 */
+		TileType getTile(const Vector2<SIUnit::Position>& position) const;
+
+		/**
+		 * Get the center of a tile.
+		 *
+		 * @param tile The tile.
+		 */
+		Vector2<SIUnit::Position> getCenter(TileType tile) const {
+			return Vector2<SIUnit::Position>(Scalar<SIUnit::Position>(tile % sizeX + 0.5), Scalar<SIUnit::Position>(tile / sizeX + 0.5));
+		}
+
+	public:
+		/**
+		 * Constructor.
+		 */
+		Route():
+			sizeX(0),
+			sizeY(0),
+			goal(noTile),
+			changeCount(0) {
+		}
+
+		/**
+		 * Destructor.
+		 */
+		virtual ~Route() {
+		}
+
+		/**
+		 * Get the tile the route was planned from.
+		 *
+		 * @return The start tile, or noTile if the route works from anywhere.
+		 */
+		virtual TileType getStart() const = 0;
+
+		/**
+		 * Get the next point to move to.
+		 *
+		 * @param position The current position.
+		 * @param destination The exact destination in the goal tile.
+		 * @param waypoint The point is stored here.
+		 * @return false if the position is not on the route.
+		 */
+		virtual bool getWaypoint(const Vector2<SIUnit::Position>& position, const Vector2<SIUnit::Position>& destination, Vector2<SIUnit::Position>& waypoint) const = 0;
+	};
+
+	/**
+	 * The distance to the destination from every tile.
+	 */
+	class FlowField: public Route {
+		friend class Pathfinder;
+
+		/** The distance of each tile, or unreachable. */
+		std::vector<std::uint32_t> distances;
+
+	public:
+		/** The distance of tiles that have no way to the destination. */
+		static const std::uint32_t unreachable = 0xffffffffu;
+
+		virtual TileType getStart() const {
+			return noTile;
+		}
+
+		virtual bool getWaypoint(const Vector2<SIUnit::Position>& position, const Vector2<SIUnit::Position>& destination, Vector2<SIUnit::Position>& waypoint) const;
+	};
+
+	/**
+	 * A path of tiles from one tile to another.
+	 */
+	class Path: public Route {
+		friend class Pathfinder;
+
+		/** The tiles, from the start to the goal. */
+		std::vector<TileType> tiles;
+
+		/** The tiles with their indices in the path, sorted by tile. */
+		std::vector<std::pair<TileType, std::uint32_t> > order;
+
+	public:
+		virtual TileType getStart() const {
+			return tiles.front();
+		}
+
+		virtual bool getWaypoint(const Vector2<SIUnit::Position>& position, const Vector2<SIUnit::Position>& destination, Vector2<SIUnit::Position>& waypoint) const;
+	};
+
+private:
+	/** A rectangle of tiles for limiting a search. */
+	struct Area {
+		/** The first tile coordinates. */
+		TileType x0, y0;
+
+		/** The coordinates after the last tile. */
+		TileType x1, y1;
+	};
+
+	/** The width of the map. */
+	TileType sizeX;
+
+	/** The height of the map. */
+	TileType sizeY;
+
+	/** Is each tile walkable? */
+	std::vector<char> walkable;
+
+	/** The number of regions in the x direction. */
+	std::uint32_t regionsX;
+
+	/** The value of the change counter when each region last changed. */
+	std::vector<std::uint64_t> regionChanges;
+
+	/** Counter of walkability changes. */
+	std::uint64_t changeCount;
+
+	/** Flow fields by goal tile. */
+	std::map<TileType, std::shared_ptr<const FlowField> > flowFields;
+
+	/** Paths by start and goal tile. */
+	std::map<std::pair<TileType, TileType>, std::shared_ptr<const Path> > paths;
+
+	/** Search state: the cost of each tile so far. */
+	std::vector<std::uint32_t> costs;
+
+	/** Search state: the tile each tile was reached from. */
+	std::vector<TileType> parents;
+
+	/** Search state: the open tiles by estimated cost. */
+	std::vector<std::pair<std::uint32_t, TileType> > open;
+
+	/** Search state: the regions that have been looked at. */
+	std::vector<char> visitedRegions;
+
+	/** The abstract graph, with the regions as clusters. */
+	PathGraph graph;
+
+	/** Has the walkability changed since the graph was built? */
+	bool graphChanged;
+
+	/** Graph search state: the cost of each node so far; the start and the goal are the last two. */
+	std::vector<std::uint32_t> nodeCosts;
+
+	/** Graph search state: the node each node was reached from. */
+	std::vector<PathGraph::NodeType> nodeParents;
+
+	/** Graph search state: the cost from each node of the goal's cluster to the goal. */
+	std::vector<std::uint32_t> goalCosts;
+
+	/** Graph search state: the edges from the start. */
+	std::vector<PathGraph::Edge> startEdges;
+
+	/**
+	 * Get the region of a tile.
+	 *
+	 * @param tile The tile.
+	 */
+	std::uint32_t getRegion(TileType tile) const {
+		return (tile % sizeX) / regionSize + (tile / sizeX) / regionSize * regionsX;
+	}
+
+	/**
+	 * Get the area of the whole map.
+	 */
+	Area getMapArea() const;
+
+	/**
+	 * Get the area of a region.
+	 *
+	 * @param region The region.
+	 */
+	Area getRegionArea(std::uint32_t region) const;
+
+	/**
+	 * Find the neighbours that can be entered from a tile.
+	 *
+	 * @param tile The tile.
+	 * @param area The area the neighbours must be in.
+	 * @param neighbours The neighbours are stored here.
+	 * @param moveCosts The costs of the moves are stored here.
+	 * @return The number of neighbours.
+	 */
+	unsigned int getNeighbours(TileType tile, const Area& area, TileType neighbours[8], std::uint32_t moveCosts[8]) const;
+
+	/**
+	 * Prepare the search state for a new search in an area.
+	 *
+	 * @param area The area.
+	 */
+	void resetSearch(const Area& area);
+
+	/**
+	 * Forget the visited regions, before the searches for a new route.
+	 */
+	void clearVisited() {
+		std::fill(visitedRegions.begin(), visitedRegions.end(), false);
+	}
+
+	/**
+	 * Compute the costs from a tile to all tiles of an area with Dijkstra's algorithm.
+	 *
+	 * @param start The start tile, walkable and in the area.
+	 * @param area The area.
+	 */
+	void searchArea(TileType start, const Area& area);
+
+	/**
+	 * Find a path in an area with A*.
+	 *
+	 * @param start The start tile, walkable and in the area.
+	 * @param goal The goal tile, walkable and in the area.
+	 * @param area The area.
+	 * @param tiles The tiles after the start are appended here.
+	 * @return false if there is no path.
+	 */
+	bool searchPath(TileType start, TileType goal, const Area& area, std::vector<TileType>& tiles);
+
+	/**
+	 * Find a path on the abstract graph and refine it inside the clusters.
+	 *
+	 * @param start The start tile, walkable.
+	 * @param goal The goal tile, walkable.
+	 * @param tiles The tiles after the start are appended here.
+	 * @return false if there is no path.
+	 */
+	bool searchGraph(TileType start, TileType goal, std::vector<TileType>& tiles);
+
+	/**
+	 * Compute a hash of the size and the walkable tiles, for checking the graph cache.
+	 */
+	std::uint64_t hashTiles() const;
+
+	/**
+	 * Mark the region of a tile as looked at.
+	 *
+	 * @param tile The tile.
+	 */
+	void visit(TileType tile) {
+		visitedRegions[getRegion(tile)] = true;
+	}
+
+	/**
+	 * Copy the map size and the visited regions to a route and mark it current.
+	 *
+	 * @param route The route.
+	 * @param goal The goal tile.
+	 */
+	void finishRoute(Route& route, TileType goal) const;
+
+	/**
+	 * Compute a flow field with Dijkstra's algorithm from the goal.
+	 *
+	 * @param goal The goal tile, walkable.
+	 * @return The flow field.
+	 */
+	std::shared_ptr<const FlowField> computeFlowField(TileType goal);
+
+	/**
+	 * Compute a path with A*, or on the graph if the tiles are far apart.
+	 *
+	 * @param start The start tile, walkable.
+	 * @param goal The goal tile, walkable.
+	 * @return The path, or NULL if there is none.
+	 */
+	std::shared_ptr<const Path> computePath(TileType start, TileType goal);
+
+	/**
+	 * Drop unused and stale routes if there are too many.
+	 *
+	 * @param routes The cache.
+	 */
+	template <typename K, typename V> void trimCache(std::map<K, std::shared_ptr<const V> >& routes) const;
+
+public:
+	/**
+	 * Constructor; the map is empty until setMap is called.
+	 */
+	Pathfinder();
+
+	/**
+	 * Build the walkability bitmap from a map and clear the caches.
+	 *
+	 * @param map The map.
+	 */
+	void setMap(const Map& map);
+
+	/**
+	 * Build the abstract graph, or load it from a cache file if the file is for the same tiles.
+	 *
+	 * A new graph is saved to the file; failing to save is not an error.
+	 *
+	 * @param cachePath The path of the cache file.
+	 */
+	void loadGraph(const std::string& cachePath);
+
+	/**
+	 * Build the abstract graph from the current tiles.
+	 */
+	void buildGraph();
+
+	/**
+	 * Get the tile at a position.
+	 *
+	 * @param position The position.
+	 * @return The tile, or noTile if the position is outside the map.
+	 */
+	TileType getTile(const Vector2<SIUnit::Position>& position) const;
+
+	/**
+	 * Is a tile walkable?
+	 *
+	 * @param tile The tile, or noTile.
+	 */
+	bool isWalkable(TileType tile) const {
+		return tile != noTile && walkable[tile];
+	}
+
+	/**
+	 * Change the walkability of a tile, e.g. for a building; the routes through its region become stale.
+	 *
+	 * @param x The x coordinate of the tile.
+	 * @param y The y coordinate of the tile.
+	 * @param value Is the tile walkable?
+	 */
+	void setWalkable(TileType x, TileType y, bool value);
+
+	/**
+	 * Is a route still valid, i.e. has none of its regions changed?
+	 *
+	 * @param route The route.
+	 */
+	bool isCurrent(const Route& route) const;
+
+	/**
+	 * Get the flow field to the tile of a destination, from the cache if possible.
+	 *
+	 * @param destination The destination.
+	 * @return The flow field, or NULL if the destination is not walkable.
+	 */
+	std::shared_ptr<const FlowField> getFlowField(const Vector2<SIUnit::Position>& destination);
+
+	/**
+	 * Get a path between two tiles, from the cache if possible.
+	 *
+	 * @param start The start tile.
+	 * @param goal The goal tile.
+	 * @return The path, or NULL if there is none.
+	 */
+	std::shared_ptr<const Path> getPath(TileType start, TileType goal);
+};
+
+#endif
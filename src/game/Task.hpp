@@ -1,9 +1,15 @@
 #ifndef PUTKARTS_Game_Task_HPP
 #define PUTKARTS_Game_Task_HPP
 
-#include <list>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
 #include <memory>
 
+#include "util/Vector2.hpp"
+#include "ObjectStore.hpp"
+#include "Pathfinder.hpp"
+
 namespace Game {
 	class Task;
 	class Object;
@@ -12,6 +18,9 @@ namespace Game {
 
 /**
  * This class describes a task that some units are performing.
+ *
+ * The tasks belong to Game, which reuses them, so the lists keep their
+ * memory from one task to the next.
  */
 class Game::Task {
 public:
@@ -19,13 +28,55 @@ public:
 	std::shared_ptr<const ObjectAction> action;
 
 	/** The actor objects. */
-	std::list<std::weak_ptr<Object> > actors;
+	std::vector<ObjectStore::Handle> actors;
 
 	/** The target objects. */
-	std::list<std::weak_ptr<Object> > targets;
+	std::vector<ObjectStore::Handle> targets;
+
+	/**
+	 * The hash of the ids of the targets that the task was given.
+	 *
+	 * It's part of the state hash of the actors. It doesn't change when
+	 * the targets die, so deleting an object needn't rehash anything else.
+	 */
+	std::uint64_t targetHash;
+
+	/** Is there a destination? This is used if there aren't any real targets, e.g. when moving to a location. */
+	bool hasDestination;
+
+	/** The destination. */
+	Vector2<SIUnit::Position> destination;
+
+	/** The route to the destination, or NULL if it can't be reached; planned by Game. */
+	std::shared_ptr<const Pathfinder::Route> route;
+
+	/** The number of objects that have this task; maintained by Game. */
+	std::size_t references;
+
+	/** Is the task in Game's list of routed tasks? Not cleared with the task, as it stays in the list until Game drops it. */
+	bool routeListed;
+
+	/** Constructor. */
+	Task():
+		targetHash(0),
+		hasDestination(false),
+		references(0),
+		routeListed(false) {
+	}
 
-	/** A dummy target. This is used if there aren't any real targets, e.g. when moving to a location. */
-	std::shared_ptr<Object> dummy;
+	/**
+	 * Clear the task for reuse.
+	 */
+	void clear() {
+		action.reset();
+		actors.clear();
+		targets.clear();
+		targetHash = 0;
+		hasDestination = false;
+		destination = Vector2<SIUnit::Position>();
+		route.reset();
+		references = 0;
+	}
 };
 
 #endif
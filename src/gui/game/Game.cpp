@@ -1,6 +1,7 @@
 #include <algorithm>
 #include <cmath>
 #include <functional>
+#include <vector>
 
 #include "util/Path.hpp"
 
@@ -37,14 +38,17 @@ GUI::Game::Game::Game(std::shared_ptr<Connection::Client> client_, sf::RenderWin
 void GUI::Game::Game::drawGame(sf::RenderWindow& window) const {
 	window.draw(map);
 
-	// TODO: Get only visible objects! Maybe use something like game.forEachObject(rectangle, callback).
-	const ::Game::Game& game = client->getGame();
-	const ::Game::Game::ObjectContainerType& objects = game.getObjects();
-	for (::Game::Game::ObjectContainerType::const_iterator i = objects.begin(); i != objects.end(); ++i) {
-		std::shared_ptr<Object> object(getObject(i->second));
-		bool selected = selectedObjects.find(object) != selectedObjects.end();
-		object->draw(window, client->getClientInfo(), selected);
-	}
+	// Draw only the objects that are visible.
+	sf::Vector2f center(gameView.getCenter()), size(gameView.getSize());
+	Vector2<SIUnit::Position> min(center.x - size.x / 2, center.y - size.y / 2);
+	Vector2<SIUnit::Position> max(center.x + size.x / 2, center.y + size.y / 2);
+	client->getGame().forEachObject(min, max, std::bind(&Game::drawObject, this, std::ref(window), std::placeholders::_1));
+}
+
+void GUI::Game::Game::drawObject(sf::RenderWindow& window, const std::shared_ptr< ::Game::Object>& gameObject) const {
+	std::shared_ptr<Object> object(getObject(gameObject));
+	bool selected = selectedObjects.find(object) != selectedObjects.end();
+	object->draw(window, client->getClientInfo(), selected);
 }
 
 void GUI::Game::Game::exit() {
@@ -172,17 +176,25 @@ std::shared_ptr<GUI::Game::Object> GUI::Game::Game::getObject(const std::shared_
 	return i->second;
 }
 
+/**
+ * Collect objects into a vector; used with Game::Game::forEachObject.
+ *
+ * @param result The vector.
+ * @param object The object to add.
+ */
+static void collectObject(std::vector<std::shared_ptr< ::Game::Object> >& result, const std::shared_ptr< ::Game::Object>& object) {
+	result.push_back(object);
+}
+
 GUI::Game::Game::ObjectSetType GUI::Game::Game::getObjectsWithinRange(Vector2<SIUnit::Position> position, Scalar<SIUnit::Length> range, int howMany) {
-	const ::Game::Game& game = client->getGame();
-	const ::Game::Game::ObjectContainerType& objects = game.getObjects();
+	std::vector<std::shared_ptr< ::Game::Object> > found;
+	client->getGame().forEachObject(position, range, std::bind(collectObject, std::ref(found), std::placeholders::_1));
 
 	ObjectSetType result;
-	for (::Game::Game::ObjectContainerType::const_iterator i = objects.begin(); i != objects.end(); ++i) {
-		if (i->second->isNear(position, range)) {
-			result.insert(getObject(i->second));
-			if (howMany && !--howMany) {
-				break;
-			}
+	for (std::vector<std::shared_ptr< ::Game::Object> >::const_iterator i = found.begin(); i != found.end(); ++i) {
+		result.insert(getObject(*i));
+		if (howMany && !--howMany) {
+			break;
 		}
 	}
 
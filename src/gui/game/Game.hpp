@@ -83,6 +83,14 @@ class GUI::Game::Game: public Widget::Container {
 	 */
 	ObjectSetType getObjectsWithinRange(Vector2<SIUnit::Position> position, Scalar<SIUnit::Length> range, int howMany = 0);
 
+	/**
+	 * Draw one object.
+	 *
+	 * @param window The window to use for rendering.
+	 * @param object The logical object.
+	 */
+	void drawObject(sf::RenderWindow& window, const std::shared_ptr< ::Game::Object>& object) const;
+
 public:
 	/**
 	 * Constructor.
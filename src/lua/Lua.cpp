@@ -1,6 +1,14 @@
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <limits>
 
 #include "Lua.hpp"
+#include "util/Serializer.hpp"
+#include "util/Deserializer.hpp"
 
 extern "C" {
 	#include <lua.h>
@@ -8,44 +16,255 @@ extern "C" {
 	#include <lualib.h>
 }
 
-Lua::Lua() {
-	state = luaL_newstate();
+/**
+ * A compiled chunk in the cache.
+ */
+struct CompiledChunk {
+	/** The version of the source. */
+	std::time_t version;
+
+	/** The bytecode. */
+	std::shared_ptr<const std::string> bytecode;
+};
+
+/** Lock for the chunk cache. */
+static std::mutex compiledChunksMutex;
+
+/** Compiled chunks by file name or code. */
+static std::unordered_map<std::string, CompiledChunk> compiledChunks;
+
+/** Type tags of serialized values. */
+enum SerializedType {
+	SERIALIZED_NIL, SERIALIZED_FALSE, SERIALIZED_TRUE, SERIALIZED_INTEGER, SERIALIZED_NUMBER, SERIALIZED_STRING, SERIALIZED_TABLE
+};
+
+/** The deepest table nesting that is serialized; deeper tables are probably cyclic. */
+static const int maxSerializedDepth = 64;
+
+/**
+ * Writer function for lua_dump.
+ */
+static int writeChunk(lua_State* state, const void* data, size_t size, void* output) {
+	static_cast<std::string*>(output)->append(static_cast<const char*>(data), size);
+	return 0;
+}
+
+/**
+ * Panic function for errors outside protected calls.
+ */
+static int panic(lua_State* state) {
+	std::cerr << "Lua panic: " << lua_tostring(state, -1) << std::endl;
+	return 0;
+}
+
+Lua::Lua():
+	allocationCount(0),
+	allocatedBytes(0),
+	profiling(false),
+	instructionBudget(0),
+	instructionsUsed(0),
+	budgetActive(false),
+	budgetExceeded(false) {
+	state = lua_newstate(luaAlloc, this);
+	if (!state) {
+		throw Exception("Out of memory for Lua!");
+	}
+	lua_atpanic(state, panic);
 	bind("include", std::bind(&Lua::luaInclude, this));
+	bind("profileBegin", this, &Lua::beginProfileLabel);
+	bind("profileEnd", this, &Lua::endProfileLabel);
 }
 
 Lua::~Lua() {
-	lua_close(state);
+	// Everything is in the memory pool, so there's no need to free the objects one by one.
 }
 
 int Lua::luaThunk(lua_State* state) {
-	Lua& self = *reinterpret_cast<Lua*>(lua_touserdata(state, lua_upvalueindex(1)));
-	Function& func = self.functions.find(lua_tostring(state, lua_upvalueindex(2)))->second;
+	Function& func = *static_cast<Function*>(getClosureData(state));
 
 	try {
 		int args = lua_gettop(state);
 		func();
 		return lua_gettop(state) - args;
 	} catch (Lua::Exception& e) {
-		lua_pushstring(state, e.what());
-		lua_error(state);
-		return 0;
+		return raiseError(state, e.what());
 	}
 }
 
+void* Lua::getClosureData(lua_State* state) {
+	return lua_touserdata(state, lua_upvalueindex(1));
+}
+
+int Lua::raiseError(lua_State* state, const char* message) {
+	lua_pushstring(state, message);
+	return lua_error(state);
+}
+
+void* Lua::pushClosureData(std::size_t size) {
+	return lua_newuserdata(state, size);
+}
+
+void Lua::setClosure(const std::string& name, ThunkType thunk) {
+	lua_pushcclosure(state, thunk, 1);
+	lua_setglobal(state, name.c_str());
+}
+
 void Lua::unbind(const std::string& name) {
-	if (functions.erase(name)) {
-		lua_pushnil(state);
-		lua_setglobal(state, name.c_str());
-	}
+	functions.erase(name);
+	lua_pushnil(state);
+	lua_setglobal(state, name.c_str());
 }
 
 void Lua::bind(const std::string& name, Function function) {
 	unbind(name);
-	functions[name] = function;
-	lua_pushlightuserdata(state, this);
-	lua_pushlstring(state, name.c_str(), name.size());
-	lua_pushcclosure(state, luaThunk, 2);
-	lua_setglobal(state, name.c_str());
+	// The map never moves its elements, so the closure can point straight at the function.
+	Function& stored = functions[name] = function;
+	lua_pushlightuserdata(state, &stored);
+	setClosure(name, luaThunk);
+}
+
+void* Lua::luaAlloc(void* ud, void* ptr, std::size_t osize, std::size_t nsize) {
+	Lua& self = *static_cast<Lua*>(ud);
+	// With a new block, osize is not a size, so don't use it.
+	if (!ptr) {
+		osize = 0;
+	}
+	if (nsize > osize) {
+		++self.allocationCount;
+		self.allocatedBytes += nsize - osize;
+	}
+	return self.memoryPool.reallocate(ptr, osize, nsize);
+}
+
+void Lua::updateHook() {
+	int mask = 0;
+	if (instructionBudget) {
+		mask |= LUA_MASKCOUNT;
+	}
+	if (profiling) {
+		mask |= LUA_MASKCALL | LUA_MASKRET;
+	}
+	lua_sethook(state, mask ? luaHook : 0, mask, budgetStep);
+}
+
+void Lua::setProfiling(bool enabled) {
+	profiling = enabled;
+	if (!profiling) {
+		callStack.clear();
+		labelStack.clear();
+	}
+	updateHook();
+}
+
+void Lua::setInstructionBudget(std::uint64_t instructions) {
+	instructionBudget = instructions;
+	updateHook();
+}
+
+void Lua::startInstructionBudget() {
+	instructionsUsed = 0;
+	budgetActive = true;
+	budgetExceeded = false;
+	updateHook();
+}
+
+void Lua::beginProfileFrame(std::vector<ProfileFrame>& stack, ProfileEntry& entry) {
+	ProfileFrame frame;
+	frame.entry = &entry;
+	frame.allocations = allocationCount;
+	frame.allocatedBytes = allocatedBytes;
+	frame.start = std::chrono::steady_clock::now();
+	stack.push_back(frame);
+}
+
+void Lua::endProfileFrame(std::vector<ProfileFrame>& stack) {
+	// Functions that were running when the profiler was turned on end without a start.
+	if (stack.empty()) {
+		return;
+	}
+	const ProfileFrame& frame = stack.back();
+	ProfileEntry& entry = *frame.entry;
+	entry.calls += 1;
+	entry.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - frame.start).count();
+	entry.allocations += allocationCount - frame.allocations;
+	entry.allocatedBytes += allocatedBytes - frame.allocatedBytes;
+	stack.pop_back();
+}
+
+void Lua::beginProfileLabel(const String& label) {
+	if (profiling) {
+		beginProfileFrame(labelStack, labelProfile[label]);
+	}
+}
+
+void Lua::endProfileLabel() {
+	if (profiling) {
+		endProfileFrame(labelStack);
+	}
+}
+
+void Lua::luaHook(lua_State* state, lua_Debug* ar) {
+	void* ud;
+	lua_getallocf(state, &ud);
+	Lua& self = *static_cast<Lua*>(ud);
+
+	switch (ar->event) {
+		case LUA_HOOKCOUNT:
+			if (self.budgetActive && self.instructionBudget) {
+				self.instructionsUsed += budgetStep;
+				if (self.instructionsUsed > self.instructionBudget) {
+					// Charge the overrun to the innermost label, such as the object type.
+					if (!self.budgetExceeded && !self.labelStack.empty()) {
+						self.labelStack.back().entry->budgetOverruns += 1;
+					}
+					self.budgetExceeded = true;
+					luaL_error(state, "Instruction budget exceeded!");
+				}
+			}
+			break;
+#ifdef LUA_HOOKTAILCALL
+		case LUA_HOOKTAILCALL:
+			// The called function replaces the current one.
+			self.endProfileFrame(self.callStack);
+			// fall through
+#endif
+		case LUA_HOOKCALL: {
+			lua_getinfo(state, "Sn", ar);
+			std::ostringstream key;
+			if (ar->what[0] == 'C') {
+				key << "[C] " << (ar->name ? ar->name : "?");
+			} else {
+				key << ar->short_src << ":" << ar->linedefined;
+			}
+			ProfileEntry& entry = self.functionProfile[key.str()];
+			if (entry.name.empty() && ar->name) {
+				entry.name = ar->name;
+			}
+			self.beginProfileFrame(self.callStack, entry);
+			break;
+		}
+		case LUA_HOOKRET:
+#ifdef LUA_HOOKTAILRET
+		case LUA_HOOKTAILRET:
+#endif
+			self.endProfileFrame(self.callStack);
+			break;
+	}
+}
+
+void Lua::writeProfile(std::ostream& stream) const {
+	stream << "function\tname\tcalls\tseconds\tallocations\tbytes\n";
+	for (ProfileContainerType::const_iterator i = functionProfile.begin(); i != functionProfile.end(); ++i) {
+		const ProfileEntry& entry = i->second;
+		stream << i->first << "\t" << entry.name << "\t" << entry.calls << "\t" << entry.seconds << "\t" << entry.allocations << "\t" << entry.allocatedBytes << "\n";
+	}
+	stream << "memory\tbytes\tpeak\tlimit\n";
+	stream << "Lua\t" << memoryPool.getUsage() << "\t" << memoryPool.getPeakUsage() << "\t" << memoryPool.getLimit() << "\n";
+	stream << "label\tcalls\tseconds\tallocations\tbytes\toverruns\n";
+	for (ProfileContainerType::const_iterator i = labelProfile.begin(); i != labelProfile.end(); ++i) {
+		const ProfileEntry& entry = i->second;
+		stream << i->first << "\t" << entry.calls << "\t" << entry.seconds << "\t" << entry.allocations << "\t" << entry.allocatedBytes << "\t" << entry.budgetOverruns << "\n";
+	}
 }
 
 void Lua::luaInclude() {
@@ -134,10 +353,14 @@ template <> void Lua::push<Lua::String>(const String& value) {
 	lua_pushlstring(state, value.c_str(), value.size());
 }
 
-template <> void Lua::pop() {
+void Lua::discard() {
 	lua_pop(state, 1);
 }
 
+template <> void Lua::pop() {
+	discard();
+}
+
 template <> boost::any Lua::pop() {
 	boost::any result;
 	try {
@@ -151,10 +374,21 @@ template <> boost::any Lua::pop() {
 }
 
 void Lua::call(int nargs, int nresults) {
+	const std::size_t calls = callStack.size(), labels = labelStack.size();
 	int ret = lua_pcall(state, nargs, nresults, 0);
 	if (ret != 0) {
+		// Lua doesn't report the functions that ended with the error.
+		while (callStack.size() > calls) {
+			endProfileFrame(callStack);
+		}
+		while (labelStack.size() > labels) {
+			endProfileFrame(labelStack);
+		}
 		std::string str = get<String>(lua_gettop(state));
 		lua_pop(state, 1);
+		if (budgetActive && budgetExceeded) {
+			throw BudgetException(str);
+		}
 		switch (ret) {
 			case LUA_ERRRUN:
 				throw Exception("LUA_ERRRUN: " + str);
@@ -183,3 +417,190 @@ void Lua::load(const std::string& code, const std::string& context) {
 		}
 	}
 }
+
+bool Lua::loadCompiled(const std::string& key, std::time_t version, const std::string& context) {
+	std::shared_ptr<const std::string> bytecode;
+	{
+		std::lock_guard<std::mutex> lock(compiledChunksMutex);
+		std::unordered_map<std::string, CompiledChunk>::const_iterator i = compiledChunks.find(key);
+		if (i == compiledChunks.end() || i->second.version != version) {
+			return false;
+		}
+		bytecode = i->second.bytecode;
+	}
+	load(*bytecode, context);
+	return true;
+}
+
+void Lua::storeCompiled(const std::string& key, std::time_t version) {
+	std::shared_ptr<std::string> bytecode(new std::string());
+#if LUA_VERSION_NUM >= 503
+	lua_dump(state, writeChunk, bytecode.get(), 0);
+#else
+	lua_dump(state, writeChunk, bytecode.get());
+#endif
+	CompiledChunk chunk;
+	chunk.version = version;
+	chunk.bytecode = bytecode;
+	std::lock_guard<std::mutex> lock(compiledChunksMutex);
+	compiledChunks[key] = chunk;
+}
+
+void Lua::loadFile(const std::string& file) {
+	// Use a prefix that code in loadCached can't collide with.
+	const std::string key = "@" + file;
+	const std::time_t version = Path::getModificationTime(file);
+	if (!loadCompiled(key, version, file)) {
+		load(Path::readFile(file), file);
+		storeCompiled(key, version);
+	}
+}
+
+void Lua::loadCached(const std::string& code, const std::string& context) {
+	const std::string key = "=" + code;
+	if (!loadCompiled(key, 0, context)) {
+		load(code, context);
+		storeCompiled(key, 0);
+	}
+}
+
+Lua::Reference Lua::compile(const std::string& code, const std::string& context) {
+	loadCached(code, context);
+	return luaL_ref(state, LUA_REGISTRYINDEX);
+}
+
+void Lua::pushReference(Reference reference) {
+	lua_rawgeti(state, LUA_REGISTRYINDEX, reference);
+}
+
+void Lua::popSerialized(Serializer& output) {
+	try {
+		serializeValue(output, lua_gettop(state), 0);
+	} catch (...) {
+		discard();
+		throw;
+	}
+	discard();
+}
+
+void Lua::serializeValue(Serializer& output, int index, int depth) {
+	switch (lua_type(state, index)) {
+		case LUA_TNIL:
+			output.put((unsigned int) SERIALIZED_NIL);
+			return;
+		case LUA_TBOOLEAN:
+			output.put((unsigned int) (lua_toboolean(state, index) ? SERIALIZED_TRUE : SERIALIZED_FALSE));
+			return;
+		case LUA_TNUMBER: {
+			const double d = lua_tonumber(state, index);
+#if LUA_VERSION_NUM >= 503
+			const bool integer = lua_isinteger(state, index);
+#else
+			const bool integer = (d == (double) (long long) d);
+#endif
+			if (integer && d >= std::numeric_limits<int>::min() && d <= std::numeric_limits<int>::max()) {
+				output.put((unsigned int) SERIALIZED_INTEGER);
+				output.put((int) d);
+			} else {
+				// Write the exact bits; Scalar may be fixed point.
+				std::uint64_t bits;
+				std::memcpy(&bits, &d, sizeof(bits));
+				output.put((unsigned int) SERIALIZED_NUMBER);
+				output.put((unsigned int) bits);
+				output.put((unsigned int) (bits >> 32));
+			}
+			return;
+		}
+		case LUA_TSTRING: {
+			std::size_t size;
+			const char* data = lua_tolstring(state, index, &size);
+			output.put((unsigned int) SERIALIZED_STRING);
+			output.put(std::string(data, size));
+			return;
+		}
+		case LUA_TTABLE:
+			if (depth >= maxSerializedDepth || !lua_checkstack(state, 3)) {
+				throw Exception("Can't serialize a table nested this deep!");
+			}
+			output.put((unsigned int) SERIALIZED_TABLE);
+			lua_pushnil(state);
+			while (lua_next(state, index)) {
+				const int top = lua_gettop(state);
+				try {
+					serializeValue(output, top - 1, depth + 1);
+					serializeValue(output, top, depth + 1);
+				} catch (...) {
+					lua_pop(state, 2);
+					throw;
+				}
+				lua_pop(state, 1);
+			}
+			// A nil key ends the table.
+			output.put((unsigned int) SERIALIZED_NIL);
+			return;
+		default:
+			throw Exception(std::string("Can't serialize a value of type ") + lua_typename(state, lua_type(state, index)) + "!");
+	}
+}
+
+void Lua::pushSerialized(Deserializer& input) {
+	const int top = lua_gettop(state);
+	try {
+		deserializeValue(input, 0);
+	} catch (...) {
+		lua_settop(state, top);
+		throw;
+	}
+}
+
+void Lua::deserializeValue(Deserializer& input, int depth) {
+	unsigned int type;
+	input.get(type);
+	switch (type) {
+		case SERIALIZED_NIL:
+			lua_pushnil(state);
+			return;
+		case SERIALIZED_FALSE:
+		case SERIALIZED_TRUE:
+			lua_pushboolean(state, type == SERIALIZED_TRUE);
+			return;
+		case SERIALIZED_INTEGER: {
+			int i;
+			input.get(i);
+			lua_pushinteger(state, i);
+			return;
+		}
+		case SERIALIZED_NUMBER: {
+			unsigned int low, high;
+			input.get(low);
+			input.get(high);
+			const std::uint64_t bits = low | (std::uint64_t) high << 32;
+			double d;
+			std::memcpy(&d, &bits, sizeof(d));
+			lua_pushnumber(state, d);
+			return;
+		}
+		case SERIALIZED_STRING: {
+			std::string s;
+			input.get(s);
+			push<String>(s);
+			return;
+		}
+		case SERIALIZED_TABLE:
+			if (depth >= maxSerializedDepth || !lua_checkstack(state, 3)) {
+				throw std::runtime_error("Invalid data (too deep Lua table)!");
+			}
+			lua_newtable(state);
+			while (true) {
+				deserializeValue(input, depth + 1);
+				if (lua_isnil(state, -1)) {
+					lua_pop(state, 1);
+					return;
+				}
+				deserializeValue(input, depth + 1);
+				lua_rawset(state, -3);
+			}
+		default:
+			throw std::runtime_error("Invalid data (unknown Lua type)!");
+	}
+}
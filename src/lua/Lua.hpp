@@ -2,17 +2,28 @@
 #define PUTKARTS_Lua_HPP
 
 #include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <chrono>
+#include <iosfwd>
 #include <stdexcept>
 #include <vector>
+#include <map>
 #include <functional>
+#include <type_traits>
 #include <unordered_map>
 #include <boost/any.hpp>
 #include "util/Path.hpp"
+#include "util/MemoryPool.hpp"
 
 extern "C" {
 	struct lua_State;
+	struct lua_Debug;
 }
 
+class Serializer;
+class Deserializer;
+
 /**
  * Wrapper for Lua.
  */
@@ -33,17 +44,148 @@ public:
 	/** Exception type. */
 	typedef std::runtime_error Exception;
 
+	/** Exception type for code that is stopped by the instruction budget. */
+	struct BudgetException: Exception {
+		/**
+		 * Constructor.
+		 *
+		 * @param what The error message.
+		 */
+		BudgetException(const std::string& what):
+			Exception(what) {
+		}
+	};
+
+	/**
+	 * Profiling results for one function or label.
+	 *
+	 * The time and allocations include everything done in nested calls.
+	 */
+	struct ProfileEntry {
+		/** The name the function was called with, if known. */
+		std::string name;
+
+		/** The number of calls. */
+		std::uint64_t calls;
+
+		/** The total running time. */
+		double seconds;
+
+		/** The number of allocations. */
+		std::uint64_t allocations;
+
+		/** The number of allocated bytes. */
+		std::uint64_t allocatedBytes;
+
+		/** The number of times the instruction budget ran out inside a label. */
+		std::uint64_t budgetOverruns;
+
+		/**
+		 * Constructor.
+		 */
+		ProfileEntry():
+			calls(0),
+			seconds(0),
+			allocations(0),
+			allocatedBytes(0),
+			budgetOverruns(0) {
+		}
+	};
+
+	/** Type for profiling results by function or label. */
+	typedef std::map<std::string, ProfileEntry> ProfileContainerType;
+
 protected:
 	/** Function type. */
 	typedef std::function<void()> Function;
 
+	/** Handle to a compiled function stored in the Lua registry. */
+	typedef int Reference;
+
 private:
+	/** Type of the C functions that Lua calls. */
+	typedef int (*ThunkType)(lua_State* state);
+
+	/** A list of argument indices, used for unpacking the arguments of a bound method. */
+	template <std::size_t... I> struct IndexList {
+	};
+
+	/** Build IndexList<0, 1, ..., N - 1>. */
+	template <std::size_t N, std::size_t... I> struct MakeIndexList: MakeIndexList<N - 1, N - 1, I...> {
+	};
+	template <std::size_t... I> struct MakeIndexList<0, I...> {
+		typedef IndexList<I...> Type;
+	};
+
+	/** A running function or label in the profiler. */
+	struct ProfileFrame {
+		/** The results to update. */
+		ProfileEntry* entry;
+
+		/** The start time. */
+		std::chrono::steady_clock::time_point start;
+
+		/** The allocation counters at the start. */
+		std::uint64_t allocations, allocatedBytes;
+	};
+
+	/** The number of instructions between budget checks. */
+	static const int budgetStep = 1000;
+
+	/** The data of a bound method, stored in the Lua closure. */
+	template <typename C, typename R, typename... Args> struct MethodBinding {
+		/** The Lua wrapper. */
+		Lua* lua;
+
+		/** The object whose method is called. */
+		C* object;
+
+		/** The method. */
+		R (C::*method)(Args...);
+	};
+
+	/** The memory of the Lua VM; it's released all at once with the Lua object. */
+	MemoryPool memoryPool;
+
 	/** The Lua VM state. */
 	lua_State* state;
 
 	/** Allocated functions. */
 	std::unordered_map<std::string, Function> functions;
 
+	/** The number of allocations by this state. */
+	std::uint64_t allocationCount;
+
+	/** The number of bytes allocated by this state. */
+	std::uint64_t allocatedBytes;
+
+	/** Is the profiler on? */
+	bool profiling;
+
+	/** Profiling results by function. */
+	ProfileContainerType functionProfile;
+
+	/** Profiling results by label. */
+	ProfileContainerType labelProfile;
+
+	/** The running functions. */
+	std::vector<ProfileFrame> callStack;
+
+	/** The open labels. */
+	std::vector<ProfileFrame> labelStack;
+
+	/** The maximum number of instructions between startInstructionBudget and stopInstructionBudget, or zero. */
+	std::uint64_t instructionBudget;
+
+	/** The number of instructions used from the budget. */
+	std::uint64_t instructionsUsed;
+
+	/** Is the budget being counted? */
+	bool budgetActive;
+
+	/** Has the budget run out since startInstructionBudget? */
+	bool budgetExceeded;
+
 protected:
 	/** Include directories. */
 	std::vector<std::string> directories;
@@ -81,17 +223,49 @@ protected:
 	 * Boolean, Integer, Number, String, boost::any, void.
 	 */
 	template <typename T> T pop() {
-		return boost::any_cast<T>(pop<boost::any>());
+		T result;
+		try {
+			result = get<T>(-1);
+		} catch (...) {
+			discard();
+			throw;
+		}
+		discard();
+		return result;
 	}
 
 	/**
 	 * Bind a function.
 	 *
+	 * The function reads its arguments with get and returns values with push.
+	 *
 	 * @param name A name for the function.
 	 * @param function The function.
 	 */
 	void bind(const std::string& name, Function function);
 
+	/**
+	 * Bind a method with typed arguments.
+	 *
+	 * The arguments are read from Lua with get and the return value,
+	 * if any, is pushed with push, so the types must be ones that
+	 * those support. The call doesn't go through std::function or
+	 * a name lookup.
+	 *
+	 * @param name A name for the function.
+	 * @param object The object whose method is called.
+	 * @param method The method.
+	 */
+	template <typename C, typename R, typename... Args> void bind(const std::string& name, C* object, R (C::*method)(Args...)) {
+		typedef MethodBinding<C, R, Args...> BindingType;
+		unbind(name);
+		BindingType& binding = *static_cast<BindingType*>(pushClosureData(sizeof(BindingType)));
+		binding.lua = this;
+		binding.object = object;
+		binding.method = method;
+		setClosure(name, &methodThunk<C, R, Args...>);
+	}
+
 	/**
 	 * Remove a function binding.
 	 *
@@ -108,6 +282,29 @@ protected:
 	 */
 	void load(const std::string& code, const std::string& context = "evaluated code");
 
+	/**
+	 * Load a Lua file on the stack.
+	 *
+	 * The compiled file is cached for all Lua states, and it's
+	 * recompiled only if the file has been modified.
+	 *
+	 * @param file The file.
+	 * @throw Exception Thrown if anything goes wrong.
+	 */
+	void loadFile(const std::string& file);
+
+	/**
+	 * Load some constant Lua code on the stack.
+	 *
+	 * The compiled code is cached for all Lua states, so this should
+	 * only be used for code that doesn't vary.
+	 *
+	 * @param code The Lua code.
+	 * @param context The indentifier used in error reporting.
+	 * @throw Exception Thrown if anything goes wrong.
+	 */
+	void loadCached(const std::string& code, const std::string& context = "evaluated code");
+
 	/**
 	 * Call a Lua function that is already in the stack.
 	 *
@@ -117,7 +314,239 @@ protected:
 	 */
 	void call(int nargs, int nresults);
 
+	/**
+	 * Compile some Lua code into a function that can be called many times.
+	 *
+	 * The function stays in the Lua registry until the state is closed.
+	 * It receives its arguments in "...".
+	 *
+	 * @param code The Lua code.
+	 * @param context The indentifier used in error reporting.
+	 * @return A handle to the function.
+	 * @throw Exception Thrown if anything goes wrong.
+	 */
+	Reference compile(const std::string& code, const std::string& context = "compiled code");
+
+	/**
+	 * Push a compiled function on the stack.
+	 *
+	 * @param reference The handle from compile.
+	 */
+	void pushReference(Reference reference);
+
+	/**
+	 * Call a compiled function.
+	 *
+	 * The argument types must be one of the following:
+	 * Boolean, Integer, Number, String.
+	 *
+	 * @param reference The handle from compile.
+	 * @param nresults The number of results.
+	 * @param args The arguments.
+	 * @throw Exception Thrown if anything goes wrong.
+	 */
+	template <typename... Args> void callReference(Reference reference, int nresults, const Args&... args) {
+		pushReference(reference);
+		pushAll(args...);
+		call(sizeof...(Args), nresults);
+	}
+
+	/**
+	 * Serialize the value on top of the stack and pop it.
+	 *
+	 * Nil, booleans, numbers, strings and tables of these are supported.
+	 * Tables are written by value, so a table that is referred to twice
+	 * is loaded as two copies, and metatables are lost.
+	 *
+	 * @param output The serializer.
+	 * @throw Exception Thrown if the value can't be serialized.
+	 */
+	void popSerialized(Serializer& output);
+
+	/**
+	 * Deserialize a value written by popSerialized and push it.
+	 *
+	 * @param input The deserializer.
+	 * @throw std::runtime_error Thrown if the data is invalid.
+	 */
+	void pushSerialized(Deserializer& input);
+
+	/**
+	 * Start counting the instruction budget from zero.
+	 *
+	 * Until stopInstructionBudget, Lua code fails with an error when
+	 * it runs more instructions than the budget allows, and call throws
+	 * a BudgetException. The instruction counter of the hook restarts
+	 * too, so the code stops at the same instruction on every computer.
+	 */
+	void startInstructionBudget();
+
+	/**
+	 * Stop counting the instruction budget.
+	 */
+	void stopInstructionBudget() {
+		budgetActive = false;
+	}
+
+	/**
+	 * Start measuring a label, such as an object type, until endProfileLabel.
+	 *
+	 * Labels may be nested. Lua code can use profileBegin(label) and profileEnd().
+	 *
+	 * @param label The label.
+	 */
+	void beginProfileLabel(const String& label);
+
+	/**
+	 * Stop measuring the last label.
+	 */
+	void endProfileLabel();
+
 private:
+	/**
+	 * Push any number of values to Lua; the end of the recursion.
+	 */
+	void pushAll() {
+	}
+
+	/**
+	 * Push any number of values to Lua.
+	 *
+	 * @param value The first value.
+	 * @param rest The rest of the values.
+	 */
+	template <typename T, typename... Rest> void pushAll(const T& value, const Rest&... rest) {
+		push<T>(value);
+		pushAll(rest...);
+	}
+
+	/**
+	 * Pop the top value from the stack.
+	 */
+	void discard();
+
+	/**
+	 * Serialize a value; the implementation of popSerialized.
+	 *
+	 * @param output The serializer.
+	 * @param index The absolute index of the value in the stack.
+	 * @param depth The number of tables around the value.
+	 */
+	void serializeValue(Serializer& output, int index, int depth);
+
+	/**
+	 * Deserialize a value and push it; the implementation of pushSerialized.
+	 *
+	 * @param input The deserializer.
+	 * @param depth The number of tables around the value.
+	 */
+	void deserializeValue(Deserializer& input, int depth);
+
+	/**
+	 * Install the debug hook needed by the profiler and the budget.
+	 */
+	void updateHook();
+
+	/**
+	 * Start measuring a function or label.
+	 *
+	 * @param stack The stack of running functions or labels.
+	 * @param entry The results to update.
+	 */
+	void beginProfileFrame(std::vector<ProfileFrame>& stack, ProfileEntry& entry);
+
+	/**
+	 * Stop measuring the last function or label and add the results.
+	 *
+	 * @param stack The stack of running functions or labels.
+	 */
+	void endProfileFrame(std::vector<ProfileFrame>& stack);
+
+	/**
+	 * Debug hook for the profiler and the budget.
+	 *
+	 * @param state The Lua state.
+	 * @param ar The event.
+	 */
+	static void luaHook(lua_State* state, lua_Debug* ar);
+
+	/**
+	 * Memory allocator for Lua; uses the memory pool and counts the allocations.
+	 *
+	 * @param ud The Lua object.
+	 * @param ptr The old block, or NULL.
+	 * @param osize The old size.
+	 * @param nsize The new size, or zero to free the block.
+	 * @return The new block.
+	 */
+	static void* luaAlloc(void* ud, void* ptr, std::size_t osize, std::size_t nsize);
+
+	/**
+	 * Push a block of memory for the data of a closure.
+	 *
+	 * @param size The size of the data.
+	 * @return The memory.
+	 */
+	void* pushClosureData(std::size_t size);
+
+	/**
+	 * Create a closure with the data on top of the stack and store it in a global.
+	 *
+	 * @param name The name of the global.
+	 * @param thunk The C function.
+	 */
+	void setClosure(const std::string& name, ThunkType thunk);
+
+	/**
+	 * Get the data of the running closure.
+	 *
+	 * @param state The Lua state.
+	 */
+	static void* getClosureData(lua_State* state);
+
+	/**
+	 * Raise a Lua error; doesn't return.
+	 *
+	 * @param state The Lua state.
+	 * @param message The error message.
+	 */
+	static int raiseError(lua_State* state, const char* message);
+
+	/**
+	 * Call a bound method that returns a value and push the value.
+	 *
+	 * @return The number of results.
+	 */
+	template <typename C, typename R, typename... Args, std::size_t... I> int callMethod(C* object, R (C::*method)(Args...), IndexList<I...>, std::false_type) {
+		push<R>((object->*method)(get<typename std::decay<Args>::type>(I + 1)...));
+		return 1;
+	}
+
+	/**
+	 * Call a bound method that returns nothing.
+	 *
+	 * @return The number of results.
+	 */
+	template <typename C, typename R, typename... Args, std::size_t... I> int callMethod(C* object, R (C::*method)(Args...), IndexList<I...>, std::true_type) {
+		(object->*method)(get<typename std::decay<Args>::type>(I + 1)...);
+		return 0;
+	}
+
+	/**
+	 * This function forwards calls from Lua to a bound method.
+	 *
+	 * @param state The Lua state.
+	 * @return How many values does this function return to Lua?
+	 */
+	template <typename C, typename R, typename... Args> static int methodThunk(lua_State* state) {
+		MethodBinding<C, R, Args...>& binding = *static_cast<MethodBinding<C, R, Args...>*>(getClosureData(state));
+		try {
+			return binding.lua->callMethod(binding.object, binding.method, typename MakeIndexList<sizeof...(Args)>::Type(), std::is_void<R>());
+		} catch (Lua::Exception& e) {
+			return raiseError(state, e.what());
+		}
+	}
+
 	/**
 	 * This function forwards calls from Lua to the actual Function object.
 	 *
@@ -126,6 +555,24 @@ private:
 	 */
 	static int luaThunk(lua_State* state);
 
+	/**
+	 * Load a compiled chunk from the cache on the stack.
+	 *
+	 * @param key The cache key.
+	 * @param version The version of the source, such as the modification time.
+	 * @param context The indentifier used in error reporting.
+	 * @return true if the chunk was found, false otherwise.
+	 */
+	bool loadCompiled(const std::string& key, std::time_t version, const std::string& context);
+
+	/**
+	 * Store the compiled chunk on top of the stack in the cache.
+	 *
+	 * @param key The cache key.
+	 * @param version The version of the source, such as the modification time.
+	 */
+	void storeCompiled(const std::string& key, std::time_t version);
+
 	/**
 	 * Lua callback: include another file.
 	 */
@@ -139,9 +586,84 @@ public:
 
 	/**
 	 * Destructor.
+	 *
+	 * The Lua state isn't closed, the memory pool is just released,
+	 * so no finalizers (__gc metamethods) are run.
 	 */
 	virtual ~Lua();
 
+	/**
+	 * Set the maximum memory usage; allocations beyond it fail with a Lua memory error.
+	 *
+	 * @param bytes The maximum number of bytes, or zero for no limit.
+	 */
+	void setMemoryLimit(std::size_t bytes) {
+		memoryPool.setLimit(bytes);
+	}
+
+	/**
+	 * Get the number of bytes used by Lua.
+	 */
+	std::size_t getMemoryUsage() const {
+		return memoryPool.getUsage();
+	}
+
+	/**
+	 * Get the largest number of bytes Lua has used at once.
+	 */
+	std::size_t getPeakMemoryUsage() const {
+		return memoryPool.getPeakUsage();
+	}
+
+	/**
+	 * Turn the profiler on or off.
+	 *
+	 * The profiler measures the time and allocations of every Lua
+	 * function and label, which slows the code down considerably.
+	 *
+	 * @param enabled Is the profiler on?
+	 */
+	void setProfiling(bool enabled);
+
+	/**
+	 * Set the maximum number of instructions between startInstructionBudget and stopInstructionBudget.
+	 *
+	 * The budget is checked every thousand instructions.
+	 *
+	 * @param instructions The number of instructions, or zero for no limit.
+	 */
+	void setInstructionBudget(std::uint64_t instructions);
+
+	/**
+	 * Get the maximum number of instructions between startInstructionBudget and stopInstructionBudget.
+	 *
+	 * @return The number of instructions, or zero for no limit.
+	 */
+	std::uint64_t getInstructionBudget() const {
+		return instructionBudget;
+	}
+
+	/**
+	 * Get the profiling results by function.
+	 */
+	const ProfileContainerType& getFunctionProfile() const {
+		return functionProfile;
+	}
+
+	/**
+	 * Get the profiling results by label.
+	 */
+	const ProfileContainerType& getLabelProfile() const {
+		return labelProfile;
+	}
+
+	/**
+	 * Write the profiling results as tab separated text.
+	 *
+	 * @param stream The stream to write to.
+	 */
+	void writeProfile(std::ostream& stream) const;
+
 	/**
 	 * Run some Lua code.
 	 *
@@ -184,7 +706,9 @@ public:
 	 * @throw Exception Thrown if anything goes wrong.
 	 */
 	template <typename T> T runFile(const std::string& file) {
-		return run<T>(Path::readFile(file), file);
+		loadFile(file);
+		call(0, 1);
+		return pop<T>();
 	}
 };
 
@@ -202,14 +726,6 @@ template <> void Lua::push<Lua::String>(const String& value);
 
 template <> boost::any Lua::pop<boost::any>();
 template <> void Lua::pop<void>();
-
-template <> inline Lua::Number Lua::pop<Lua::Number>() {
-	boost::any result(Lua::pop<boost::any>());
-	if (boost::any_cast<Lua::Integer>(&result)) {
-		return boost::any_cast<Lua::Integer>(result);
-	}
-	return boost::any_cast<Lua::Number>(result);
-}
 /** @endcond */
 
 #endif
@@ -1,40 +1,71 @@
 #include <stdexcept>
-#include <vector>
+#include <cstring>
 
 #include "Deserializer.hpp"
+#include "Serializer.hpp"
 
-static void finishValue(std::istream& data) {
-	if (!data || data.get() != '\n') {
-		throw std::runtime_error("Invalid data (missing '\n')!");
+void Deserializer::require(std::size_t size) const {
+	if ((std::size_t) (end - position) < size) {
+		throw std::runtime_error("Invalid data (unexpected end)!");
 	}
 }
 
+void Deserializer::checkVersion() {
+	require(1);
+	if ((unsigned char) *position != Serializer::version) {
+		throw std::runtime_error("Invalid data (incompatible version)!");
+	}
+	++position;
+}
+
+std::uint64_t Deserializer::getVarint() {
+	std::uint64_t value = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		require(1);
+		const unsigned char byte = *position++;
+		value |= (std::uint64_t) (byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			return value;
+		}
+	}
+	throw std::runtime_error("Invalid data (too long number)!");
+}
+
 void Deserializer::get(unsigned int& value) {
-	data >> value;
-	finishValue(data);
+	value = getVarint();
 }
 
 void Deserializer::get(int& value) {
-	data >> value;
-	finishValue(data);
+	const std::uint64_t tmp = getVarint();
+	value = (int) ((tmp & 1) ? ~(tmp >> 1) : (tmp >> 1));
+}
+
+void Deserializer::get(std::uint64_t& value) {
+	value = getVarint();
 }
 
 void Deserializer::get(bool& value) {
-	value = (data.get() == '1');
-	finishValue(data);
+	require(1);
+	value = (*position++ != 0);
 }
 
 void Deserializer::get(Scalar<>& value) {
-	data >> value.value;
-	finishValue(data);
+#ifdef USE_FIXED_POINT
+	const std::uint64_t tmp = getVarint();
+	value.value.raw = (Fixed::RawType) ((tmp & 1) ? ~(tmp >> 1) : (tmp >> 1));
+#else
+	require(8);
+	std::uint64_t bits = 0;
+	for (int i = 0; i < 8; ++i) {
+		bits |= (std::uint64_t) (unsigned char) *position++ << (8 * i);
+	}
+	std::memcpy(&value.value, &bits, sizeof(bits));
+#endif
 }
 
 void Deserializer::get(std::string& value) {
-	std::vector<char> ret;
-	unsigned int size;
-	get(size);
-	ret.resize(size);
-	data.read(&ret[0], size);
-	finishValue(data);
-	value.assign(ret.begin(), ret.end());
+	const std::uint64_t size = getVarint();
+	require(size);
+	value.assign(position, size);
+	position += size;
 }
@@ -1,25 +1,79 @@
 #ifndef PUTKARTS_Deserializer_HPP
 #define PUTKARTS_Deserializer_HPP
 
-#include <sstream>
+#include <cstdint>
+#include <cstddef>
 #include <string>
 
 #include "Scalar.hpp"
 #include "Vector2.hpp"
 
 /**
- * Class for deserializing data.
+ * Class for deserializing data written by Serializer.
+ *
+ * The deserializer reads the data in place, so the data must stay
+ * alive and unchanged while the deserializer is used.
  */
 class Deserializer {
-	/** The data. */
-	std::istringstream data;
+	/** The current position in the data. */
+	const char* position;
+
+	/** The end of the data. */
+	const char* end;
+
+	/**
+	 * Check that there are enough bytes left.
+	 *
+	 * @param size The number of bytes needed.
+	 * @throw std::runtime_error if the data ends too early.
+	 */
+	void require(std::size_t size) const;
+
+	/**
+	 * Check the version byte at the start of the data.
+	 *
+	 * @throw std::runtime_error if the data has a different version.
+	 */
+	void checkVersion();
+
+	/**
+	 * Deserialize an unsigned variable length number.
+	 *
+	 * @return The value.
+	 */
+	std::uint64_t getVarint();
 
 public:
 	/**
 	 * Construct a new deserializer.
+	 *
+	 * @param data_ The data.
+	 * @throw std::runtime_error if the data has a different version.
 	 */
 	Deserializer(const std::string& data_):
-		data(data_) {
+		position(data_.data()),
+		end(data_.data() + data_.size()) {
+		checkVersion();
+	}
+
+	/**
+	 * Construct a new deserializer.
+	 *
+	 * @param data_ Pointer to the data.
+	 * @param size The length of the data.
+	 * @throw std::runtime_error if the data has a different version.
+	 */
+	Deserializer(const char* data_, std::size_t size):
+		position(data_),
+		end(data_ + size) {
+		checkVersion();
+	}
+
+	/**
+	 * Has all of the data been read?
+	 */
+	bool atEnd() const {
+		return position == end;
 	}
 
 	/**
@@ -36,6 +90,13 @@ public:
 	 */
 	void get(int& value);
 
+	/**
+	 * Deserialize a 64-bit unsigned integer.
+	 *
+	 * @param value Reference to the object that shall hold the value.
+	 */
+	void get(std::uint64_t& value);
+
 	/**
 	 * Deserialize a boolean.
 	 *
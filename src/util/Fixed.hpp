@@ -0,0 +1,143 @@
+#ifndef PUTKARTS_Fixed_HPP
+#define PUTKARTS_Fixed_HPP
+
+#include <cstdint>
+#include <limits>
+
+/**
+ * Signed fixed point number with 16 fractional bits.
+ *
+ * All arithmetic is done with integers, so the results are identical
+ * on every machine. The range is about ±1.4e14 with a resolution of
+ * 1/65536. Multiplication and division round the result to the nearest,
+ * and results out of range, including division by zero, saturate instead
+ * of wrapping or trapping.
+ */
+class Fixed {
+public:
+	/** Type of the raw value. */
+	typedef std::int64_t RawType;
+
+	/** The number of fractional bits. */
+	static const int fractionBits = 16;
+
+	/** The raw value, the number times 2^fractionBits. */
+	RawType raw;
+
+	/**
+	 * Default constructor; init to zero.
+	 */
+	Fixed(): raw(0) {
+	}
+
+	/**
+	 * Construct from a floating point value, rounding to the nearest.
+	 */
+	Fixed(double value);
+
+	/**
+	 * Construct from a raw value.
+	 */
+	static Fixed fromRaw(RawType raw) {
+		Fixed tmp;
+		tmp.raw = raw;
+		return tmp;
+	}
+
+	/**
+	 * Convert to floating point.
+	 */
+	double toDouble() const {
+		return raw / (double) ((RawType) 1 << fractionBits);
+	}
+	explicit operator double() const {
+		return toDouble();
+	}
+
+	/**
+	 * Allow usage in conditions.
+	 */
+	explicit operator bool() const {
+		return raw != 0;
+	}
+	bool operator ! () const {
+		return !raw;
+	}
+
+	// Comparisons
+	bool operator < (Fixed const& t) const { return raw < t.raw; }
+	bool operator > (Fixed const& t) const { return raw > t.raw; }
+	bool operator <= (Fixed const& t) const { return raw <= t.raw; }
+	bool operator >= (Fixed const& t) const { return raw >= t.raw; }
+	bool operator == (Fixed const& t) const { return raw == t.raw; }
+	bool operator != (Fixed const& t) const { return raw != t.raw; }
+
+	// Arithmetic
+	Fixed operator - () const {
+		return fromRaw(-raw);
+	}
+	Fixed operator + (Fixed const& t) const {
+		return fromRaw(raw + t.raw);
+	}
+	Fixed operator - (Fixed const& t) const {
+		return fromRaw(raw - t.raw);
+	}
+	Fixed operator * (Fixed const& t) const;
+	Fixed operator / (Fixed const& t) const;
+};
+
+namespace std {
+	/**
+	 * Limits of Fixed. There is no NaN or infinity; the extreme values stand in for infinities.
+	 */
+	template <> class numeric_limits<Fixed> {
+	public:
+		static const bool is_specialized = true;
+		static const bool is_signed = true;
+		static const bool is_integer = false;
+		static const bool is_exact = true;
+		static const bool has_infinity = false;
+		static const bool has_quiet_NaN = false;
+		static const bool has_signaling_NaN = false;
+		static Fixed min() { return Fixed::fromRaw(1); }
+		static Fixed max() { return Fixed::fromRaw(numeric_limits<Fixed::RawType>::max()); }
+		static Fixed lowest() { return -max(); }
+		static Fixed epsilon() { return Fixed::fromRaw(1); }
+		static Fixed infinity() { return max(); }
+		static Fixed quiet_NaN() { return Fixed(); }
+	};
+}
+
+// Math functions for Fixed. These are found by argument-dependent lookup.
+
+/**
+ * Square root; computed with integers. Negative numbers give zero.
+ */
+Fixed sqrt(Fixed x);
+
+/**
+ * Sine and cosine; computed from a lookup table.
+ */
+Fixed sin(Fixed a);
+Fixed cos(Fixed a);
+Fixed tan(Fixed a);
+
+/**
+ * Angle of the vector (x, y) in the range [-pi, pi]; computed from a lookup table.
+ */
+Fixed atan2(Fixed y, Fixed x);
+
+/**
+ * Remainder of division, with the sign of the dividend.
+ */
+Fixed fmod(Fixed x, Fixed y);
+
+/**
+ * Power, exponent and logarithm. These go through floating point and
+ * are not deterministic; the simulation must not use them.
+ */
+Fixed pow(Fixed x, Fixed y);
+Fixed exp(Fixed x);
+Fixed log(Fixed x);
+
+#endif
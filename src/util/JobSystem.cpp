@@ -0,0 +1,156 @@
+#include <exception>
+#include <algorithm>
+
+#include "JobSystem.hpp"
+
+/**
+ * Bookkeeping for one call to parallelFor.
+ */
+struct JobSystem::Batch {
+	/** The loop body. */
+	const RangeFunctionType* function;
+
+	/** Lock for the fields below. */
+	std::mutex mutex;
+
+	/** Condition for signaling that the batch is done. */
+	std::condition_variable done;
+
+	/** The number of unfinished jobs. */
+	std::size_t remaining;
+
+	/** The first exception thrown by the loop body. */
+	std::exception_ptr error;
+};
+
+JobSystem::JobSystem(unsigned int threadCount):
+	pendingJobs(0),
+	quit(false) {
+	if (!threadCount) {
+		unsigned int cores = std::thread::hardware_concurrency();
+		threadCount = cores > 1 ? cores - 1 : 0;
+	}
+	for (unsigned int i = 0; i < threadCount; ++i) {
+		queues.push_back(std::unique_ptr<Queue>(new Queue));
+	}
+	for (unsigned int i = 0; i < threadCount; ++i) {
+		threads.push_back(std::thread(&JobSystem::work, this, i));
+	}
+}
+
+JobSystem::~JobSystem() {
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		quit = true;
+	}
+	sleepCondition.notify_all();
+	for (std::vector<std::thread>::iterator i = threads.begin(); i != threads.end(); ++i) {
+		i->join();
+	}
+}
+
+bool JobSystem::takeJob(std::size_t first, Job& job) {
+	const std::size_t n = queues.size();
+	for (std::size_t k = 0; k < n; ++k) {
+		Queue& queue = *queues[(first + k) % n];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.jobs.empty()) {
+			continue;
+		}
+		// Take own jobs from the front and steal from the back.
+		if (k == 0) {
+			job = queue.jobs.front();
+			queue.jobs.pop_front();
+		} else {
+			job = queue.jobs.back();
+			queue.jobs.pop_back();
+		}
+		std::lock_guard<std::mutex> sleepLock(sleepMutex);
+		--pendingJobs;
+		return true;
+	}
+	return false;
+}
+
+void JobSystem::runJob(const Job& job) {
+	Batch& batch = *job.batch;
+	try {
+		(*batch.function)(job.begin, job.end);
+	} catch (...) {
+		std::lock_guard<std::mutex> lock(batch.mutex);
+		if (!batch.error) {
+			batch.error = std::current_exception();
+		}
+	}
+	std::lock_guard<std::mutex> lock(batch.mutex);
+	if (!--batch.remaining) {
+		batch.done.notify_all();
+	}
+}
+
+void JobSystem::work(std::size_t index) {
+	while (true) {
+		Job job;
+		if (takeJob(index, job)) {
+			runJob(job);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		while (!pendingJobs && !quit) {
+			sleepCondition.wait(lock);
+		}
+		if (quit) {
+			return;
+		}
+	}
+}
+
+void JobSystem::parallelFor(std::size_t begin, std::size_t end, std::size_t chunkSize, const RangeFunctionType& function) {
+	if (begin >= end) {
+		return;
+	}
+	chunkSize = std::max<std::size_t>(chunkSize, 1);
+	const std::size_t count = (end - begin + chunkSize - 1) / chunkSize;
+
+	// Without workers, or with only one chunk, just run the loop here.
+	if (queues.empty() || count == 1) {
+		for (std::size_t i = begin; i < end; i += chunkSize) {
+			function(i, std::min(i + chunkSize, end));
+		}
+		return;
+	}
+
+	// The workers hold a raw pointer, so the batch must outlive every job.
+	Batch batch;
+	batch.function = &function;
+	batch.remaining = count;
+
+	// Deal the chunks to the queues.
+	for (std::size_t k = 0; k < count; ++k) {
+		Job job;
+		job.batch = &batch;
+		job.begin = begin + k * chunkSize;
+		job.end = std::min(job.begin + chunkSize, end);
+		Queue& queue = *queues[k % queues.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back(job);
+	}
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		pendingJobs += count;
+	}
+	sleepCondition.notify_all();
+
+	// Help until the queues are empty, then wait for the rest.
+	Job job;
+	while (takeJob(0, job)) {
+		runJob(job);
+	}
+	std::unique_lock<std::mutex> lock(batch.mutex);
+	while (batch.remaining) {
+		batch.done.wait(lock);
+	}
+	if (batch.error) {
+		std::rethrow_exception(batch.error);
+	}
+}
@@ -0,0 +1,125 @@
+#ifndef PUTKARTS_JobSystem_HPP
+#define PUTKARTS_JobSystem_HPP
+
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <boost/utility.hpp>
+
+/**
+ * A pool of worker threads for running data parallel loops.
+ *
+ * Each worker has its own queue of jobs. A worker takes jobs from the
+ * front of its own queue, and when it runs out, it steals from the back
+ * of the other queues. The thread that starts a loop helps with the work
+ * until the whole loop is done.
+ */
+class JobSystem: boost::noncopyable {
+public:
+	/** Function type for loop bodies; the arguments are the range [begin, end). */
+	typedef std::function<void(std::size_t, std::size_t)> RangeFunctionType;
+
+private:
+	/** Bookkeeping for one call to parallelFor. */
+	struct Batch;
+
+	/** One chunk of a loop. */
+	struct Job {
+		/** The batch this job belongs to. */
+		Batch* batch;
+
+		/** The range to process. */
+		std::size_t begin, end;
+	};
+
+	/** A job queue with its lock. */
+	struct Queue {
+		/** Lock for the queue. */
+		std::mutex mutex;
+
+		/** The jobs. */
+		std::deque<Job> jobs;
+	};
+
+	/** The job queues, one per worker. */
+	std::vector<std::unique_ptr<Queue> > queues;
+
+	/** The worker threads. */
+	std::vector<std::thread> threads;
+
+	/** Lock for sleeping and waking the workers. */
+	std::mutex sleepMutex;
+
+	/** Condition for waking the workers. */
+	std::condition_variable sleepCondition;
+
+	/** Number of queued jobs, guarded by sleepMutex. */
+	std::size_t pendingJobs;
+
+	/** Set when the workers should exit. */
+	bool quit;
+
+	/**
+	 * Take a job, preferably from the given queue.
+	 *
+	 * @param first The queue to try first.
+	 * @param job The job is stored here.
+	 * @return true if a job was found.
+	 */
+	bool takeJob(std::size_t first, Job& job);
+
+	/**
+	 * Run a job and mark it done.
+	 *
+	 * @param job The job.
+	 */
+	void runJob(const Job& job);
+
+	/**
+	 * The main loop of a worker thread.
+	 *
+	 * @param index The index of the worker's own queue.
+	 */
+	void work(std::size_t index);
+
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param threads The number of worker threads; zero means one less than the number of cores.
+	 */
+	JobSystem(unsigned int threads = 0);
+
+	/**
+	 * Destructor; stops the workers.
+	 */
+	~JobSystem();
+
+	/**
+	 * Get the number of worker threads.
+	 */
+	std::size_t getThreadCount() const {
+		return threads.size();
+	}
+
+	/**
+	 * Run a loop in parallel and wait until all of it is done.
+	 *
+	 * The range is split into chunks of the given size, and each chunk is
+	 * processed by exactly one call to the function. If a call throws, the
+	 * first exception is rethrown here after the rest of the loop is done.
+	 *
+	 * @param begin The start of the range.
+	 * @param end The end of the range.
+	 * @param chunkSize The number of elements to process in one call.
+	 * @param function The loop body.
+	 */
+	void parallelFor(std::size_t begin, std::size_t end, std::size_t chunkSize, const RangeFunctionType& function);
+};
+
+#endif
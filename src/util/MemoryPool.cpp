@@ -0,0 +1,151 @@
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include "MemoryPool.hpp"
+
+static_assert(sizeof(char*) <= MemoryPool::granularity, "MemoryPool: chunk header doesn't fit");
+
+MemoryPool::MemoryPool(std::size_t limit_):
+	chunks(0),
+	chunkBegin(0),
+	chunkEnd(0),
+	largeBlocks(0),
+	usage(0),
+	peakUsage(0),
+	limit(limit_) {
+	static_assert(sizeof(LargeBlock) <= granularity, "MemoryPool: block header doesn't fit");
+	std::fill(freeLists, freeLists + classCount, static_cast<FreeBlock*>(0));
+}
+
+MemoryPool::~MemoryPool() {
+	while (chunks) {
+		char* next = *reinterpret_cast<char**>(chunks);
+		std::free(chunks);
+		chunks = next;
+	}
+	while (largeBlocks) {
+		LargeBlock* next = largeBlocks->next;
+		std::free(largeBlocks);
+		largeBlocks = next;
+	}
+}
+
+bool MemoryPool::account(std::size_t oldSize, std::size_t newSize) {
+	if (newSize > oldSize && limit && usage + (newSize - oldSize) > limit) {
+		return false;
+	}
+	usage = usage - oldSize + newSize;
+	peakUsage = std::max(peakUsage, usage);
+	return true;
+}
+
+void* MemoryPool::allocateSmall(std::size_t size) {
+	const std::size_t c = getClass(size);
+	if (freeLists[c]) {
+		FreeBlock* block = freeLists[c];
+		freeLists[c] = block->next;
+		return block;
+	}
+	const std::size_t classSize = (c + 1) * granularity;
+	if (static_cast<std::size_t>(chunkEnd - chunkBegin) < classSize) {
+		// The rest of the old chunk is wasted; it's less than one block.
+		char* chunk = static_cast<char*>(std::malloc(chunkSize));
+		if (!chunk) {
+			return 0;
+		}
+		*reinterpret_cast<char**>(chunk) = chunks;
+		chunks = chunk;
+		chunkBegin = chunk + granularity;
+		chunkEnd = chunk + chunkSize;
+	}
+	void* block = chunkBegin;
+	chunkBegin += classSize;
+	return block;
+}
+
+void* MemoryPool::allocateLarge(std::size_t size) {
+	LargeBlock* header = static_cast<LargeBlock*>(std::malloc(granularity + size));
+	if (!header) {
+		return 0;
+	}
+	header->prev = 0;
+	header->next = largeBlocks;
+	if (largeBlocks) {
+		largeBlocks->prev = header;
+	}
+	largeBlocks = header;
+	return reinterpret_cast<char*>(header) + granularity;
+}
+
+void MemoryPool::release(void* block, std::size_t size) {
+	if (size <= maxSmallSize) {
+		FreeBlock* freeBlock = static_cast<FreeBlock*>(block);
+		const std::size_t c = getClass(size);
+		freeBlock->next = freeLists[c];
+		freeLists[c] = freeBlock;
+		return;
+	}
+	LargeBlock* header = reinterpret_cast<LargeBlock*>(static_cast<char*>(block) - granularity);
+	if (header->prev) {
+		header->prev->next = header->next;
+	} else {
+		largeBlocks = header->next;
+	}
+	if (header->next) {
+		header->next->prev = header->prev;
+	}
+	std::free(header);
+}
+
+void* MemoryPool::allocate(std::size_t size) {
+	if (!account(0, size)) {
+		return 0;
+	}
+	void* block = size <= maxSmallSize ? allocateSmall(size) : allocateLarge(size);
+	if (!block) {
+		account(size, 0);
+	}
+	return block;
+}
+
+void MemoryPool::deallocate(void* block, std::size_t size) {
+	if (!block) {
+		return;
+	}
+	account(size, 0);
+	release(block, size);
+}
+
+void* MemoryPool::reallocate(void* block, std::size_t oldSize, std::size_t newSize) {
+	if (!block) {
+		return newSize ? allocate(newSize) : 0;
+	}
+	if (!newSize) {
+		deallocate(block, oldSize);
+		return 0;
+	}
+	if (!account(oldSize, newSize)) {
+		return 0;
+	}
+
+	// A block is big enough for any size in its class.
+	const bool oldSmall = oldSize <= maxSmallSize, newSmall = newSize <= maxSmallSize;
+	if (oldSmall && newSmall && getClass(oldSize) == getClass(newSize)) {
+		return block;
+	}
+
+	void* moved = newSmall ? allocateSmall(newSize) : allocateLarge(newSize);
+	if (!moved) {
+		// Shrinking must not fail; the old block is big enough, and it
+		// can later be freed as a block of the new size.
+		if (newSize <= oldSize) {
+			return block;
+		}
+		account(newSize, oldSize);
+		return 0;
+	}
+	std::memcpy(moved, block, std::min(oldSize, newSize));
+	release(block, oldSize);
+	return moved;
+}
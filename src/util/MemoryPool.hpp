@@ -0,0 +1,172 @@
+#ifndef PUTKARTS_MemoryPool_HPP
+#define PUTKARTS_MemoryPool_HPP
+
+#include <cstddef>
+#include <boost/utility.hpp>
+
+/**
+ * Memory allocator with free lists for small blocks.
+ *
+ * Small blocks are rounded up to a size class and carved from large
+ * chunks; freed blocks go to the free list of their class. Bigger
+ * blocks come from malloc. All memory is released at once when the
+ * pool is destroyed, even if the blocks were never deallocated.
+ *
+ * The pool counts the bytes in use, and it can refuse allocations
+ * that would go over a limit. It's not thread safe.
+ */
+class MemoryPool: boost::noncopyable {
+public:
+	/** The size classes are multiples of this; it's also the alignment of the blocks. */
+	static const std::size_t granularity = 16;
+
+	/** The largest block that comes from the free lists. */
+	static const std::size_t maxSmallSize = 512;
+
+	/** The size of the chunks the small blocks are carved from. */
+	static const std::size_t chunkSize = 64 * 1024;
+
+private:
+	/** The number of size classes. */
+	static const std::size_t classCount = maxSmallSize / granularity;
+
+	/** A free small block. */
+	struct FreeBlock {
+		/** The next free block of the same class. */
+		FreeBlock* next;
+	};
+
+	/** The header of a big block. */
+	struct LargeBlock {
+		/** The neighbours in the list of big blocks. */
+		LargeBlock *prev, *next;
+	};
+
+	/** The chunks, linked through their first bytes. */
+	char* chunks;
+
+	/** The unused part of the last chunk. */
+	char *chunkBegin, *chunkEnd;
+
+	/** The free lists by size class. */
+	FreeBlock* freeLists[classCount];
+
+	/** The big blocks. */
+	LargeBlock* largeBlocks;
+
+	/** The bytes in use. */
+	std::size_t usage;
+
+	/** The maximum of usage so far. */
+	std::size_t peakUsage;
+
+	/** The maximum usage, or zero for no limit. */
+	std::size_t limit;
+
+	/**
+	 * Get the size class of a small block.
+	 *
+	 * @param size The size, from 1 to maxSmallSize.
+	 * @return The index of the class.
+	 */
+	static std::size_t getClass(std::size_t size) {
+		return (size - 1) / granularity;
+	}
+
+	/**
+	 * Check the limit and update the usage.
+	 *
+	 * @param oldSize The old size of the block.
+	 * @param newSize The new size of the block.
+	 * @return false if the limit doesn't allow the change.
+	 */
+	bool account(std::size_t oldSize, std::size_t newSize);
+
+	/**
+	 * Allocate a small block; doesn't touch the usage.
+	 */
+	void* allocateSmall(std::size_t size);
+
+	/**
+	 * Allocate a big block; doesn't touch the usage.
+	 */
+	void* allocateLarge(std::size_t size);
+
+	/**
+	 * Free a block; doesn't touch the usage.
+	 */
+	void release(void* block, std::size_t size);
+
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param limit_ The maximum number of bytes in use, or zero for no limit.
+	 */
+	MemoryPool(std::size_t limit_ = 0);
+
+	/**
+	 * Destructor; frees all memory.
+	 */
+	~MemoryPool();
+
+	/**
+	 * Allocate a block.
+	 *
+	 * @param size The size, not zero.
+	 * @return The block, or NULL if out of memory or over the limit.
+	 */
+	void* allocate(std::size_t size);
+
+	/**
+	 * Free a block.
+	 *
+	 * @param block The block, or NULL.
+	 * @param size The size given when the block was allocated.
+	 */
+	void deallocate(void* block, std::size_t size);
+
+	/**
+	 * Resize a block, like realloc.
+	 *
+	 * Making a block smaller never fails.
+	 *
+	 * @param block The block, or NULL for a new block.
+	 * @param oldSize The size given when the block was allocated; ignored for a new block.
+	 * @param newSize The new size, or zero to free the block.
+	 * @return The block, or NULL if the block was freed or the allocation failed.
+	 */
+	void* reallocate(void* block, std::size_t oldSize, std::size_t newSize);
+
+	/**
+	 * Get the number of bytes in use.
+	 */
+	std::size_t getUsage() const {
+		return usage;
+	}
+
+	/**
+	 * Get the largest number of bytes that have been in use at once.
+	 */
+	std::size_t getPeakUsage() const {
+		return peakUsage;
+	}
+
+	/**
+	 * Get the limit.
+	 */
+	std::size_t getLimit() const {
+		return limit;
+	}
+
+	/**
+	 * Set the maximum number of bytes in use; blocks in use are not affected.
+	 *
+	 * @param limit_ The limit, or zero for no limit.
+	 */
+	void setLimit(std::size_t limit_) {
+		limit = limit_;
+	}
+};
+
+#endif
@@ -65,6 +65,12 @@ bool Path::exists(const std::string& path) {
 	return boost::filesystem::exists(path);
 }
 
+std::time_t Path::getModificationTime(const std::string& path) {
+	boost::system::error_code error;
+	std::time_t result = boost::filesystem::last_write_time(path, error);
+	return error ? -1 : result;
+}
+
 std::string Path::readFile(const std::string& path) {
 	std::ifstream ifs(path.c_str(), std::ios::binary);
 	if (!ifs) {
@@ -79,6 +85,21 @@ std::string Path::readFile(const std::string& path) {
 	return result;
 }
 
+void Path::writeFile(const std::string& path, const std::string& data) {
+	const boost::filesystem::path tmp(boost::filesystem::unique_path(path + ".%%%%-%%%%-%%%%.tmp"));
+	std::ofstream ofs(tmp.string().c_str(), std::ios::binary | std::ios::trunc);
+	ofs.write(data.data(), data.size());
+	ofs.close();
+	boost::system::error_code error;
+	if (ofs) {
+		boost::filesystem::rename(tmp, path, error);
+	}
+	if (!ofs || error) {
+		boost::filesystem::remove(tmp, error);
+		throw std::runtime_error("Can't write file: " + path);
+	}
+}
+
 void Path::init(const std::string& argv0) {
 	// This works in the development environment:
 	// argv0 = root/bin/program; chdir to root; everything else is right here as well.
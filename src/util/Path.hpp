@@ -2,6 +2,7 @@
 #define PUTKARTS_Path_HPP
 
 #include <string>
+#include <ctime>
 
 /**
  * Functions for locating game files and handling filesystem.
@@ -33,6 +34,14 @@ namespace Path {
 	 */
 	extern bool exists(const std::string& path);
 
+	/**
+	 * Get the last modification time of a file.
+	 *
+	 * @param path The path.
+	 * @return The time, or -1 if it's not available.
+	 */
+	extern std::time_t getModificationTime(const std::string& path);
+
 	/**
 	 * Read a whole file.
 	 *
@@ -41,6 +50,19 @@ namespace Path {
 	 */
 	extern std::string readFile(const std::string& path);
 
+	/**
+	 * Replace a whole file.
+	 *
+	 * The data is written to a temporary file that is then renamed over
+	 * the path, so readers never see a partly written file and concurrent
+	 * writers don't mix their data.
+	 *
+	 * @param path The path.
+	 * @param data The new contents of the file.
+	 * @throw std::runtime_error if the file can't be written.
+	 */
+	extern void writeFile(const std::string& path, const std::string& data);
+
 	/**
 	 * Initialize the data and configuration paths.
 	 *
@@ -0,0 +1,75 @@
+#ifndef PUTKARTS_PoolAllocator_HPP
+#define PUTKARTS_PoolAllocator_HPP
+
+#include <cstddef>
+#include <memory>
+#include <new>
+
+#include "MemoryPool.hpp"
+
+/**
+ * Standard allocator that takes the memory from a MemoryPool.
+ *
+ * The allocator keeps the pool alive, so with std::allocate_shared the
+ * pool lasts as long as the objects. Like the pool, it's not thread safe.
+ */
+template <typename T> class PoolAllocator {
+	template <typename U> friend class PoolAllocator;
+
+	/** The pool. */
+	std::shared_ptr<MemoryPool> pool;
+
+public:
+	/** Type of the allocated values. */
+	typedef T value_type;
+
+	/** Allocator for another type. */
+	template <typename U> struct rebind {
+		typedef PoolAllocator<U> other;
+	};
+
+	/**
+	 * Constructor.
+	 *
+	 * @param pool_ The pool.
+	 */
+	explicit PoolAllocator(std::shared_ptr<MemoryPool> pool_):
+		pool(pool_) {
+	}
+
+	/**
+	 * Copy from an allocator of another type.
+	 */
+	template <typename U> PoolAllocator(const PoolAllocator<U>& other):
+		pool(other.pool) {
+	}
+
+	/**
+	 * Allocate memory for n values.
+	 *
+	 * @throw std::bad_alloc Thrown if the pool is out of memory.
+	 */
+	T* allocate(std::size_t n) {
+		void* p = pool->allocate(n * sizeof(T));
+		if (!p) {
+			throw std::bad_alloc();
+		}
+		return static_cast<T*>(p);
+	}
+
+	/**
+	 * Free memory for n values.
+	 */
+	void deallocate(T* p, std::size_t n) {
+		pool->deallocate(p, n * sizeof(T));
+	}
+
+	template <typename U> bool operator == (const PoolAllocator<U>& other) const {
+		return pool == other.pool;
+	}
+	template <typename U> bool operator != (const PoolAllocator<U>& other) const {
+		return pool != other.pool;
+	}
+};
+
+#endif
@@ -6,10 +6,16 @@
 
 #include "Math.hpp"
 #include "SIUnit.hpp"
+#include "Fixed.hpp"
 
 template <typename U1 = SIUnit::Unit<> >
 struct Scalar {
+	// The representation; fixed point makes the simulation identical on all machines.
+#ifdef USE_FIXED_POINT
+	typedef Fixed T;
+#else
 	typedef double T;
+#endif
 	typedef U1 Unit;
 	typedef Scalar<U1> Type;
 
@@ -21,12 +27,17 @@ struct Scalar {
 	// Construct from a value
 	Scalar(T _val) : value(_val) {}
 
+#ifdef USE_FIXED_POINT
+	// Construct from a floating point value
+	Scalar(double _val) : value(_val) {}
+#endif
+
 	// Copy constructor
 	Scalar(Type const& t) : value(t.value) {}
 
 	// Accessing the raw value
 	double getDouble() const {
-		return value;
+		return static_cast<double>(value);
 	}
 
 	// Assignment without type checks
@@ -149,6 +160,7 @@ struct Scalar {
 
 	// Modulo
 	Type mod(Type divisor) const {
+		using std::fmod;
 		return Type(fmod(value, divisor.value));
 	}
 };
@@ -156,7 +168,8 @@ struct Scalar {
 // Square root; the template magic requires a helper.
 template <typename U1>
 inline Scalar<U1> _sqrtHelper(Scalar<SIUnitMul(U1, 2)> const& x) {
-	return std::sqrt(x.value);
+	using std::sqrt;
+	return sqrt(x.value);
 }
 template <typename U1>
 inline Scalar<SIUnitDiv(U1, 2)> sqrt(Scalar<U1> const& x) {
@@ -165,32 +178,39 @@ inline Scalar<SIUnitDiv(U1, 2)> sqrt(Scalar<U1> const& x) {
 
 // Power
 inline Scalar<> pow(Scalar<> const& x, Scalar<> const& y) {
-	return std::pow(x.value, y.value);
+	using std::pow;
+	return pow(x.value, y.value);
 }
 
 // Exponent function
 inline Scalar<> exp(Scalar<> const& x) {
-	return std::exp(x.value);
+	using std::exp;
+	return exp(x.value);
 }
 
 // Logarithm
 inline Scalar<> log(Scalar<> const& x) {
-	return std::log(x.value);
+	using std::log;
+	return log(x.value);
 }
 
 // Trigonometry
 inline Scalar<> cos(Scalar<> const& a) {
-	return std::cos(a.value);
+	using std::cos;
+	return cos(a.value);
 }
 inline Scalar<> sin(Scalar<> const& a) {
-	return std::sin(a.value);
+	using std::sin;
+	return sin(a.value);
 }
 inline Scalar<> tan(Scalar<> const& a) {
-	return std::tan(a.value);
+	using std::tan;
+	return tan(a.value);
 }
 template <typename U1>
 inline Scalar<> atan2(Scalar<U1> const& y, Scalar<U1> const& x) {
-	return std::atan2(y.value, x.value);
+	using std::atan2;
+	return atan2(y.value, x.value);
 }
 
 #endif
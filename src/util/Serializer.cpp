@@ -1,24 +1,47 @@
+#include <cstring>
+
 #include "Serializer.hpp"
 
+void Serializer::putVarint(std::uint64_t value) {
+	while (value >= 0x80) {
+		data.push_back((char) (value | 0x80));
+		value >>= 7;
+	}
+	data.push_back((char) value);
+}
+
 void Serializer::put(const unsigned int& value) {
-	data << value << '\n';
+	putVarint(value);
 }
 
 void Serializer::put(const int& value) {
-	data << value << '\n';
+	// Zigzag encoding keeps small negative numbers short.
+	putVarint(value < 0 ? ~((std::uint64_t) value << 1) : (std::uint64_t) value << 1);
+}
+
+void Serializer::put(const std::uint64_t& value) {
+	putVarint(value);
 }
 
 void Serializer::put(const bool& value) {
-	data << (value ? 1 : 0) << '\n';
+	data.push_back(value ? 1 : 0);
 }
 
 void Serializer::put(const Scalar<>& value) {
-	data << value.getDouble() << '\n';
+#ifdef USE_FIXED_POINT
+	const Fixed::RawType raw = value.value.raw;
+	putVarint(raw < 0 ? ~((std::uint64_t) raw << 1) : (std::uint64_t) raw << 1);
+#else
+	// Write the bits of the double in little endian order.
+	std::uint64_t bits;
+	std::memcpy(&bits, &value.value, sizeof(bits));
+	for (int i = 0; i < 8; ++i) {
+		data.push_back((char) (bits >> (8 * i)));
+	}
+#endif
 }
 
 void Serializer::put(const std::string& value) {
-	unsigned int size = value.size();
-	put(size);
-	data.write(value.c_str(), size);
-	data << '\n';
+	putVarint(value.size());
+	data.append(value);
 }
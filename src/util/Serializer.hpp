@@ -1,7 +1,7 @@
 #ifndef PUTKARTS_Serializer_HPP
 #define PUTKARTS_Serializer_HPP
 
-#include <sstream>
+#include <cstdint>
 #include <string>
 
 #include "Scalar.hpp"
@@ -9,19 +9,49 @@
 
 /**
  * Functions for serializing and unserializing data.
+ *
+ * The data is binary: integers are written as variable length numbers
+ * (7 bits per byte), booleans as one byte, scalars as raw IEEE doubles
+ * or raw fixed point values, and strings with a length prefix. The data
+ * starts with a format version byte so that incompatible peers are
+ * detected by Deserializer.
  */
 class Serializer {
 	/** The data. */
-	std::ostringstream data;
+	std::string data;
+
+	/**
+	 * Serialize an unsigned variable length number.
+	 *
+	 * @param value The value to serialize.
+	 */
+	void putVarint(std::uint64_t value);
 
 public:
+	/** The format version; the first byte of the data. Not ASCII, so old text data doesn't match. */
+	static const unsigned char version = 0x82;
+
+	/**
+	 * Constructor.
+	 */
+	Serializer() {
+		clear();
+	}
+
 	/**
 	 * Get the serialized data.
 	 *
 	 * @return The data.
 	 */
-	std::string getData() const {
-		return data.str();
+	const std::string& getData() const {
+		return data;
+	}
+
+	/**
+	 * Start over; the buffer is kept, so it's cheap to reuse the serializer.
+	 */
+	void clear() {
+		data.assign(1, (char) version);
 	}
 
 	/**
@@ -38,6 +68,13 @@ public:
 	 */
 	void put(const int& value);
 
+	/**
+	 * Serialize a 64-bit unsigned integer.
+	 *
+	 * @param value The value to serialize.
+	 */
+	void put(const std::uint64_t& value);
+
 	/**
 	 * Serialize a boolean.
 	 *
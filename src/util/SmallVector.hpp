@@ -0,0 +1,167 @@
+#ifndef PUTKARTS_SmallVector_HPP
+#define PUTKARTS_SmallVector_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+
+/**
+ * Vector that stores up to N elements without allocating memory.
+ *
+ * Only for trivial types, which are copied with memcpy.
+ */
+template <typename T, std::size_t N> class SmallVector {
+	static_assert(std::is_trivial<T>::value, "SmallVector: T must be trivial");
+
+public:
+	typedef T value_type;
+	typedef std::size_t size_type;
+	typedef T* iterator;
+	typedef const T* const_iterator;
+
+private:
+	/** The elements; either storage or on the heap. */
+	T* elements;
+
+	/** The number of elements. */
+	size_type count;
+
+	/** The number of elements that fit in the current memory. */
+	size_type capacity_;
+
+	/** Memory for the first N elements. */
+	T storage[N];
+
+	/**
+	 * Is the memory on the heap?
+	 */
+	bool isAllocated() const {
+		return elements != storage;
+	}
+
+public:
+	/**
+	 * Constructor.
+	 */
+	SmallVector():
+		elements(storage),
+		count(0),
+		capacity_(N) {
+	}
+
+	/**
+	 * Copy constructor.
+	 */
+	SmallVector(const SmallVector& other):
+		elements(storage),
+		count(0),
+		capacity_(N) {
+		*this = other;
+	}
+
+	/**
+	 * Destructor.
+	 */
+	~SmallVector() {
+		if (isAllocated()) {
+			delete[] elements;
+		}
+	}
+
+	/**
+	 * Copy assignment; keeps the current memory if the elements fit.
+	 */
+	SmallVector& operator = (const SmallVector& other) {
+		if (this != &other) {
+			clear();
+			reserve(other.count);
+			std::memcpy(elements, other.elements, other.count * sizeof(T));
+			count = other.count;
+		}
+		return *this;
+	}
+
+	size_type size() const {
+		return count;
+	}
+	bool empty() const {
+		return !count;
+	}
+	size_type capacity() const {
+		return capacity_;
+	}
+
+	iterator begin() {
+		return elements;
+	}
+	iterator end() {
+		return elements + count;
+	}
+	const_iterator begin() const {
+		return elements;
+	}
+	const_iterator end() const {
+		return elements + count;
+	}
+
+	T& operator [] (size_type i) {
+		return elements[i];
+	}
+	const T& operator [] (size_type i) const {
+		return elements[i];
+	}
+	T& back() {
+		return elements[count - 1];
+	}
+	const T& back() const {
+		return elements[count - 1];
+	}
+
+	/**
+	 * Make room for at least n elements.
+	 */
+	void reserve(size_type n) {
+		if (n <= capacity_) {
+			return;
+		}
+		n = std::max(n, 2 * capacity_);
+		T* memory = new T[n];
+		std::memcpy(memory, elements, count * sizeof(T));
+		if (isAllocated()) {
+			delete[] elements;
+		}
+		elements = memory;
+		capacity_ = n;
+	}
+
+	void push_back(const T& value) {
+		if (count == capacity_) {
+			// The value may be in the old memory, so copy it first.
+			T tmp(value);
+			reserve(count + 1);
+			elements[count++] = tmp;
+		} else {
+			elements[count++] = value;
+		}
+	}
+	void pop_back() {
+		--count;
+	}
+
+	/**
+	 * Remove the elements; the memory is kept.
+	 */
+	void clear() {
+		count = 0;
+	}
+
+	bool operator == (const SmallVector& other) const {
+		return count == other.count && std::equal(begin(), end(), other.begin());
+	}
+	bool operator != (const SmallVector& other) const {
+		return !(*this == other);
+	}
+};
+
+#endif